@@ -0,0 +1,799 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+
+/**
+ * Throughput benchmarks for the codec as a whole and for each of its 
+ * stages.  The input is the ETSI test data and male-1.wav.
+ * 
+ * Usage: gsm-bench [--data <dir>] [--json <file>] [--baseline <file>] 
+ *                  [--threshold <percent>] [--min-time <seconds>] [--counters]
+ * 
+ * The results are printed and (optionally) written as JSON.  If a 
+ * baseline JSON file from an earlier run is given then each benchmark 
+ * is compared against it and the exit code is 1 if any of them got 
+ * slower by more than the threshold (default 10%).
+ *
+ * With --counters (Linux) each benchmark is run once more with the 
+ * hardware counters enabled and the cycles, instructions, branch misses 
+ * and L1D read misses per frame are reported.  Since there is a benchmark
+ * for each stage this tells whether a stage is limited by compute, 
+ * branching or memory.  Counters that can't be opened are shown as "-".
+ */
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "perf_counters.h"
+#include "fixed_math.h"
+#include "kernels.h"
+#include "gsm-0610-codec/Parameters.h"
+#include "gsm-0610-codec/Encoder.h"
+#include "gsm-0610-codec/EncoderBank.h"
+#include "gsm-0610-codec/IncrementalEncoder.h"
+#include "gsm-0610-codec/Decoder.h"
+#include "gsm-0610-codec/DecoderBank.h"
+#include "gsm-0610-codec/wav_util.h"
+
+using namespace kc1fsz;
+
+struct Result {
+    std::string name;
+    double nsPerFrame;
+    double framesPerSec;
+    // Hardware counts per frame, negative if not measured
+    double perFrame[PerfCounters::COUNT];
+};
+
+// Results are folded into this so that the work can't be optimized away
+static volatile int32_t sink = 0;
+
+static double minTime = 0.25;
+
+// Only set when --counters is used
+static PerfCounters* counters = 0;
+
+/**
+ * Calls f() (which processes framesPerCall frames) until at least 
+ * minTime seconds have gone by.
+ */
+template <typename F> static Result measure(const char* name, size_t framesPerCall, F f) {
+    // Warm up
+    f();
+    typedef std::chrono::steady_clock clock;
+    size_t calls = 0;
+    auto start = clock::now();
+    double elapsed = 0;
+    do {
+        f();
+        calls++;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < minTime);
+    double frames = (double)calls * (double)framesPerCall;
+    Result r = { name, elapsed * 1e9 / frames, frames / elapsed, { } };
+    for (unsigned c = 0; c < PerfCounters::COUNT; c++) {
+        r.perFrame[c] = -1;
+    }
+    if (counters) {
+        counters->start();
+        f();
+        counters->stop();
+        for (unsigned c = 0; c < PerfCounters::COUNT; c++) {
+            if (counters->isAvailable(c)) {
+                r.perFrame[c] = (double)counters->get(c) / (double)framesPerCall;
+            }
+        }
+    }
+    return r;
+}
+
+/**
+ * The time from the last sample of a frame to its parameters with the 
+ * incremental encoder, i.e. only the 160th push() of each frame is timed.
+ * (For encode() this is the whole call.)
+ */
+static Result measureEndOfFrame(const char* name, const std::vector<int16_t>& pcm, 
+    size_t frames) {
+    typedef std::chrono::steady_clock clock;
+    double timed = 0, elapsed = 0;
+    size_t count = 0;
+    auto start = clock::now();
+    do {
+        IncrementalEncoder encoder;
+        Parameters out;
+        for (size_t f = 0; f < frames; f++) {
+            const int16_t* frame = &pcm[f * 160];
+            for (uint16_t k = 0; k < 159; k++) {
+                encoder.push(frame[k], &out);
+            }
+            auto t0 = clock::now();
+            encoder.push(frame[159], &out);
+            timed += std::chrono::duration<double>(clock::now() - t0).count();
+        }
+        sink = sink + out.LARc[0];
+        count += frames;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < minTime);
+    Result r = { name, timed * 1e9 / (double)count, (double)count / timed, { } };
+    for (unsigned c = 0; c < PerfCounters::COUNT; c++) {
+        r.perFrame[c] = -1;
+    }
+    return r;
+}
+
+static std::vector<int16_t> loadInp(const std::string& fn) {
+    std::ifstream str(fn, std::ios::binary);
+    std::vector<int16_t> result;
+    uint8_t b[2];
+    while (str.read((char*)b, 2)) {
+        result.push_back((int16_t)(((uint16_t)b[1] << 8) | b[0]));
+    }
+    return result;
+}
+
+static std::vector<Parameters> loadCod(const std::string& fn) {
+    std::ifstream str(fn, std::ios::binary);
+    std::vector<Parameters> result;
+    Parameters p;
+    // NOTE: THERE IS AN ENDIANNESS ASSUMPTION HERE (same as the tests)
+    while (str.read((char*)&p, 76 * 2)) {
+        result.push_back(p);
+    }
+    return result;
+}
+
+/**
+ * The SNR (dB) of y[] vs. x[].
+ */
+static double snr(const std::vector<int16_t>& x, const std::vector<int16_t>& y) {
+    double signal = 0, noise = 0;
+    for (size_t k = 0; k < x.size(); k++) {
+        double e = (double)x[k] - (double)y[k];
+        signal += (double)x[k] * (double)x[k];
+        noise += e * e;
+    }
+    return 10.0 * log10(signal / (noise > 0 ? noise : 1));
+}
+
+/**
+ * The average of the per-frame SNR (dB), each clamped to [-10, 80] and 
+ * skipping silent frames.
+ */
+static double segmentalSnr(const std::vector<int16_t>& x, const std::vector<int16_t>& y) {
+    double sum = 0;
+    size_t count = 0;
+    for (size_t f = 0; f + 160 <= x.size(); f += 160) {
+        double signal = 0, noise = 0;
+        for (size_t k = f; k < f + 160; k++) {
+            double e = (double)x[k] - (double)y[k];
+            signal += (double)x[k] * (double)x[k];
+            noise += e * e;
+        }
+        if (signal < 160.0 * 64 * 64) {
+            continue;
+        }
+        double s = 10.0 * log10(signal / (noise > 0 ? noise : 1));
+        sum += s < -10 ? -10 : (s > 80 ? 80 : s);
+        count++;
+    }
+    return count ? sum / count : 0;
+}
+
+/**
+ * Encodes and decodes pcm[] and prints the quality of the result.
+ */
+static void printQuality(const char* label, Encoder& encoder, const std::vector<int16_t>& pcm,
+    size_t frames) {
+    Decoder decoder;
+    std::vector<int16_t> out(pcm.size());
+    for (size_t f = 0; f < frames; f++) {
+        Parameters p;
+        encoder.encode(&pcm[f * 160], &p);
+        decoder.decode(&p, &out[f * 160]);
+    }
+    printf("%s: SNR %.2f dB, segmental SNR %.2f dB\n", label, snr(pcm, out), 
+        segmentalSnr(pcm, out));
+}
+
+// ----- JSON ------------------------------------------------------------------
+
+static void writeJson(std::ostream& str, const std::vector<Result>& results) {
+    str << "{\n  \"benchmark\": \"gsm-bench\",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        char line[256];
+        snprintf(line, sizeof(line), 
+            "    { \"name\": \"%s\", \"ns_per_frame\": %.1f, \"frames_per_sec\": %.1f",
+            results[i].name.c_str(), results[i].nsPerFrame, results[i].framesPerSec);
+        str << line;
+        for (unsigned c = 0; c < PerfCounters::COUNT; c++) {
+            if (results[i].perFrame[c] >= 0) {
+                snprintf(line, sizeof(line), ", \"%s_per_frame\": %.1f", 
+                    PerfCounters::name(c), results[i].perFrame[c]);
+                str << line;
+            }
+        }
+        str << (i + 1 < results.size() ? " },\n" : " }\n");
+    }
+    str << "  ]\n}\n";
+}
+
+/**
+ * Just enough of a parser to read back what writeJson() produces.
+ */
+static std::vector<Result> readJson(std::istream& str) {
+    std::stringstream ss;
+    ss << str.rdbuf();
+    std::string doc = ss.str();
+    std::vector<Result> results;
+    size_t pos = 0;
+    while ((pos = doc.find("\"name\"", pos)) != std::string::npos) {
+        size_t q0 = doc.find('"', doc.find(':', pos));
+        size_t q1 = doc.find('"', q0 + 1);
+        if (q0 == std::string::npos || q1 == std::string::npos) {
+            break;
+        }
+        Result r;
+        r.name = doc.substr(q0 + 1, q1 - q0 - 1);
+        size_t n = doc.find("\"ns_per_frame\"", q1);
+        size_t f = doc.find("\"frames_per_sec\"", q1);
+        if (n == std::string::npos || f == std::string::npos) {
+            break;
+        }
+        r.nsPerFrame = strtod(doc.c_str() + doc.find(':', n) + 1, 0);
+        r.framesPerSec = strtod(doc.c_str() + doc.find(':', f) + 1, 0);
+        results.push_back(r);
+        pos = q1;
+    }
+    return results;
+}
+
+// ----- Benchmarks ------------------------------------------------------------
+
+/**
+ * The intermediate signals of the encoder for each frame, captured 
+ * once up front so that each stage can be timed on its own using 
+ * realistic input.
+ */
+struct EncoderTrace {
+    // Pre-emphasized signal (input to lpcAnalysis())
+    std::vector<int16_t> s;
+    std::vector<int16_t> smax;
+    // Input to shortTermAnalysis()
+    std::vector<int16_t> sScaled;
+    std::vector<int16_t> rp;
+    // Short term residual, scaled sub-segments and the dp[] history
+    // at the start of each sub-segment
+    std::vector<int16_t> d;
+    std::vector<int16_t> wt;
+    std::vector<int16_t> dp;
+};
+
+static EncoderTrace traceEncoder(const std::vector<int16_t>& pcm, size_t frames) {
+
+    EncoderTrace t;
+    t.s.resize(frames * 160);
+    t.smax.resize(frames);
+    t.sScaled.resize(frames * 160);
+    t.rp.resize(frames * 4 * 9);
+    t.d.resize(frames * 160);
+    t.wt.resize(frames * 160);
+    t.dp.resize(frames * 4 * 120);
+
+    int16_t z1 = 0, mp = 0;
+    int32_t L_z2 = 0;
+    int16_t LARpp_last[9] = { 0 };
+    int16_t u[8] = { 0 };
+    int16_t dp[240] = { 0 };
+    uint16_t head = 0;
+
+    for (size_t f = 0; f < frames; f++) {
+        int16_t* s = &t.s[f * 160];
+        bool homing;
+        t.smax[f] = Encoder::preprocess(&pcm[f * 160], &z1, &L_z2, &mp, s, &homing);
+
+        int16_t* sScaled = &t.sScaled[f * 160];
+        memcpy(sScaled, s, 160 * 2);
+        uint16_t LARc[8];
+        Encoder::lpcAnalysis(sScaled, t.smax[f], LARc);
+        int16_t (*rp)[9] = (int16_t (*)[9])&t.rp[f * 36];
+        Encoder::decodeReflectionCoefficients(LARc, LARpp_last, rp);
+
+        int16_t* d = &t.d[f * 160];
+        Encoder::shortTermAnalysis(rp, u, sScaled, d);
+
+        for (uint16_t j = 0; j < 4; j++) {
+            memcpy(&t.dp[(f * 4 + j) * 120], dp + head, 120 * 2);
+            // Same scaling as in encodeSubSegment()
+            const int16_t* dj = d + (j * 40);
+            int16_t dmax = 0;
+            for (uint16_t k = 0; k < 40; k++) {
+                int16_t temp = s_abs(dj[k]);
+                dmax = temp > dmax ? temp : dmax;
+            }
+            int16_t temp = dmax == 0 ? 0 : norm((int32_t)dmax << 16);
+            int16_t scal = temp > 6 ? 0 : sub(6, temp);
+            for (uint16_t k = 0; k < 40; k++) {
+                t.wt[f * 160 + j * 40 + k] = dj[k] >> scal;
+            }
+            SubSegParameters out;
+            Encoder::encodeSubSegment(dj, dp + head, &out);
+            head = Encoder::nextHistoryHead(head);
+        }
+    }
+    return t;
+}
+
+int main(int argc, const char** argv) {
+
+    std::string dataDir = "../tests/data";
+    std::string jsonFn, baselineFn;
+    double threshold = 10.0;
+    bool useCounters = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--data" && i + 1 < argc) {
+            dataDir = argv[++i];
+        } else if (arg == "--json" && i + 1 < argc) {
+            jsonFn = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baselineFn = argv[++i];
+        } else if (arg == "--threshold" && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            minTime = atof(argv[++i]);
+        } else if (arg == "--counters") {
+            useCounters = true;
+        } else {
+            std::cerr << "Usage: gsm-bench [--data <dir>] [--json <file>] [--baseline <file>] "
+                "[--threshold <percent>] [--min-time <seconds>] [--counters]" << std::endl;
+            return 2;
+        }
+    }
+
+    // ----- Load the test data ----------------------------------------------
+
+    std::vector<int16_t> pcm;
+    for (const char* seq : { "Seq01", "Seq02", "Seq03", "Seq04" }) {
+        std::vector<int16_t> x = loadInp(dataDir + "/" + seq + ".inp");
+        pcm.insert(pcm.end(), x.begin(), x.end());
+    }
+    std::vector<int16_t> wavPcm(160 * 1024);
+    {
+        std::ifstream str(dataDir + "/male-1.wav", std::ios::binary);
+        int samples = decodeToPCM16(str, wavPcm.data(), wavPcm.size());
+        if (samples < 0) {
+            std::cerr << "Unable to read male-1.wav" << std::endl;
+            return 2;
+        }
+        wavPcm.resize(samples - (samples % 160));
+        pcm.insert(pcm.end(), wavPcm.begin(), wavPcm.end());
+    }
+    const size_t frames = pcm.size() / 160;
+
+    std::vector<Parameters> params;
+    for (const char* seq : { "Seq01", "Seq02", "Seq03", "Seq04", "Seq05" }) {
+        std::vector<Parameters> x = loadCod(dataDir + "/" + seq + ".cod");
+        params.insert(params.end(), x.begin(), x.end());
+    }
+
+    if (frames == 0 || params.empty()) {
+        std::cerr << "No test data found in " << dataDir << std::endl;
+        return 2;
+    }
+
+    std::vector<uint8_t> packed(params.size() * 33);
+    Parameters::packBatch(params.data(), params.size(), packed.data());
+
+    EncoderTrace trace = traceEncoder(pcm, frames);
+
+    std::cout << "Frames: " << frames << " (encoder), " << params.size() 
+        << " (decoder)" << std::endl;
+
+    // The quality of each complexity level and of the float analysis, 
+    // encode + decode vs. the input
+    for (unsigned level = 0; level <= Encoder::MAX_COMPLEXITY; level++) {
+        Encoder encoder;
+        encoder.setComplexity(level);
+        std::string label = "Complexity " + std::to_string(level);
+        printQuality(label.c_str(), encoder, pcm, frames);
+    }
+    {
+        Encoder encoder;
+        encoder.setFloatAnalysis(true);
+        printQuality("Float analysis", encoder, pcm, frames);
+    }
+
+    PerfCounters perfCounters;
+    if (useCounters) {
+        if (perfCounters.isAnyAvailable()) {
+            counters = &perfCounters;
+        } else {
+            std::cout << "Hardware counters are not available (not Linux, no PMU or " 
+                "perf_event_paranoid too high), continuing without them" << std::endl;
+        }
+    }
+
+    // ----- Run ----------------------------------------------------------------
+
+    std::vector<Result> results;
+
+    results.push_back(measure("encode", frames, [&]() {
+        Encoder encoder;
+        Parameters out;
+        for (size_t f = 0; f < frames; f++) {
+            encoder.encode(&pcm[f * 160], &out);
+        }
+        sink = sink + out.LARc[0];
+    }));
+
+    // The reduced LTP lag searches (see Encoder::setComplexity())
+    for (unsigned level = 1; level <= Encoder::MAX_COMPLEXITY; level++) {
+        std::string name = "encode.complexity" + std::to_string(level);
+        results.push_back(measure(name.c_str(), frames, [&]() {
+            Encoder encoder;
+            encoder.setComplexity(level);
+            Parameters out;
+            for (size_t f = 0; f < frames; f++) {
+                encoder.encode(&pcm[f * 160], &out);
+            }
+            sink = sink + out.LARc[0];
+        }));
+    }
+
+    // The single-precision analysis (see Encoder::setFloatAnalysis())
+    results.push_back(measure("encode.float", frames, [&]() {
+        Encoder encoder;
+        encoder.setFloatAnalysis(true);
+        Parameters out;
+        for (size_t f = 0; f < frames; f++) {
+            encoder.encode(&pcm[f * 160], &out);
+        }
+        sink = sink + out.LARc[0];
+    }));
+
+    // Packed output one frame at a time vs. all of the frames in one call
+    // (see Encoder::encodeFrames())
+    std::vector<uint8_t> packedOut(frames * 33);
+    results.push_back(measure("encode.packed", frames, [&]() {
+        Encoder encoder;
+        for (size_t f = 0; f < frames; f++) {
+            encoder.encode(&pcm[f * 160], &packedOut[f * 33]);
+        }
+        sink = sink + packedOut[0];
+    }));
+
+    results.push_back(measure("encode.frames", frames, [&]() {
+        Encoder encoder;
+        encoder.encodeFrames(pcm.data(), frames, packedOut.data());
+        sink = sink + packedOut[0];
+    }));
+
+    // A sample at a time (see IncrementalEncoder.h), the total and the 
+    // part that is left for the end of the frame
+    results.push_back(measure("encode.incremental", frames, [&]() {
+        IncrementalEncoder encoder;
+        Parameters out;
+        for (size_t k = 0; k < frames * 160; k++) {
+            encoder.push(pcm[k], &out);
+        }
+        sink = sink + out.LARc[0];
+    }));
+
+    results.push_back(measureEndOfFrame("encode.end_of_frame", pcm, frames));
+
+    // Eight streams in lockstep (see EncoderBank.h), each starting at a 
+    // different frame.  The time is per channel, so it compares directly 
+    // with "encode".
+    results.push_back(measure("encode.bank8", frames * 8, [&]() {
+        EncoderBank<8> bank;
+        Parameters out[8];
+        for (size_t f = 0; f < frames; f++) {
+            const int16_t* in[8];
+            for (unsigned lane = 0; lane < 8; lane++) {
+                in[lane] = &pcm[((f + lane * 17) % frames) * 160];
+            }
+            bank.encode(in, out);
+        }
+        sink = sink + out[0].LARc[0];
+    }));
+
+    // Two channels of interleaved PCM, one after the other and then on 
+    // a thread each (see encodeChannels()).  The time is per stereo frame.
+    std::vector<int16_t> stereo(frames * 160 * 2);
+    for (size_t k = 0; k < frames * 160; k++) {
+        stereo[2 * k] = pcm[k];
+        stereo[2 * k + 1] = pcm[frames * 160 - 1 - k];
+    }
+    std::vector<uint8_t> stereoPacked(frames * 33 * 2);
+    uint8_t* const stereoOut[2] = { &stereoPacked[0], &stereoPacked[frames * 33] };
+    results.push_back(measure("encode.stereo", frames, [&]() {
+        for (unsigned c = 0; c < 2; c++) {
+            Encoder encoder;
+            encoder.encodeFrames(&stereo[c], frames, stereoOut[c], 2);
+        }
+        sink = sink + stereoPacked[0];
+    }));
+
+    results.push_back(measure("encode.stereo.threads", frames, [&]() {
+        encodeChannels(stereo.data(), 2, frames * 160, stereoOut);
+        sink = sink + stereoPacked[0];
+    }));
+
+    results.push_back(measure("decode.stereo", frames, [&]() {
+        for (unsigned c = 0; c < 2; c++) {
+            Decoder decoder;
+            decoder.decodeFrames(stereoOut[c], frames, &stereo[c], 2);
+        }
+        sink = sink + stereo[0];
+    }));
+
+    results.push_back(measure("decode.stereo.threads", frames, [&]() {
+        const uint8_t* const in[2] = { stereoOut[0], stereoOut[1] };
+        decodeChannels(in, 2, frames, stereo.data());
+        sink = sink + stereo[0];
+    }));
+
+    results.push_back(measure("decode", params.size(), [&]() {
+        Decoder decoder;
+        int16_t out[160];
+        for (size_t f = 0; f < params.size(); f++) {
+            decoder.decode(&params[f], out);
+        }
+        sink = sink + out[0];
+    }));
+
+    // Eight streams in lockstep (see DecoderBank.h), per channel like 
+    // encode.bank8
+    std::vector<Parameters> bankParams(params.size() * 8);
+    for (size_t f = 0; f < params.size(); f++) {
+        for (unsigned lane = 0; lane < 8; lane++) {
+            bankParams[f * 8 + lane] = params[(f + lane * 17) % params.size()];
+        }
+    }
+    results.push_back(measure("decode.bank8", params.size() * 8, [&]() {
+        DecoderBank<8> bank;
+        int16_t out[8][160];
+        int16_t* const outp[8] = { out[0], out[1], out[2], out[3], out[4], out[5], 
+            out[6], out[7] };
+        for (size_t f = 0; f < params.size(); f++) {
+            bank.decode(&bankParams[f * 8], outp);
+        }
+        sink = sink + out[0][0];
+    }));
+
+    std::vector<int16_t> pcmOut(params.size() * 160);
+    // 40 samples at a time (see Decoder::decodeBlock()), for the whole frame
+    results.push_back(measure("decode.blocks", params.size(), [&]() {
+        Decoder decoder;
+        int16_t out[160];
+        for (size_t f = 0; f < params.size(); f++) {
+            decoder.startFrame(&params[f]);
+            for (uint16_t j = 0; j < 4; j++) {
+                decoder.decodeBlock(out + (j * 40));
+            }
+        }
+        sink = sink + out[0];
+    }));
+
+    results.push_back(measure("decode.packed", params.size(), [&]() {
+        Decoder decoder;
+        for (size_t f = 0; f < params.size(); f++) {
+            decoder.decode(&packed[f * 33], &pcmOut[f * 160]);
+        }
+        sink = sink + pcmOut[0];
+    }));
+
+    results.push_back(measure("decode.frames", params.size(), [&]() {
+        Decoder decoder;
+        decoder.decodeFrames(packed.data(), params.size(), pcmOut.data());
+        sink = sink + pcmOut[0];
+    }));
+
+    results.push_back(measure("encode.preprocess", frames, [&]() {
+        int16_t z1 = 0, mp = 0, s[160];
+        int32_t L_z2 = 0;
+        bool homing;
+        int32_t acc = 0;
+        for (size_t f = 0; f < frames; f++) {
+            acc += Encoder::preprocess(&pcm[f * 160], &z1, &L_z2, &mp, s, &homing);
+        }
+        sink = sink + acc;
+    }));
+
+    // NOTE: This includes a 160 sample copy per frame since the signal
+    // is modified in place.
+    results.push_back(measure("encode.lpc", frames, [&]() {
+        int16_t s[160];
+        uint16_t LARc[8];
+        for (size_t f = 0; f < frames; f++) {
+            memcpy(s, &trace.s[f * 160], sizeof(s));
+            Encoder::lpcAnalysis(s, trace.smax[f], LARc);
+        }
+        sink = sink + LARc[0];
+    }));
+
+    results.push_back(measure("encode.short_term", frames, [&]() {
+        int16_t u[8] = { 0 };
+        int16_t d[160];
+        for (size_t f = 0; f < frames; f++) {
+            Encoder::shortTermAnalysis((const int16_t (*)[9])&trace.rp[f * 36], u, 
+                &trace.sScaled[f * 160], d);
+        }
+        sink = sink + d[0];
+    }));
+
+    results.push_back(measure("encode.ltp_search", frames, [&]() {
+        int32_t L_max;
+        int32_t acc = 0;
+        for (size_t f = 0; f < frames; f++) {
+            for (uint16_t j = 0; j < 4; j++) {
+                acc += ltpLagSearch(&trace.wt[f * 160 + j * 40], &trace.dp[(f * 4 + j) * 120], 
+                    &L_max);
+            }
+        }
+        sink = sink + acc;
+    }));
+
+    // NOTE: The short term residual is used as the input since it has the
+    // same character as the long term residual e[].
+    results.push_back(measure("encode.rpe", frames, [&]() {
+        int16_t Mc, xmaxc, xMc[13];
+        int32_t acc = 0;
+        for (size_t f = 0; f < frames; f++) {
+            for (uint16_t j = 0; j < 4; j++) {
+                rpeEncode(&trace.d[f * 160 + j * 40], &Mc, &xmaxc, xMc);
+                acc += xmaxc;
+            }
+        }
+        sink = sink + acc;
+    }));
+
+    results.push_back(measure("decode.long_term", params.size(), [&]() {
+        int16_t drp[240] = { 0 };
+        int16_t nrp = 40;
+        uint16_t head = 0;
+        int16_t wt[160];
+        for (size_t f = 0; f < params.size(); f++) {
+            for (uint16_t j = 0; j < 4; j++) {
+                Decoder::decodeSubSegment(&params[f].subSegs[j], drp + head, &nrp, wt + j * 40);
+                head = Encoder::nextHistoryHead(head);
+            }
+        }
+        sink = sink + wt[0];
+    }));
+
+    results.push_back(measure("decode.short_term", params.size(), [&]() {
+        int16_t LARpp_last[9] = { 0 };
+        int16_t v[9] = { 0 };
+        int16_t msr = 0;
+        int16_t rrp[4][9];
+        int16_t out[160];
+        for (size_t f = 0; f < params.size(); f++) {
+            Encoder::decodeReflectionCoefficients(&params[f], LARpp_last, rrp);
+            // NOTE: The residual isn't important here, the trace is used
+            Decoder::shortTermSynthesis(rrp, v, &msr, &trace.d[(f % frames) * 160], out);
+        }
+        sink = sink + out[0];
+    }));
+
+    results.push_back(measure("pack", params.size(), [&]() {
+        for (size_t f = 0; f < params.size(); f++) {
+            params[f].pack(&packed[f * 33]);
+        }
+        sink = sink + packed[1];
+    }));
+
+    results.push_back(measure("unpack", params.size(), [&]() {
+        Parameters p;
+        int32_t acc = 0;
+        for (size_t f = 0; f < params.size(); f++) {
+            p.unpack(&packed[f * 33]);
+            acc += p.LARc[0];
+        }
+        sink = sink + acc;
+    }));
+
+    results.push_back(measure("wav_io", wavPcm.size() / 160, [&]() {
+        std::stringstream str;
+        encodeFromPCM16(wavPcm.data(), wavPcm.size(), str, 8000);
+        std::vector<int16_t> back(wavPcm.size());
+        sink = sink + decodeToPCM16(str, back.data(), back.size());
+    }));
+
+    // ----- Report -------------------------------------------------------------
+
+    std::vector<Result> baseline;
+    if (!baselineFn.empty()) {
+        std::ifstream str(baselineFn);
+        if (!str.good()) {
+            std::cerr << "Unable to read baseline " << baselineFn << std::endl;
+            return 2;
+        }
+        baseline = readJson(str);
+    }
+
+    int regressions = 0;
+    printf("%-20s %14s %14s %10s\n", "benchmark", "ns/frame", "frames/sec", 
+        baseline.empty() ? "" : "vs. base");
+    for (const Result& r : results) {
+        printf("%-20s %14.1f %14.1f", r.name.c_str(), r.nsPerFrame, r.framesPerSec);
+        for (const Result& b : baseline) {
+            if (b.name == r.name && b.nsPerFrame > 0) {
+                double change = 100.0 * (r.nsPerFrame - b.nsPerFrame) / b.nsPerFrame;
+                printf(" %+9.1f%%", change);
+                if (change > threshold) {
+                    printf("  REGRESSION");
+                    regressions++;
+                }
+            }
+        }
+        printf("\n");
+    }
+
+    if (counters) {
+        printf("\n%-20s %12s %12s %6s %12s %12s\n", "per frame", "cycles", "instructions", 
+            "IPC", "br-misses", "L1D-misses");
+        for (const Result& r : results) {
+            printf("%-20s", r.name.c_str());
+            const unsigned order[] = { PerfCounters::CYCLES, PerfCounters::INSTRUCTIONS };
+            for (unsigned c : order) {
+                if (r.perFrame[c] >= 0) {
+                    printf(" %12.0f", r.perFrame[c]);
+                } else {
+                    printf(" %12s", "-");
+                }
+            }
+            if (r.perFrame[PerfCounters::CYCLES] > 0 && r.perFrame[PerfCounters::INSTRUCTIONS] >= 0) {
+                printf(" %6.2f", r.perFrame[PerfCounters::INSTRUCTIONS] / 
+                    r.perFrame[PerfCounters::CYCLES]);
+            } else {
+                printf(" %6s", "-");
+            }
+            const unsigned order2[] = { PerfCounters::BRANCH_MISSES, PerfCounters::L1D_MISSES };
+            for (unsigned c : order2) {
+                if (r.perFrame[c] >= 0) {
+                    printf(" %12.1f", r.perFrame[c]);
+                } else {
+                    printf(" %12s", "-");
+                }
+            }
+            printf("\n");
+        }
+    }
+
+    if (!jsonFn.empty()) {
+        std::ofstream str(jsonFn);
+        writeJson(str, results);
+    }
+
+    if (regressions > 0) {
+        printf("%d benchmark(s) slower than the baseline by more than %.1f%%\n", 
+            regressions, threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,217 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+
+/**
+ * Range profile of the fixed-point operations.
+ *
+ * Usage: gsm-range [--data <dir>] [--seed <n>]
+ *
+ * The codec is built with GSM_RANGE_PROFILE (see fixed_math.h and 
+ * range_profile.h) and without the SSE/AVX kernels, so every call of a
+ * fixed-point operation records its exact result.  The inputs are the 
+ * ETSI sequences (encoded and decoded), male-1.wav, some synthetic stress
+ * signals and random parameters for the decoder.  The observed range of 
+ * each call site is printed.
+ *
+ * The exit code is 1 if any of the ..._nosat() call sites would have 
+ * saturated, meaning that its RANGE NOTE is wrong.
+ */
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gsm-0610-codec/Parameters.h"
+#include "gsm-0610-codec/PackedFrame.h"
+#include "gsm-0610-codec/Encoder.h"
+#include "gsm-0610-codec/Decoder.h"
+#include "gsm-0610-codec/EncoderBank.h"
+#include "gsm-0610-codec/DecoderBank.h"
+#include "gsm-0610-codec/wav_util.h"
+
+#include "range_profile.h"
+
+using namespace kc1fsz;
+
+static uint32_t lcg_state = 1;
+
+static int16_t rand16(int16_t lo, int16_t hi) {
+    lcg_state = lcg_state * 1664525 + 1013904223;
+    return lo + (int16_t)((lcg_state >> 8) % (uint32_t)(hi - lo + 1));
+}
+
+// ----- Inputs ----------------------------------------------------------------
+
+static std::vector<int16_t> loadInp(const std::string& fn) {
+    std::ifstream str(fn, std::ios::binary);
+    std::vector<int16_t> result;
+    uint8_t b[2];
+    while (str.read((char*)b, 2)) {
+        result.push_back((int16_t)(((uint16_t)b[1] << 8) | b[0]));
+    }
+    return result;
+}
+
+static std::vector<Parameters> loadCod(const std::string& fn) {
+    std::ifstream str(fn, std::ios::binary);
+    std::vector<Parameters> result;
+    Parameters p;
+    // NOTE: THERE IS AN ENDIANNESS ASSUMPTION HERE (same as the tests)
+    while (str.read((char*)&p, 76 * 2)) {
+        result.push_back(p);
+    }
+    return result;
+}
+
+static const unsigned STRESS_FRAMES = 200;
+
+static std::vector<int16_t> squareWave(unsigned period) {
+    std::vector<int16_t> pcm(STRESS_FRAMES * 160);
+    for (size_t k = 0; k < pcm.size(); k++) {
+        pcm[k] = (k % period) < period / 2 ? 32767 : -32768;
+    }
+    return pcm;
+}
+
+static std::vector<int16_t> clippingNoise() {
+    std::vector<int16_t> pcm(STRESS_FRAMES * 160);
+    for (size_t k = 0; k < pcm.size(); k++) {
+        int32_t x = (int32_t)rand16(-32768, 32767) * 4;
+        pcm[k] = x > 32767 ? 32767 : (x < -32768 ? -32768 : x);
+    }
+    return pcm;
+}
+
+static std::vector<int16_t> homingPattern() {
+    std::vector<int16_t> pcm = clippingNoise();
+    for (size_t f = 4; f < STRESS_FRAMES; f += 5) {
+        for (uint16_t k = 0; k < 160; k++) {
+            pcm[f * 160 + k] = 1;
+        }
+    }
+    return pcm;
+}
+
+static void randomParams(Parameters* p) {
+    for (uint16_t i = 0; i < 8; i++) {
+        p->LARc[i] = rand16(0, (1 << PackedFrame::LARC_BITS[i]) - 1);
+    }
+    for (uint16_t j = 0; j < 4; j++) {
+        p->subSegs[j].Nc = rand16(0, 127);
+        p->subSegs[j].bc = rand16(0, 3);
+        p->subSegs[j].Mc = rand16(0, 3);
+        p->subSegs[j].xmaxc = rand16(0, 63);
+        for (uint16_t i = 0; i < 13; i++) {
+            p->subSegs[j].xMc[i] = rand16(0, 7);
+        }
+    }
+}
+
+// ----- Profiling -------------------------------------------------------------
+
+static const unsigned LANES = 3;
+
+/**
+ * Encodes the signal (with the Encoder and with every lane of an 
+ * EncoderBank) and then decodes the result.
+ */
+static void encodeDecode(const std::vector<int16_t>& pcm) {
+    Encoder encoder;
+    Decoder decoder;
+    EncoderBank<LANES> encoderBank;
+    DecoderBank<LANES> decoderBank;
+    Parameters params, bankParams[LANES];
+    int16_t out[160], bankOut[LANES][160];
+    int16_t* const bankOutPtrs[LANES] = { bankOut[0], bankOut[1], bankOut[2] };
+    for (size_t f = 0; f + 160 <= pcm.size(); f += 160) {
+        encoder.encode(pcm.data() + f, &params);
+        decoder.decode(&params, out);
+        const int16_t* const in[LANES] = { pcm.data() + f, pcm.data() + f, pcm.data() + f };
+        encoderBank.encode(in, bankParams);
+        decoderBank.decode(bankParams, bankOutPtrs);
+    }
+}
+
+static void decode(const std::vector<Parameters>& params) {
+    Decoder decoder;
+    int16_t out[160];
+    for (const Parameters& p : params) {
+        decoder.decode(&p, out);
+    }
+}
+
+int main(int argc, const char** argv) {
+
+    std::string dataDir = "../tests/data";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--data" && i + 1 < argc) {
+            dataDir = argv[++i];
+        } else if (arg == "--seed" && i + 1 < argc) {
+            lcg_state = strtoul(argv[++i], 0, 10);
+        } else {
+            std::cerr << "Usage: gsm-range [--data <dir>] [--seed <n>]" << std::endl;
+            return 2;
+        }
+    }
+
+    bool found = false;
+    for (const char* seq : { "Seq01", "Seq02", "Seq03", "Seq04", "Seq05" }) {
+        std::vector<int16_t> pcm = loadInp(dataDir + "/" + seq + ".inp");
+        if (!pcm.empty()) {
+            encodeDecode(pcm);
+            found = true;
+        }
+        decode(loadCod(dataDir + "/" + seq + ".cod"));
+    }
+    if (!found) {
+        std::cerr << "No test data found in " << dataDir << std::endl;
+        return 2;
+    }
+    {
+        std::vector<int16_t> pcm(160 * 1024);
+        std::ifstream str(dataDir + "/male-1.wav", std::ios::binary);
+        int samples = decodeToPCM16(str, pcm.data(), pcm.size());
+        if (samples > 0) {
+            pcm.resize(samples);
+            encodeDecode(pcm);
+        }
+    }
+    encodeDecode(squareWave(40));
+    encodeDecode(squareWave(4));
+    encodeDecode(clippingNoise());
+    encodeDecode(homingPattern());
+
+    std::vector<Parameters> params(STRESS_FRAMES * 10);
+    for (Parameters& p : params) {
+        randomParams(&p);
+    }
+    decode(params);
+
+    unsigned violations = range::report(std::cout);
+    if (violations) {
+        std::cout << violations << " call site(s) outside of their RANGE NOTE" << std::endl;
+        return 1;
+    }
+    return 0;
+}
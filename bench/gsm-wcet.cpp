@@ -0,0 +1,578 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+
+/**
+ * Worst-case execution time of the encoder and decoder.
+ *
+ * Usage: gsm-wcet [--data <dir>] [--repeats <n>] [--iterations <n>]
+ *                 [--seed <n>] [--save <prefix>] [--counters]
+ *
+ * Each frame of each input is timed on its own and the distribution
+ * (p50/p99/max) of the per-frame cost is reported.  The inputs are the
+ * ETSI sequences, male-1.wav and some synthetic stress signals.  To keep
+ * OS noise (interrupts, preemption) out of the numbers every input is run
+ * --repeats times (default 5) and the minimum cost of each frame is used,
+ * so what remains is the data-dependent part.
+ *
+ * After that a random-mutation hill climb looks for the single frame
+ * that maximizes the encode time (and the set of parameters that
+ * maximizes the decode time).  Each search starts from the most expensive
+ * frame of the distributions, with the codec in the state it had when 
+ * that frame came along.  A candidate is kept when it increases the 
+ * median of --repeats timings, or with --counters (Linux) the instruction
+ * count, since the minimum cost changes too much from one run to the next 
+ * to climb on.  The result is then timed like the distributions and a 
+ * warning is printed if it isn't more expensive than the seed.  With --save the worst frames found 
+ * are written as <prefix>.inp and <prefix>.cod in the same format as the 
+ * ETSI test data.
+ *
+ * The costs are measured with the TSC on x86 and converted to ns.
+ */
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "perf_counters.h"
+#include "gsm-0610-codec/Parameters.h"
+#include "gsm-0610-codec/PackedFrame.h"
+#include "gsm-0610-codec/Encoder.h"
+#include "gsm-0610-codec/Decoder.h"
+#include "gsm-0610-codec/wav_util.h"
+
+using namespace kc1fsz;
+
+// ----- Timing ----------------------------------------------------------------
+
+static inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static double nsPerTick = 1.0;
+
+static void calibrate() {
+    typedef std::chrono::steady_clock clock;
+    auto start = clock::now();
+    uint64_t t0 = ticks();
+    while (std::chrono::duration<double>(clock::now() - start).count() < 0.05) {
+    }
+    uint64_t t1 = ticks();
+    double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    nsPerTick = ns / (double)(t1 - t0);
+}
+
+// Results are folded into this so that the work can't be optimized away
+static volatile int32_t sink = 0;
+
+static uint32_t lcg_state = 1;
+
+static int16_t rand16(int16_t lo, int16_t hi) {
+    lcg_state = lcg_state * 1664525 + 1013904223;
+    return lo + (int16_t)((lcg_state >> 8) % (uint32_t)(hi - lo + 1));
+}
+
+// ----- Inputs ----------------------------------------------------------------
+
+static std::vector<int16_t> loadInp(const std::string& fn) {
+    std::ifstream str(fn, std::ios::binary);
+    std::vector<int16_t> result;
+    uint8_t b[2];
+    while (str.read((char*)b, 2)) {
+        result.push_back((int16_t)(((uint16_t)b[1] << 8) | b[0]));
+    }
+    return result;
+}
+
+static std::vector<Parameters> loadCod(const std::string& fn) {
+    std::ifstream str(fn, std::ios::binary);
+    std::vector<Parameters> result;
+    Parameters p;
+    // NOTE: THERE IS AN ENDIANNESS ASSUMPTION HERE (same as the tests)
+    while (str.read((char*)&p, 76 * 2)) {
+        result.push_back(p);
+    }
+    return result;
+}
+
+static const unsigned STRESS_FRAMES = 200;
+
+static std::vector<int16_t> squareWave(unsigned period) {
+    std::vector<int16_t> pcm(STRESS_FRAMES * 160);
+    for (size_t k = 0; k < pcm.size(); k++) {
+        pcm[k] = (k % period) < period / 2 ? 32767 : -32768;
+    }
+    return pcm;
+}
+
+/**
+ * Loud noise that is hard-clipped at full scale most of the time.
+ */
+static std::vector<int16_t> clippingNoise() {
+    std::vector<int16_t> pcm(STRESS_FRAMES * 160);
+    for (size_t k = 0; k < pcm.size(); k++) {
+        int32_t x = (int32_t)rand16(-32768, 32767) * 4;
+        pcm[k] = x > 32767 ? 32767 : (x < -32768 ? -32768 : x);
+    }
+    return pcm;
+}
+
+/**
+ * Clipping noise with a homing frame (which resets the encoder) after
+ * every fourth frame.
+ */
+static std::vector<int16_t> homingPattern() {
+    std::vector<int16_t> pcm = clippingNoise();
+    for (size_t f = 4; f < STRESS_FRAMES; f += 5) {
+        for (uint16_t k = 0; k < 160; k++) {
+            pcm[f * 160 + k] = 1;
+        }
+    }
+    return pcm;
+}
+
+static void randomParams(Parameters* p) {
+    for (uint16_t i = 0; i < 8; i++) {
+        p->LARc[i] = rand16(0, (1 << PackedFrame::LARC_BITS[i]) - 1);
+    }
+    for (uint16_t j = 0; j < 4; j++) {
+        p->subSegs[j].Nc = rand16(0, 127);
+        p->subSegs[j].bc = rand16(0, 3);
+        p->subSegs[j].Mc = rand16(0, 3);
+        p->subSegs[j].xmaxc = rand16(0, 63);
+        for (uint16_t i = 0; i < 13; i++) {
+            p->subSegs[j].xMc[i] = rand16(0, 7);
+        }
+    }
+}
+
+// ----- Per-frame distribution ------------------------------------------------
+
+static unsigned repeats = 5;
+
+struct Distribution {
+    std::string name;
+    size_t frames;
+    double p50, p99, max;
+    size_t maxFrame;
+};
+
+static Distribution distribution(const std::string& name, const std::vector<uint64_t>& cost) {
+    std::vector<uint64_t> sorted = cost;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    Distribution d;
+    d.name = name;
+    d.frames = n;
+    d.p50 = sorted[(n - 1) / 2] * nsPerTick;
+    d.p99 = sorted[(size_t)std::ceil(0.99 * n) - 1] * nsPerTick;
+    d.max = sorted[n - 1] * nsPerTick;
+    d.maxFrame = std::max_element(cost.begin(), cost.end()) - cost.begin();
+    return d;
+}
+
+static std::vector<uint64_t> encodeCost(const std::vector<int16_t>& pcm,
+    std::vector<Parameters>* params) {
+    size_t frames = pcm.size() / 160;
+    std::vector<uint64_t> cost(frames, UINT64_MAX);
+    params->resize(frames);
+    for (unsigned r = 0; r < repeats; r++) {
+        Encoder encoder;
+        for (size_t f = 0; f < frames; f++) {
+            uint64_t t0 = ticks();
+            encoder.encode(&pcm[f * 160], &(*params)[f]);
+            uint64_t t1 = ticks();
+            cost[f] = std::min(cost[f], t1 - t0);
+        }
+    }
+    return cost;
+}
+
+static std::vector<uint64_t> decodeCost(const std::vector<Parameters>& params) {
+    std::vector<uint64_t> cost(params.size(), UINT64_MAX);
+    int16_t pcm[160];
+    for (unsigned r = 0; r < repeats; r++) {
+        Decoder decoder;
+        for (size_t f = 0; f < params.size(); f++) {
+            uint64_t t0 = ticks();
+            decoder.decode(&params[f], pcm);
+            uint64_t t1 = ticks();
+            cost[f] = std::min(cost[f], t1 - t0);
+        }
+        sink = sink + pcm[0];
+    }
+    return cost;
+}
+
+// ----- Search ----------------------------------------------------------------
+
+// The hardware counters used for the search objective, or null
+static PerfCounters* counters = 0;
+
+/**
+ * The cost of run(), with reset() called (outside of the timing) before 
+ * each run.  With stable = false this is the minimum time of --repeats 
+ * runs (in ticks), like the distributions.  With stable = true it is a 
+ * search objective that doesn't move much between measurements: the 
+ * instruction count where available, otherwise the median time of 
+ * --repeats runs.
+ */
+template <typename R, typename F> static uint64_t frameCost(R reset, F run, bool stable) {
+    if (stable && counters) {
+        reset();
+        counters->start();
+        run();
+        counters->stop();
+        return counters->get(PerfCounters::INSTRUCTIONS);
+    }
+    std::vector<uint64_t> cost(repeats);
+    for (unsigned r = 0; r < repeats; r++) {
+        reset();
+        uint64_t t0 = ticks();
+        run();
+        uint64_t t1 = ticks();
+        cost[r] = t1 - t0;
+    }
+    if (!stable) {
+        return *std::min_element(cost.begin(), cost.end());
+    }
+    std::nth_element(cost.begin(), cost.begin() + repeats / 2, cost.end());
+    return cost[repeats / 2];
+}
+
+/**
+ * The cost of encoding one frame, starting from the given state.
+ */
+static uint64_t encodeFrameCost(const Encoder& primed, const int16_t frame[], bool stable) {
+    Encoder encoder;
+    Parameters out;
+    uint64_t cost = frameCost([&]() { encoder = primed; }, 
+        [&]() { encoder.encode(frame, &out); }, stable);
+    sink = sink + out.LARc[0];
+    return cost;
+}
+
+static uint64_t decodeFrameCost(const Decoder& primed, const Parameters* params, bool stable) {
+    Decoder decoder;
+    int16_t pcm[160];
+    uint64_t cost = frameCost([&]() { decoder = primed; }, 
+        [&]() { decoder.decode(params, pcm); }, stable);
+    sink = sink + pcm[0];
+    return cost;
+}
+
+static void mutateFrame(int16_t frame[]) {
+    uint16_t k = rand16(0, 159);
+    switch (rand16(0, 3)) {
+        // One sample at either end of the range
+        case 0: frame[k] = rand16(0, 1) ? 32767 : -32768; break;
+        // One random sample
+        case 1: frame[k] = rand16(-32768, 32767); break;
+        // A run of full-scale alternation
+        case 2: {
+            uint16_t len = rand16(1, 40);
+            for (uint16_t i = k; i < 160 && i < k + len; i++) {
+                frame[i] = (i & 1) ? 32767 : -32768;
+            }
+            break;
+        }
+        // A run that is flipped
+        default: {
+            uint16_t len = rand16(1, 40);
+            for (uint16_t i = k; i < 160 && i < k + len; i++) {
+                frame[i] = frame[i] == -32768 ? 32767 : -frame[i];
+            }
+            break;
+        }
+    }
+}
+
+static void mutateParams(Parameters* p) {
+    uint16_t field = rand16(0, 8 + 4 * 5 - 1);
+    if (field < 8) {
+        p->LARc[field] = rand16(0, (1 << PackedFrame::LARC_BITS[field]) - 1);
+        return;
+    }
+    SubSegParameters& s = p->subSegs[(field - 8) / 5];
+    switch ((field - 8) % 5) {
+        case 0: s.Nc = rand16(0, 127); break;
+        case 1: s.bc = rand16(0, 3); break;
+        case 2: s.Mc = rand16(0, 3); break;
+        case 3: s.xmaxc = rand16(0, 63); break;
+        default: s.xMc[rand16(0, 12)] = rand16(0, 7); break;
+    }
+}
+
+/**
+ * Hill climb: keep any mutation that makes the frame more expensive.
+ * 
+ * @param cost The search objective (see frameCost())
+ * @returns The objective of the result
+ */
+template <typename T, typename C, typename M> static uint64_t climb(T* x,
+    unsigned iterations, C cost, M mutate) {
+    uint64_t best = cost(*x);
+    for (unsigned i = 0; i < iterations; i++) {
+        T y = *x;
+        // Sometimes take a bigger step
+        unsigned steps = rand16(1, 4);
+        for (unsigned s = 0; s < steps; s++) {
+            mutate(&y);
+        }
+        uint64_t c = cost(y);
+        if (c > best) {
+            best = c;
+            *x = y;
+        }
+    }
+    return best;
+}
+
+struct Frame { int16_t pcm[160]; };
+
+int main(int argc, const char** argv) {
+
+    std::string dataDir = "../tests/data";
+    std::string saveFn;
+    unsigned iterations = 20000;
+    bool useCounters = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--data" && i + 1 < argc) {
+            dataDir = argv[++i];
+        } else if (arg == "--repeats" && i + 1 < argc) {
+            repeats = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            lcg_state = strtoul(argv[++i], 0, 10);
+        } else if (arg == "--save" && i + 1 < argc) {
+            saveFn = argv[++i];
+        } else if (arg == "--counters") {
+            useCounters = true;
+        } else {
+            std::cerr << "Usage: gsm-wcet [--data <dir>] [--repeats <n>] [--iterations <n>] "
+                "[--seed <n>] [--save <prefix>] [--counters]" << std::endl;
+            return 2;
+        }
+    }
+
+    calibrate();
+
+    // ----- Inputs ------------------------------------------------------------
+
+    std::vector<std::pair<std::string, std::vector<int16_t>>> inputs;
+    {
+        std::vector<int16_t> pcm;
+        for (const char* seq : { "Seq01", "Seq02", "Seq03", "Seq04" }) {
+            std::vector<int16_t> x = loadInp(dataDir + "/" + seq + ".inp");
+            pcm.insert(pcm.end(), x.begin(), x.end());
+        }
+        pcm.resize(pcm.size() - (pcm.size() % 160));
+        if (pcm.empty()) {
+            std::cerr << "No test data found in " << dataDir << std::endl;
+            return 2;
+        }
+        inputs.push_back({ "etsi", pcm });
+    }
+    {
+        std::vector<int16_t> pcm(160 * 1024);
+        std::ifstream str(dataDir + "/male-1.wav", std::ios::binary);
+        int samples = decodeToPCM16(str, pcm.data(), pcm.size());
+        if (samples > 0) {
+            pcm.resize(samples - (samples % 160));
+            inputs.push_back({ "male-1.wav", pcm });
+        }
+    }
+    inputs.push_back({ "square-fs-40", squareWave(40) });
+    inputs.push_back({ "square-fs-4", squareWave(4) });
+    inputs.push_back({ "clipping-noise", clippingNoise() });
+    inputs.push_back({ "homing-pattern", homingPattern() });
+
+    // ----- Distributions -----------------------------------------------------
+
+    std::vector<Distribution> encodeDist, decodeDist;
+    // The worst frames of all of the inputs are the starting points of the 
+    // searches.  The stream they are in is kept so that the codec can be 
+    // put back in the state it had at that point.
+    const std::vector<int16_t>* encodeSeedInput = 0;
+    size_t encodeSeedFrame = 0;
+    double encodeSeedNs = 0;
+    std::vector<Parameters> decodeSeedInput;
+    size_t decodeSeedFrame = 0;
+    double decodeSeedNs = 0;
+
+    auto addDecode = [&](const std::string& name, const std::vector<Parameters>& params) {
+        Distribution d = distribution(name, decodeCost(params));
+        if (d.max > decodeSeedNs) {
+            decodeSeedNs = d.max;
+            decodeSeedInput = params;
+            decodeSeedFrame = d.maxFrame;
+        }
+        decodeDist.push_back(d);
+    };
+
+    for (const auto& input : inputs) {
+        std::vector<Parameters> params;
+        Distribution d = distribution(input.first, encodeCost(input.second, &params));
+        if (d.max > encodeSeedNs) {
+            encodeSeedNs = d.max;
+            encodeSeedInput = &input.second;
+            encodeSeedFrame = d.maxFrame;
+        }
+        encodeDist.push_back(d);
+        // The decoder gets what the encoder produced
+        addDecode(input.first, params);
+    }
+    {
+        std::vector<Parameters> params;
+        for (const char* seq : { "Seq01", "Seq02", "Seq03", "Seq04", "Seq05" }) {
+            std::vector<Parameters> x = loadCod(dataDir + "/" + seq + ".cod");
+            params.insert(params.end(), x.begin(), x.end());
+        }
+        if (!params.empty()) {
+            addDecode("etsi.cod", params);
+        }
+        params.resize(STRESS_FRAMES);
+        for (Parameters& p : params) {
+            randomParams(&p);
+        }
+        addDecode("random-params", params);
+    }
+
+    printf("Per-frame cost in ns (minimum of %u runs per frame)\n\n", repeats);
+    for (unsigned pass = 0; pass < 2; pass++) {
+        const std::vector<Distribution>& dists = pass == 0 ? encodeDist : decodeDist;
+        printf("%-8s %-16s %8s %10s %10s %10s\n", pass == 0 ? "encode" : "decode",
+            "input", "frames", "p50", "p99", "max");
+        for (const Distribution& d : dists) {
+            printf("%-8s %-16s %8zu %10.0f %10.0f %10.0f\n", "", d.name.c_str(), d.frames,
+                d.p50, d.p99, d.max);
+        }
+        printf("\n");
+    }
+
+    // ----- Search ------------------------------------------------------------
+
+    PerfCounters perfCounters;
+    if (useCounters) {
+        if (perfCounters.isAvailable(PerfCounters::INSTRUCTIONS)) {
+            counters = &perfCounters;
+            // The first use has some one-time costs (i.e. symbol binding)
+            counters->start();
+            counters->stop();
+        } else {
+            std::cerr << "The instruction counter is not available (not Linux, no PMU or " 
+                "perf_event_paranoid too high), searching on the median time" << std::endl;
+        }
+    }
+
+    // The codecs in the state they had just before the seed frames
+    Encoder primedEncoder;
+    Frame worstFrame;
+    {
+        Parameters params;
+        for (size_t f = 0; f < encodeSeedFrame; f++) {
+            primedEncoder.encode(&(*encodeSeedInput)[f * 160], &params);
+        }
+        memcpy(worstFrame.pcm, &(*encodeSeedInput)[encodeSeedFrame * 160], 
+            sizeof(worstFrame.pcm));
+    }
+    Decoder primedDecoder;
+    Parameters worstParams = decodeSeedInput[decodeSeedFrame];
+    {
+        int16_t pcm[160];
+        for (size_t f = 0; f < decodeSeedFrame; f++) {
+            primedDecoder.decode(&decodeSeedInput[f], pcm);
+        }
+    }
+
+    // The seed frames timed the same way as the results
+    encodeSeedNs = encodeFrameCost(primedEncoder, worstFrame.pcm, false) * nsPerTick;
+    decodeSeedNs = decodeFrameCost(primedDecoder, &worstParams, false) * nsPerTick;
+
+    uint64_t encodeSeed = encodeFrameCost(primedEncoder, worstFrame.pcm, true);
+    uint64_t encodeBest = climb(&worstFrame, iterations,
+        [&](const Frame& x) { return encodeFrameCost(primedEncoder, x.pcm, true); },
+        [](Frame* x) { mutateFrame(x->pcm); });
+    uint64_t decodeSeed = decodeFrameCost(primedDecoder, &worstParams, true);
+    uint64_t decodeBest = climb(&worstParams, iterations,
+        [&](const Parameters& x) { return decodeFrameCost(primedDecoder, &x, true); },
+        [](Parameters* x) { mutateParams(x); });
+
+    // The results are timed the same way as the distributions
+    double encodeWorstNs = encodeFrameCost(primedEncoder, worstFrame.pcm, false) * nsPerTick;
+    double decodeWorstNs = decodeFrameCost(primedDecoder, &worstParams, false) * nsPerTick;
+    printf("Search (%u iterations, objective: %s)\n", iterations, 
+        counters ? "instructions" : "median time");
+    printf("  worst encode frame  %10.0f ns (%.2fx the ETSI p50, seed frame %.0f ns)\n", 
+        encodeWorstNs, encodeWorstNs / encodeDist[0].p50, encodeSeedNs);
+    printf("  worst decode frame  %10.0f ns (%.2fx the ETSI p50, seed frame %.0f ns)\n", 
+        decodeWorstNs, decodeWorstNs / decodeDist[0].p50, decodeSeedNs);
+    if (encodeBest <= encodeSeed || encodeWorstNs <= encodeSeedNs) {
+        printf("  WARNING: the encode search didn't beat its seed frame\n");
+    }
+    if (decodeBest <= decodeSeed || decodeWorstNs <= decodeSeedNs) {
+        printf("  WARNING: the decode search didn't beat its seed frame\n");
+    }
+
+    // Each channel needs one encode and one decode every 20 ms
+    double encodeMax = encodeWorstNs, decodeMax = decodeWorstNs;
+    for (const Distribution& d : encodeDist) {
+        encodeMax = std::max(encodeMax, d.max);
+    }
+    for (const Distribution& d : decodeDist) {
+        decodeMax = std::max(decodeMax, d.max);
+    }
+    printf("  full-duplex channels per core (20 ms frames, no margin): %.0f\n",
+        std::floor(20e6 / (encodeMax + decodeMax)));
+
+    if (!saveFn.empty()) {
+        std::ofstream inp(saveFn + ".inp", std::ios::binary);
+        for (uint16_t k = 0; k < 160; k++) {
+            uint8_t b[2] = { (uint8_t)(worstFrame.pcm[k] & 0xff),
+                (uint8_t)((uint16_t)worstFrame.pcm[k] >> 8) };
+            inp.write((const char*)b, 2);
+        }
+        std::ofstream cod(saveFn + ".cod", std::ios::binary);
+        // NOTE: THERE IS AN ENDIANNESS ASSUMPTION HERE (same as the tests)
+        cod.write((const char*)&worstParams, 76 * 2);
+    }
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#ifndef _perf_counters_h
+#define _perf_counters_h
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace kc1fsz {
+
+/**
+ * The hardware performance counters of the calling thread (user space
+ * only) using perf_event_open(2).  Each counter is opened on its own so
+ * that a missing one (common in VMs, or with perf_event_paranoid > 2)
+ * doesn't take the others with it.  On anything other than Linux none
+ * of them are available.
+ */
+class PerfCounters {
+public:
+
+    enum Counter {
+        CYCLES,
+        INSTRUCTIONS,
+        BRANCH_MISSES,
+        L1D_MISSES,
+        COUNT
+    };
+
+    static const char* name(unsigned c) {
+        switch (c) {
+            case CYCLES: return "cycles";
+            case INSTRUCTIONS: return "instructions";
+            case BRANCH_MISSES: return "branch_misses";
+            case L1D_MISSES: return "l1d_misses";
+            default: return "?";
+        }
+    }
+
+    PerfCounters() {
+        for (unsigned c = 0; c < COUNT; c++) {
+            _fd[c] = -1;
+            _value[c] = 0;
+        }
+#ifdef __linux__
+        _fd[CYCLES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        _fd[INSTRUCTIONS] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        _fd[BRANCH_MISSES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        _fd[L1D_MISSES] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#endif
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (unsigned c = 0; c < COUNT; c++) {
+            if (_fd[c] >= 0) {
+                close(_fd[c]);
+            }
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool isAvailable(unsigned c) const { return _fd[c] >= 0; }
+
+    bool isAnyAvailable() const {
+        for (unsigned c = 0; c < COUNT; c++) {
+            if (isAvailable(c)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void start() {
+#ifdef __linux__
+        for (unsigned c = 0; c < COUNT; c++) {
+            if (_fd[c] >= 0) {
+                ioctl(_fd[c], PERF_EVENT_IOC_RESET, 0);
+                ioctl(_fd[c], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+        for (unsigned c = 0; c < COUNT; c++) {
+            if (_fd[c] >= 0) {
+                ioctl(_fd[c], PERF_EVENT_IOC_DISABLE, 0);
+                uint64_t v = 0;
+                _value[c] = (::read(_fd[c], &v, sizeof(v)) == sizeof(v)) ? v : 0;
+            }
+        }
+#endif
+    }
+
+    /**
+     * @returns The count between the last start()/stop() pair.
+     */
+    uint64_t get(unsigned c) const { return _value[c]; }
+
+private:
+
+#ifdef __linux__
+    static int open(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        return fd < 0 ? -1 : fd;
+    }
+#endif
+
+    int _fd[COUNT];
+    uint64_t _value[COUNT];
+};
+
+}
+
+#endif
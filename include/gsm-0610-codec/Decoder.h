@@ -20,10 +20,74 @@
 #ifndef _Decoder_h
 #define _Decoder_h
 
+#include <cassert>
+#include <type_traits>
+
 #include "Parameters.h"
+#include "Stats.h"
+#include "Policy.h"
+#include "Encoder.h"
+#include "PackedFrame.h"
 
 namespace kc1fsz {
 
+/**
+ * The stateless stages of the decoder, which don't depend on the policy.
+ */
+class DecoderBase {
+public:
+
+    // These are the stateless stages of decode(). All state that is carried
+    // between frames is passed in explicitly.
+
+    /**
+     * Sections 5.3.1 and 5.3.2 - RPE decoding and long term synthesis
+     * filtering of one sub-segment.
+     * 
+     * @param drp The reconstructed short term residual history [0..119], 
+     *   carried between sub-segments.  The 40 new entries are written 
+     *   to [120..159] and also to [0..39], so the caller must provide a 
+     *   160 entry window and then advance it by 40 (see 
+     *   Encoder::nextHistoryHead()).
+     * @param nrp The last valid LTP lag, carried between sub-segments.
+     * @param wt Receives the reconstructed short term residual [0..39]
+     */
+    static void decodeSubSegment(const SubSegParameters* in, int16_t drp[], int16_t* nrp, 
+        int16_t wt[]);
+
+    /**
+     * Sections 5.3.4 to 5.3.7 - Short term synthesis filtering, deemphasis,
+     * up-scaling and truncation.
+     * 
+     * @param rrp The reflection coefficients for each zone, rrp[0..3][1..8]
+     * @param v The filter state [0..8], carried between frames
+     * @param msr The deemphasis state, carried between frames
+     * @param wt The reconstructed short term residual [0..159]
+     * @param outputPcm Receives the 160 PCM samples
+     * @param stride The distance between output samples, i.e. the number
+     *   of channels of interleaved PCM.
+     */
+    static void shortTermSynthesis(const int16_t rrp[][9], int16_t v[], int16_t* msr, 
+        const int16_t wt[], int16_t outputPcm[], unsigned stride = 1);
+
+    /**
+     * Same as above, but for the 40 samples of sub-segment j [0..3] only.
+     * Running this for j = 0..3 in order is the same as the above.
+     * 
+     * @param wt The reconstructed short term residual of the sub-segment [0..39]
+     * @param outputPcm Receives the 40 PCM samples
+     */
+    static void shortTermSynthesis(const int16_t rrp[][9], int16_t v[], int16_t* msr, 
+        uint16_t j, const int16_t wt[], int16_t outputPcm[], unsigned stride = 1);
+
+protected:
+
+    /**
+     * Looks for output samples at full scale (after truncation).
+     */
+    static bool isSaturated(const int16_t pcm[], uint16_t count = 160, unsigned stride = 1);
+};
+
 /**
  * A GSM 06.10 decoder based on the official documentation marked:
  *  "Draft ETSI EN 300 961 V8.0.1 (2000-07)"
@@ -32,33 +96,336 @@ namespace kc1fsz {
  * 
  * GSM decoding must maintain state between frames so a single instance 
  * of this class should be created/maintained per decoding stream. 
+ * 
+ * The Policy (see Policy.h) fixes the bounds checking and the 
+ * instrumentation at compile time (the decoder has no homing or analysis).
+ * Decoder is the version with the BuildPolicy.
  */
-class Decoder {
+template <class Policy> class BasicDecoder : public DecoderBase {
 public:
 
-    Decoder();
+    BasicDecoder() 
+    :   _fromPacked(false),
+        _blocksPending(0) {
+        reset();
+    }
 
     /**
      * Returns the decoder to the "home" state.
      */
-    void reset();
+    void reset() {
+        _nrp = 40;
+        for (uint16_t k = 0; k < 240; k++) {
+            _drp[k] = 0;
+        }
+        _drpHead = 0;
+        for (uint16_t i = 0; i <= 8; i++) {
+            _LARpp_last[i] = 0;
+        }
+        for (uint16_t i = 0; i <= 8; i++) {
+            _v[i] = 0;
+        }
+        _msr = 0;
+        _blocksPending = 0;
+    }
 
     /**
      * Converts a set of frame parameters into a single frame of 
      * 160 PCM samples (13-bit, left-aligned).  This implies
      * that the low three bits will be zero.
+     * 
+     * Any blocks of a frame given to startFrame() that weren't pulled are
+     * decoded (and thrown away) first.
+     * 
+     * @param stride The distance between output samples, i.e. the number 
+     *   of channels to write one channel of interleaved PCM in place.
     */
-    void decode(const Parameters* in, int16_t* outputPcm);
+    void decode(const Parameters* input, int16_t* outputPcm, unsigned stride = 1) {
+
+        if constexpr (Policy::boundsChecking) {
+            // Mc and bc are used as indexes
+            assert(input->isInRange());
+        }
+        finishFrame();
+
+        uint64_t stageStart = 0;
+        if constexpr (Policy::instrumentation) {
+            stageStart = instrumentationNs();
+            _stats.frames++;
+        }
+
+        // This will be filled one sub-segment at a time.  It is 
+        // essentially the dr' signal for each sub-segment.
+        int16_t wt[160];
+
+        // This part runs four times, once for each sub-segment.  In keeping with 
+        // the draft convention, we use "j" to denote the sub-segment.
+        for (uint16_t j = 0; j < 4; j++) {
+            decodeSubSegment(&(input->subSegs[j]), _drp + _drpHead, &_nrp, wt + (j * 40));
+            _drpHead = Encoder::nextHistoryHead(_drpHead);
+        }
+        stageEnd(DecoderStats::LONG_TERM_SYNTHESIS, &stageStart);
+
+        // Section 5.3.3 - Computation of the decoded reflection coefficients
+        // The goal is to reconstruct rrp[1..8] 
+
+        int16_t rrp[4][9];
+        Encoder::decodeReflectionCoefficients(input, _LARpp_last, rrp);
+        stageEnd(DecoderStats::REFLECTION_COEFFICIENTS, &stageStart);
+
+        // NUMERICAL NOTE: At this point rrp[] is at full scale
+
+        shortTermSynthesis(rrp, _v, &_msr, wt, outputPcm, stride);
+        stageEnd(DecoderStats::SHORT_TERM_SYNTHESIS, &stageStart);
+        countSaturated(outputPcm, stride);
+    }
+
+    /**
+     * Same as above, but works directly from a 33-byte packed frame 
+     * (RFC 3551, i.e. an RTP payload).  The fields are extracted as 
+     * they are needed.
+     */
+    void decode(const uint8_t* packedIn, int16_t* outputPcm, unsigned stride = 1) {
+
+        const PackedFrame* frame = PackedFrame::at(packedIn);
+        finishFrame();
+
+        // The parameters are pulled out of the frame as they are needed
+        uint64_t stageStart = 0;
+        if constexpr (Policy::instrumentation) {
+            stageStart = instrumentationNs();
+            _stats.frames++;
+        }
+
+        int16_t wt[160];
+        for (uint16_t j = 0; j < 4; j++) {
+            SubSegParameters subSeg;
+            frame->getSubSeg(j, &subSeg);
+            decodeSubSegment(&subSeg, _drp + _drpHead, &_nrp, wt + (j * 40));
+            _drpHead = Encoder::nextHistoryHead(_drpHead);
+        }
+        stageEnd(DecoderStats::LONG_TERM_SYNTHESIS, &stageStart);
+
+        uint16_t LARc[8];
+        frame->getLARc(LARc);
+        int16_t rrp[4][9];
+        Encoder::decodeReflectionCoefficients(LARc, _LARpp_last, rrp);
+        stageEnd(DecoderStats::REFLECTION_COEFFICIENTS, &stageStart);
+
+        shortTermSynthesis(rrp, _v, &_msr, wt, outputPcm, stride);
+        stageEnd(DecoderStats::SHORT_TERM_SYNTHESIS, &stageStart);
+        countSaturated(outputPcm, stride);
+    }
+
+    /**
+     * Decodes nFrames consecutive 33-byte packed frames (RFC 3551) into 
+     * nFrames consecutive 160-sample frames.  The output is the same as 
+     * calling decode() for each frame, but the next few packed frames are 
+     * prefetched while the current one is being decoded.
+     * See decode() for the stride.
+     * IMPORTANT: THE CALLER MUST ENSURE THAT packedIn[] HAS nFrames * 33 
+     * BYTES AND pcmOut[] HAS nFrames * 160 * stride SAMPLES.
+     */
+    void decodeFrames(const uint8_t* packedIn, size_t nFrames, int16_t* pcmOut, 
+        unsigned stride = 1) {
+        // A packed frame is only about half of a cache line, so this stays 
+        // a couple of lines ahead.
+        const size_t ahead = 4;
+        for (size_t f = 0; f < nFrames; f++) {
+            if (f + ahead < nFrames) {
+                EncoderBase::prefetch(packedIn + ahead * PackedFrame::BYTES, 
+                    PackedFrame::BYTES);
+            }
+            decode(packedIn, pcmOut, stride);
+            packedIn += PackedFrame::BYTES;
+            pcmOut += 160 * stride;
+        }
+    }
+
+    // ----- Pull-style Decoding ---------------------------------------------
+    // For playback paths that want the output 40 samples (5 ms) at a time.
+    // The frame is given to startFrame() and then each call of decodeBlock()
+    // runs the long term and short term synthesis of one sub-segment, so 
+    // the work is spread evenly over the four blocks.  The output is the 
+    // same as decode().
+
+    /**
+     * Starts a frame.  The reflection coefficients for all four zones 
+     * are computed here.  Any blocks of the previous frame that weren't 
+     * pulled are decoded (and thrown away) first, since the filter state 
+     * must see every sub-segment.
+     */
+    void startFrame(const Parameters* input) {
+
+        if constexpr (Policy::boundsChecking) {
+            assert(input->isInRange());
+        }
+
+        uint64_t stageStart = beginFrame();
+        for (uint16_t j = 0; j < 4; j++) {
+            _subSegs[j] = input->subSegs[j];
+        }
+        _fromPacked = false;
+        Encoder::decodeReflectionCoefficients(input, _LARpp_last, _rrp);
+        stageEnd(DecoderStats::REFLECTION_COEFFICIENTS, &stageStart);
+    }
+
+    /**
+     * Same as above, but from a 33-byte packed frame (RFC 3551).  The frame
+     * is kept and the fields of each sub-segment are extracted when its 
+     * block is pulled.
+     */
+    void startFrame(const uint8_t* packedIn) {
+
+        uint64_t stageStart = beginFrame();
+        for (unsigned i = 0; i < PackedFrame::BYTES; i++) {
+            _packed[i] = packedIn[i];
+        }
+        _fromPacked = true;
+        uint16_t LARc[8];
+        PackedFrame::at(_packed)->getLARc(LARc);
+        Encoder::decodeReflectionCoefficients(LARc, _LARpp_last, _rrp);
+        stageEnd(DecoderStats::REFLECTION_COEFFICIENTS, &stageStart);
+    }
+
+    /**
+     * The number of 40-sample blocks of the current frame that haven't been
+     * pulled yet [0..4].
+     */
+    unsigned blocksPending() const { return _blocksPending; }
+
+    /**
+     * Produces the next 40 samples of the current frame.
+     * IMPORTANT: THE CALLER MUST ENSURE THAT blocksPending() > 0 AND THAT 
+     * outputPcm[] HAS ROOM FOR 40 SAMPLES (40 * stride).
+     * 
+     * @param stride See decode()
+     */
+    void decodeBlock(int16_t* outputPcm, unsigned stride = 1) {
+
+        if constexpr (Policy::boundsChecking) {
+            assert(_blocksPending > 0);
+        }
+        const uint16_t j = 4 - _blocksPending;
+
+        uint64_t stageStart = 0;
+        if constexpr (Policy::instrumentation) {
+            stageStart = instrumentationNs();
+        }
+
+        SubSegParameters subSeg;
+        if (_fromPacked) {
+            PackedFrame::at(_packed)->getSubSeg(j, &subSeg);
+        } else {
+            subSeg = _subSegs[j];
+        }
+        int16_t wt[40];
+        decodeSubSegment(&subSeg, _drp + _drpHead, &_nrp, wt);
+        _drpHead = Encoder::nextHistoryHead(_drpHead);
+        stageEnd(DecoderStats::LONG_TERM_SYNTHESIS, &stageStart);
+
+        shortTermSynthesis(_rrp, _v, &_msr, j, wt, outputPcm, stride);
+        stageEnd(DecoderStats::SHORT_TERM_SYNTHESIS, &stageStart);
+        _blocksPending--;
+
+        if constexpr (Policy::instrumentation) {
+            _blockSaturated = _blockSaturated || isSaturated(outputPcm, 40, stride);
+            if (_blocksPending == 0 && _blockSaturated) {
+                _stats.saturatedFrames++;
+            }
+        }
+    }
+
+    /**
+     * Returns a copy of the counters.  These are only collected when the 
+     * policy has instrumentation, otherwise they are all zero.
+     */
+    DecoderStats getStats() const {
+        if constexpr (Policy::instrumentation) {
+            return _stats;
+        } else {
+            return DecoderStats();
+        }
+    }
+
+    void clearStats() {
+        if constexpr (Policy::instrumentation) {
+            _stats = DecoderStats();
+        }
+    }
 
 private:
 
+    /**
+     * Ends the timing of one stage and starts the next.
+     */
+    void stageEnd(unsigned stage, uint64_t* start) {
+        if constexpr (Policy::instrumentation) {
+            uint64_t now = instrumentationNs();
+            _stats.stageNs[stage] += now - *start;
+            *start = now;
+        }
+    }
+
+    /**
+     * Decodes (and throws away) any blocks of the current frame that 
+     * weren't pulled, since the filter state must see every sub-segment.
+     */
+    void finishFrame() {
+        int16_t discard[40];
+        while (_blocksPending > 0) {
+            decodeBlock(discard);
+        }
+    }
+
+    /**
+     * The common start of startFrame(): finishes the previous frame and
+     * starts the timing.
+     */
+    uint64_t beginFrame() {
+        finishFrame();
+        uint64_t stageStart = 0;
+        if constexpr (Policy::instrumentation) {
+            stageStart = instrumentationNs();
+            _stats.frames++;
+        }
+        _blocksPending = 4;
+        _blockSaturated = false;
+        return stageStart;
+    }
+
+    void countSaturated(const int16_t outputPcm[], unsigned stride) {
+        if constexpr (Policy::instrumentation) {
+            if (isSaturated(outputPcm, 160, stride)) {
+                _stats.saturatedFrames++;
+            }
+        }
+    }
+
     int16_t _nrp;
-    int16_t _drp[160];
+    // A mirrored ring buffer of the reconstructed short term residual
+    // with the window starting at _drpHead.  See Encoder::_dp.
+    int16_t _drp[240];
+    uint16_t _drpHead;
     int16_t _LARpp_last[9];
     int16_t _v[9];
     int16_t _msr;
+    // The frame being pulled (see startFrame())
+    SubSegParameters _subSegs[4];
+    uint8_t _packed[PackedFrame::BYTES];
+    bool _fromPacked;
+    int16_t _rrp[4][9];
+    unsigned _blocksPending;
+    bool _blockSaturated;
+
+    typename std::conditional<Policy::instrumentation, DecoderStats, NoStats>::type _stats;
 };
 
+/**
+ * The decoder with the build policy (see BuildPolicy in Policy.h).
+ */
+typedef BasicDecoder<BuildPolicy> Decoder;
+
 }
 
 #endif
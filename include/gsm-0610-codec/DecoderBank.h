@@ -0,0 +1,159 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#ifndef _DecoderBank_h
+#define _DecoderBank_h
+
+#include "Parameters.h"
+#include "Encoder.h"
+#include "Decoder.h"
+
+namespace kc1fsz {
+
+/**
+ * The parts of the bank that don't depend on the number of channels.
+ *
+ * All of the arrays are in structure-of-arrays form: the channel (lane)
+ * is the fastest-moving index, so x[k][lane] is at x[k * lanes + lane].
+ */
+class DecoderBankBase {
+protected:
+
+    /**
+     * Sections 5.3.4 to 5.3.7 - Short term synthesis filtering, deemphasis,
+     * up-scaling and truncation for all lanes at once.
+     *
+     * @param rrp The reflection coefficients [4][9][lanes]
+     * @param v The filter state [9][lanes]
+     * @param msr The deemphasis state [lanes]
+     * @param wt The reconstructed short term residual [160][lanes], 
+     *   receives the output PCM in place.
+     */
+    static void shortTermSynthesis(unsigned lanes, const int16_t rrp[],
+        int16_t v[], int16_t msr[], int16_t wt[]);
+};
+
+/**
+ * Decodes N independent streams in lockstep.  The short term synthesis
+ * filter and the deemphasis are recursive within a stream, so here each
+ * stream runs in its own SIMD lane.  The RPE decoding and long term 
+ * synthesis are shared with Decoder and run one lane at a time.
+ *
+ * The output of each lane is bit-identical to what a standalone Decoder
+ * would produce for the same stream.
+ */
+template <unsigned N> class DecoderBank : public DecoderBankBase {
+public:
+
+    DecoderBank() {
+        reset();
+    }
+
+    /**
+     * Returns all of the decoders to the "home" state.
+     */
+    void reset() {
+        for (unsigned lane = 0; lane < N; lane++) {
+            reset(lane);
+        }
+        _drpHead = 0;
+    }
+
+    /**
+     * Returns one decoder to the "home" state.
+     */
+    void reset(unsigned lane) {
+        _nrp[lane] = 40;
+        // NOTE: The history window is shared by all of the lanes, 
+        // clearing the whole buffer is the same as starting over.
+        for (uint16_t k = 0; k < 240; k++) {
+            _drp[lane][k] = 0;
+        }
+        for (uint16_t i = 0; i <= 8; i++) {
+            _LARpp_last[lane][i] = 0;
+            _v[i][lane] = 0;
+        }
+        _msr[lane] = 0;
+    }
+
+    /**
+     * Converts one set of frame parameters for each of the N channels 
+     * into 160 PCM samples (13-bit, left-aligned).
+     */
+    void decode(const Parameters in[N], int16_t* const outputPcm[N]) {
+
+        // These grow with N so they are kept off of the stack
+        int16_t (&wt)[160][N] = _wt;
+        int16_t (&rrp)[4][9][N] = _rrp;
+
+        uint16_t head = _drpHead;
+        for (unsigned lane = 0; lane < N; lane++) {
+            // Sections 5.3.1 and 5.3.2
+            int16_t wtl[160];
+            head = _drpHead;
+            for (uint16_t j = 0; j < 4; j++) {
+                Decoder::decodeSubSegment(&(in[lane].subSegs[j]), _drp[lane] + head, 
+                    &(_nrp[lane]), wtl + (j * 40));
+                head = Encoder::nextHistoryHead(head);
+            }
+            for (uint16_t k = 0; k < 160; k++) {
+                wt[k][lane] = wtl[k];
+            }
+            // Section 5.3.3
+            int16_t rrpl[4][9];
+            Encoder::decodeReflectionCoefficients(&(in[lane]), _LARpp_last[lane], rrpl);
+            for (uint16_t zone = 0; zone < 4; zone++) {
+                for (uint16_t i = 0; i < 9; i++) {
+                    rrp[zone][i][lane] = rrpl[zone][i];
+                }
+            }
+        }
+        _drpHead = head;
+
+        // Sections 5.3.4 to 5.3.7. NOTE: wt[] is replaced by the output
+        shortTermSynthesis(N, &rrp[0][0][0], &_v[0][0], _msr, &wt[0][0]);
+
+        for (unsigned lane = 0; lane < N; lane++) {
+            for (uint16_t k = 0; k < 160; k++) {
+                outputPcm[lane][k] = wt[k][lane];
+            }
+        }
+    }
+
+private:
+
+    // State preserved between segments, one per lane
+    int16_t _v[9][N];
+    int16_t _msr[N];
+    // These are only used one lane at a time so they are kept together
+    int16_t _nrp[N];
+    // Mirrored ring buffers, see Encoder::_dp
+    int16_t _drp[N][240];
+    uint16_t _drpHead;
+    int16_t _LARpp_last[N][9];
+    // Scratch memory, nothing here is carried between frames.
+    // The reconstructed short term residual, replaced by the output
+    int16_t _wt[160][N];
+    // The reflection coefficients for each zone
+    int16_t _rrp[4][9][N];
+};
+
+}
+
+#endif
@@ -20,11 +20,23 @@
 #ifndef _Encoder_h
 #define _Encoder_h
 
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
 #include "Parameters.h"
+#include "Stats.h"
+#include "Policy.h"
+#include "PackedFrame.h"
 
 namespace kc1fsz {
 
-class Encoder {
+/**
+ * The tables and the stateless stages of the encoder, which don't depend
+ * on the policy.  These are shared by the decoder and the other encoder
+ * front-ends (i.e. EncoderBank).
+ */
+class EncoderBase {
 
 public:
 
@@ -71,18 +83,19 @@ public:
      */
     static uint16_t k2zone(uint16_t k);
 
-    Encoder(bool homingSupported = true);
-    
     /**
-     * Sets the encoder back to the "home" state.
+     * Scratch memory used while encoding a frame.  Nothing is carried 
+     * between frames so one of these can be shared by any number of 
+     * encoders (one at a time), which keeps it off of the stack.
      */
-    void reset();
+    struct Workspace {
+        // The pre-emphasized signal, replaced by the short term residual
+        int16_t s[160];
+        // The reflection coefficients for each zone
+        int16_t rp[4][9];
+    };
 
-    /**
-     * Encodes a 160-sample frame and returns the parameters.
-     * IMPORTANT: THE CALLER MUST ENSURE THAT inputPcm[] CONTAINS 160 SAMPLES.
-    */
-    void encode(const int16_t inputPcm[], Parameters* out);
+    static constexpr unsigned MAX_COMPLEXITY = 1;
 
     /**
      * Reconstructs the reflection coefficients in rp[] from the parameters. Uses
@@ -92,11 +105,217 @@ public:
         int16_t* LARpp_last, int16_t rp[][9]);
 
     /**
-     * Reverses the APCM coding of a pulse.
+     * Same as above, but works directly from the coded LARc[0..7].
+     */
+    static void decodeReflectionCoefficients(const uint16_t LARc[], 
+        int16_t* LARpp_last, int16_t rp[][9]);
+
+    /**
+     * Sections 5.2.16 and 5.2.17 - Reverses the APCM coding of the pulses 
+     * of a sub-segment and places them on the RPE grid.  The exponent and 
+     * mantissa are implied by xmaxc, so this uses the table lookup (see 
+     * tables.h).
+     */
+    static void inverseAPCM(const SubSegParameters* params, int16_t xMp[]);
+
+    /**
+     * Same as above for sub-segment j [0..3] of a frame.  The exponent and 
+     * mantissa are ignored, they are implied by xmaxc.
+     */
+    [[deprecated("exp and mant are ignored, use inverseAPCM(&params->subSegs[j], xMp)")]]
+    static void inverseAPCM(const Parameters* params, int16_t j, int16_t exp, int16_t mant, 
+        int16_t xMp[]) {
+        (void)exp;
+        (void)mant;
+        inverseAPCM(&(params->subSegs[j]), xMp);
+    }
+
+    // ----- Encoder Stages ---------------------------------------------------
+    // These are the stateless stages of encode().  All state that is carried
+    // between frames is passed in explicitly so that the stages can be 
+    // shared by other encoder front-ends.
+
+    /**
+     * Sections 5.2.1 to 5.2.3 - Scaling, offset compensation and 
+     * pre-emphasis, done in a single pass.
      * 
-     * @params j The sub-segment number [0..3]
+     * @param sop The input frame [0..159]
+     * @param z1 Offset compensation state, carried between frames
+     * @param L_z2 Offset compensation state, carried between frames
+     * @param mp Pre-emphasis state, carried between frames
+     * @param s Receives the pre-emphasized signal [0..159]
+     * @param homingFrame Receives true if sop[] is a homing frame (see 
+     *   isHomingFrame()).
+     * @returns The maximum of |s[0..159]| for lpcAnalysis()
      */
-    static void inverseAPCM(const Parameters* params, int16_t j, int16_t exp, int16_t mant, int16_t xMp[]);
+    static int16_t preprocess(const int16_t sop[], int16_t* z1, int32_t* L_z2, int16_t* mp,
+        int16_t s[], bool* homingFrame);
+
+    /**
+     * Same as above, but for one channel of interleaved PCM: the input 
+     * sample k is sop[k * stride].
+     */
+    static int16_t preprocess(const int16_t sop[], unsigned stride, int16_t* z1, 
+        int32_t* L_z2, int16_t* mp, int16_t s[], bool* homingFrame);
+
+    /**
+     * Sections 5.2.4 to 5.2.7 - Autocorrelation, Schur recursion and 
+     * the quantization of the Log-Area Ratios.
+     * 
+     * @param s The pre-emphasized signal [0..159].  IMPORTANT: This is 
+     *   scaled/rescaled in place as described in section 5.2.4 and the 
+     *   modified version is what must be passed to the short term filter.
+     * @param LARc Receives the coded Log-Area Ratios [0..7]
+     */
+    static void lpcAnalysis(int16_t s[], uint16_t LARc[]);
+
+    /**
+     * Same as above, but for callers that have already found the maximum
+     * of |s[0..159]|.
+     */
+    static void lpcAnalysis(int16_t s[], int16_t smax, uint16_t LARc[]);
+
+    /**
+     * Sections 5.2.5 to 5.2.7 - The Schur recursion and the quantization
+     * of the Log-Area Ratios, starting from the autocorrelation.
+     * 
+     * @param L_ACF The autocorrelation for lags [0..8]
+     * @param LARc Receives the coded Log-Area Ratios [0..7]
+     */
+    static void lpcFromAutocorrelation(const int32_t L_ACF[], uint16_t LARc[]);
+
+    /**
+     * The per-sample state of the incremental encoder (see 
+     * IncrementalEncoder.h).  Nothing in here is carried between frames.
+     */
+    struct Accumulator {
+        // The pre-emphasized signal so far [0..count-1]
+        int16_t s[160];
+        uint16_t count;
+        // The maximum of |s[0..count-1]|
+        int16_t smax;
+        // Whether s[0..count-1] came from a homing frame so far
+        bool homing;
+        // s[] scaled as in section 5.2.4 for each scaling [0..4] that 
+        // is still possible, in reverse order and followed by 8 zeros
+        int16_t scaled[5][168];
+        // The partial sums of section 5.2.4 (before the final shift) for
+        // each scaling [0..4] that is still possible.
+        int32_t L_sum[5][9];
+    };
+
+    /**
+     * Starts a new frame.
+     */
+    static void clearAccumulator(Accumulator* acc);
+
+    /**
+     * Sections 5.2.1 to 5.2.3 and the autocorrelation sums of 5.2.4 
+     * for one sample (see preprocess()).
+     * IMPORTANT: THE CALLER MUST ENSURE THAT acc->count < 160.
+     */
+    static void accumulate(Accumulator* acc, int16_t sop, int16_t* z1, int32_t* L_z2, 
+        int16_t* mp);
+
+    /**
+     * Same as lpcAnalysis() above, but for a complete frame (160 samples) 
+     * that came in through accumulate().  The result is the same, and 
+     * acc->s[] is scaled/rescaled in the same way.
+     */
+    static void lpcAnalysis(Accumulator* acc, uint16_t LARc[]);
+
+    /**
+     * Section 5.2.10 - Short term analysis filtering.
+     * 
+     * @param rp The reflection coefficients for each zone, rp[0..3][1..8]
+     * @param u The filter state [0..7], carried between frames
+     * @param s The signal [0..159] coming out of lpcAnalysis()
+     * @param d Receives the short term residual [0..159]. This may be
+     *   the same array as s[].
+     */
+    static void shortTermAnalysis(const int16_t rp[][9], int16_t u[], const int16_t s[], 
+        int16_t d[]);
+
+    /**
+     * Sections 5.2.11 to 5.2.18 - Long term prediction and RPE encoding 
+     * of one sub-segment.
+     * 
+     * @param d The short term residual of the sub-segment [0..39]
+     * @param dp The reconstructed short term residual history [0..119], 
+     *   carried between sub-segments.  The 40 new entries are written 
+     *   to [120..159] and also to [0..39], so the caller must provide a 
+     *   160 entry window and then advance it by 40 (see 
+     *   nextHistoryHead()).
+     * @param out Receives the sub-segment parameters
+     */
+    static void encodeSubSegment(const int16_t d[], int16_t dp[], SubSegParameters* out);
+
+    /**
+     * Same as above, but with the reduced lag search when complexity > 0
+     * (see setComplexity()).
+     * 
+     * @param lagHint A likely lag [40..120] (i.e. the previous Nc) that 
+     *   is always tried, 0 is ignored.
+     */
+    static void encodeSubSegment(const int16_t d[], int16_t dp[], SubSegParameters* out,
+        unsigned complexity, int16_t lagHint);
+
+    /**
+     * Same as above, but with the single-precision LTP parameters and RPE 
+     * weighting filter (see setFloatAnalysis()).
+     */
+    static void encodeSubSegmentFloat(const int16_t d[], int16_t dp[], SubSegParameters* out);
+
+    /**
+     * Sections 5.2.11 to 5.2.12, the first half of encodeSubSegment().
+     * 
+     * @param out Receives Nc and bc
+     * @param e Receives the long term residual [0..39]
+     * @param dpp Receives the estimate of the short term residual [0..39]
+     */
+    static void ltpEncodeSubSegment(const int16_t d[], const int16_t dp[], 
+        SubSegParameters* out, unsigned complexity, int16_t lagHint, 
+        int16_t e[], int16_t dpp[]);
+
+    /**
+     * Same as above, but with the single-precision LTP parameters.
+     */
+    static void ltpEncodeSubSegmentFloat(const int16_t d[], const int16_t dp[], 
+        SubSegParameters* out, int16_t e[], int16_t dpp[]);
+
+    /**
+     * Sections 5.2.13 to 5.2.18, the second half of encodeSubSegment().
+     * 
+     * @param e The long term residual from ltpEncodeSubSegment()
+     * @param dpp The estimate from ltpEncodeSubSegment()
+     * @param dp The history, updated as described for encodeSubSegment()
+     * @param out Receives Mc, xmaxc and xMc[]
+     */
+    static void rpeEncodeSubSegment(const int16_t e[], const int16_t dpp[], int16_t dp[], 
+        SubSegParameters* out, bool floatAnalysis);
+
+    /**
+     * Sections 5.2.4 to 5.2.7 in single precision (see setFloatAnalysis()).
+     * No scaling of s[] is needed so it isn't modified.
+     */
+    static void lpcAnalysisFloat(const int16_t s[], uint16_t LARc[]);
+
+    /**
+     * Section 5.2.10 in single precision (see setFloatAnalysis()).
+     * 
+     * @param sLast The last 8 samples of the previous s[], carried between 
+     *   frames. 
+     */
+    static void shortTermAnalysisFloat(const int16_t rp[][9], int16_t sLast[], 
+        const int16_t s[], int16_t d[]);
+
+    /**
+     * Moves the start of a 120-entry mirrored history window (see _dp) 
+     * forward by one sub-segment: 0 -> 40 -> 80 -> 0.
+     */
+    static uint16_t nextHistoryHead(uint16_t head) {
+        return head == 80 ? 0 : head + 40;
+    }
 
     /**
      * Determines whether the frame is an Encoder Homing Frame.
@@ -107,21 +326,373 @@ public:
      */
     static bool isHomingFrame(const int16_t frame[]);
 
-private:
+    /**
+     * Asks for the cache lines of bytes[0..size-1] to be loaded ahead of 
+     * their use (a hint, it does nothing where the compiler has no 
+     * prefetch).
+     */
+    static void prefetch(const void* bytes, unsigned size) {
+#if defined(__GNUC__)
+        for (unsigned i = 0; i < size; i += 32) {
+            __builtin_prefetch((const uint8_t*)bytes + i);
+        }
+#else
+        (void)bytes;
+        (void)size;
+#endif
+    }
+
+};
+
+/**
+ * A GSM 06.10 encoder based on the official documentation marked:
+ *  "Draft ETSI EN 300 961 V8.0.1 (2000-07)"
+ * 
+ * GSM encoding must maintain state between frames so a single instance 
+ * of this class should be created/maintained per encoding stream. 
+ * 
+ * The Policy (see Policy.h) fixes the homing, the analysis arithmetic, 
+ * the bounds checking and the instrumentation at compile time.  Encoder 
+ * is the version with the BuildPolicy.
+ */
+template <class Policy> class BasicEncoder : public EncoderBase {
+public:
+
+    /**
+     * @param homingSupported Whether to reset after a homing frame, only 
+     *   used when the policy has Homing::RUNTIME.
+     */
+    BasicEncoder(bool homingSupported = true) 
+    :   _homingSupported(homingSupported),
+        _lastFrameHome(false),
+        _complexity(0),
+        _floatAnalysis(false) {
+        reset();
+    }
+    
+    /**
+     * Sets the encoder back to the "home" state.
+     */
+    void reset() {
+        _z1 = 0;
+        _L_z2 = 0;
+        _mp = 0;
+        for (uint16_t i = 1; i <= 8; i++) {
+            _LARpp_last[i] = 0;
+        }
+        for (uint16_t i = 0; i < 8; i++) {
+            _u[i] = 0;
+            _sLast[i] = 0;
+        }
+        for (uint16_t i = 0; i < 240; i++) {
+            _dp[i] = 0;
+        }
+        _dpHead = 0;
+        _lastNc = 0;
+    }
+
+    /**
+     * Trades quality for speed in the search for the LTP lag (section 
+     * 5.2.11).  The output is always a valid bitstream.
+     * 
+     * 0 - The full search of lags 40..120 (bit-exact, the default)
+     * 1 - Every 2nd lag, the lags around the previous Nc and then the 
+     *     lags around the best of those.
+     * 
+     * The setting survives reset().
+     */
+    void setComplexity(unsigned level) {
+        _complexity = level > MAX_COMPLEXITY ? MAX_COMPLEXITY : level;
+    }
+
+    unsigned getComplexity() const { return _complexity; }
+
+    /**
+     * Turns on the single-precision analysis (autocorrelation, reflection 
+     * coefficients, short term filter, LTP parameters and the RPE weighting
+     * filter).  This is much faster on desktop processors but it is NOT
+     * bit-exact: the output is still a valid bitstream, but won't match 
+     * the ETSI test sequences.  The reconstruction of the short term 
+     * residual stays in fixed point so it tracks the decoder exactly.
+     * The complexity level (above) doesn't apply in this mode.  The gain
+     * comes from the SSE4.1/AVX2 versions, the portable build is about 
+     * as fast as the fixed-point path.
+     * 
+     * Off by default.  Change it before the first frame (or after reset()),
+     * the setting itself survives reset().  This has no effect unless the
+     * policy has Analysis::RUNTIME.
+     */
+    void setFloatAnalysis(bool enabled) { _floatAnalysis = enabled; }
+
+    bool isFloatAnalysis() const { 
+        if constexpr (Policy::analysis == Analysis::RUNTIME) {
+            return _floatAnalysis;
+        } else {
+            return Policy::analysis == Analysis::FLOAT;
+        }
+    }
+
+    /**
+     * Encodes a 160-sample frame and returns the parameters.
+     * IMPORTANT: THE CALLER MUST ENSURE THAT inputPcm[] CONTAINS 160 SAMPLES.
+    */
+    void encode(const int16_t inputPcm[], Parameters* out) {
+        Workspace ws;
+        encodeFrame(inputPcm, out->LARc, out->subSegs, &ws);
+    }
+
+    /**
+     * Same as above, but uses the caller's scratch memory.
+     */
+    void encode(const int16_t inputPcm[], Parameters* out, Workspace* ws) {
+        encodeFrame(inputPcm, out->LARc, out->subSegs, ws);
+    }
+
+    /**
+     * Same as above, but writes the parameters straight into a 33-byte
+     * packed frame (RFC 3551).
+     * IMPORTANT: THE CALLER MUST ENSURE THAT packedOut[] HAS 33 BYTES.
+     */
+    void encode(const int16_t inputPcm[], uint8_t* packedOut) {
+        encodeFrames(inputPcm, 1, packedOut);
+    }
+
+    /**
+     * Encodes nFrames consecutive 160-sample frames from pcm[] into nFrames 
+     * consecutive 33-byte packed frames (RFC 3551).  The output is the same
+     * as calling encode() for each frame, but one workspace is used for all 
+     * of the frames and the input of the next frame is prefetched while 
+     * the current one is being encoded.
+     * 
+     * @param stride For one channel of interleaved PCM, the number of 
+     *   channels.  Sample k of the channel is pcm[k * stride], so the 
+     *   channels are encoded in place without deinterleaving them.
+     * 
+     * IMPORTANT: THE CALLER MUST ENSURE THAT pcm[] HAS nFrames * 160 * stride
+     * SAMPLES AND packedOut[] HAS nFrames * 33 BYTES.
+     */
+    void encodeFrames(const int16_t* pcm, size_t nFrames, uint8_t* packedOut, 
+        unsigned stride = 1) {
+        Workspace ws;
+        uint16_t LARc[8];
+        SubSegParameters subSegs[4];
+        for (size_t f = 0; f < nFrames; f++) {
+            if (f + 1 < nFrames) {
+                prefetch(pcm + 160 * stride, 160 * stride * sizeof(int16_t));
+            }
+            encodeFrame(pcm, LARc, subSegs, &ws, stride);
+            PackedFrame* frame = PackedFrame::at(packedOut);
+            frame->setLARc(LARc);
+            for (uint16_t j = 0; j < 4; j++) {
+                frame->setSubSeg(j, subSegs[j]);
+            }
+            pcm += 160 * stride;
+            packedOut += PackedFrame::BYTES;
+        }
+    }
+
+    /**
+     * Returns a copy of the counters.  These are only collected when the 
+     * policy has instrumentation, otherwise they are all zero.
+     */
+    EncoderStats getStats() const {
+        if constexpr (Policy::instrumentation) {
+            return _stats;
+        } else {
+            return EncoderStats();
+        }
+    }
+
+    void clearStats() {
+        if constexpr (Policy::instrumentation) {
+            _stats = EncoderStats();
+        }
+    }
+
+protected:
+
+    /**
+     * Ends the timing of one stage and starts the next.
+     */
+    void stageEnd(unsigned stage, uint64_t* start) {
+        if constexpr (Policy::instrumentation) {
+            uint64_t now = instrumentationNs();
+            _stats.stageNs[stage] += now - *start;
+            *start = now;
+        }
+    }
+
+    void encodeFrame(const int16_t sop[], uint16_t LARc[], SubSegParameters subSegs[],
+        Workspace* ws, unsigned stride = 1) {
+
+        uint64_t stageStart = 0;
+        if constexpr (Policy::instrumentation) {
+            stageStart = instrumentationNs();
+        }
+
+        int16_t* s = ws->s;
+        bool homingFrame = false;
+        int16_t smax = stride == 1 ? 
+            preprocess(sop, &_z1, &_L_z2, &_mp, s, &homingFrame) :
+            preprocess(sop, stride, &_z1, &_L_z2, &_mp, s, &homingFrame);
+        countFrame(smax);
+        stageEnd(EncoderStats::PREPROCESS, &stageStart);
+
+        // Section 5.2.4 - Autocorrelation
+        // Section 5.2.5 - Computation of the reflection coefficients
+        // Section 5.2.6 - Transformation of reflection coefficients to log-area ratios
+        // Section 5.2.7 - Quantization and coding of the Log-Area Ratios
+        const bool floatAnalysis = isFloatAnalysis();
+        if (floatAnalysis) {
+            lpcAnalysisFloat(s, LARc);
+        } else {
+            lpcAnalysis(s, smax, LARc);
+        }
+        stageEnd(EncoderStats::LPC_ANALYSIS, &stageStart);
+
+        encodeAnalyzed(s, ws->rp, LARc, subSegs, homingFrame, &stageStart);
+    }
+
+    void countFrame(int16_t smax) {
+        if constexpr (Policy::instrumentation) {
+            _stats.frames++;
+            if (smax == 32767) {
+                _stats.saturatedFrames++;
+            }
+        }
+    }
+
+    /**
+     * The rest of a frame after lpcAnalysis(): sections 5.2.8 to 5.2.18 
+     * and the homing.
+     * 
+     * @param s The signal [0..159] coming out of lpcAnalysis(), replaced 
+     *   by the short term residual.
+     * @param rp Scratch space for the reflection coefficients
+     */
+    void encodeAnalyzed(int16_t s[], int16_t rp[][9], const uint16_t LARc[], 
+        SubSegParameters subSegs[], bool homingFrame, uint64_t* stageStart) {
+
+        const bool floatAnalysis = isFloatAnalysis();
+
+        // ===== SHORT TERM ANALYSIS FILTERING SECTION =======================
+
+        // Section 5.2.8 - Decoding of the coded Log-Area Ratios.  
+        // This basically reverses the process above to create the r' version
+        // of the reflection coefficients.  These will also be used on the 
+        // decoder side.
+
+        // We get one set of reflection coefficients for each zone.
+        // The coefficients are in rp[0..3][1..8].
+
+        decodeReflectionCoefficients(LARc, _LARpp_last, rp);
+        stageEnd(EncoderStats::REFLECTION_COEFFICIENTS, stageStart);
+
+        // NUMERICAL NOTE: At this point rp[] is back to the original 
+        // scale of r[].
+
+        // Section 5.2.10 - Short term analysis filtering
+        //
+        // This is the short-term residual signal that will be computed.
+        // NOTE: The residual d[] replaces s[] in place
+        int16_t* d = s;
+        if (floatAnalysis) {
+            shortTermAnalysisFloat(rp, _sLast, s, d);
+        } else {
+            shortTermAnalysis(rp, _u, s, d);
+        }
+        stageEnd(EncoderStats::SHORT_TERM_ANALYSIS, stageStart);
+
+        // ===== LONG TERM PREDICTOR SECTION =================================
+
+        // This part runs four times, once for each sub-segment.  In keeping with 
+        // the draft convention, we use "j" to denote the sub-segment.
+
+        // Only used by the reduced lag search
+        int16_t lagHint = _lastNc;
+        for (uint16_t j = 0; j < 4; j++) {
+            if constexpr (Policy::instrumentation) {
+                // Split in two so that each half can be timed.
+                // The long term residual and the estimate of d[]
+                int16_t e[40], dpp[40];
+                if (floatAnalysis) {
+                    ltpEncodeSubSegmentFloat(d + (j * 40), _dp + _dpHead, &(subSegs[j]), 
+                        e, dpp);
+                } else {
+                    ltpEncodeSubSegment(d + (j * 40), _dp + _dpHead, &(subSegs[j]), 
+                        _complexity, lagHint, e, dpp);
+                }
+                stageEnd(EncoderStats::LTP, stageStart);
+
+                // ===== RPE ENCODING SECTION ================================
+
+                rpeEncodeSubSegment(e, dpp, _dp + _dpHead, &(subSegs[j]), floatAnalysis);
+                stageEnd(EncoderStats::RPE, stageStart);
+            } else {
+                if (floatAnalysis) {
+                    encodeSubSegmentFloat(d + (j * 40), _dp + _dpHead, &(subSegs[j]));
+                } else {
+                    encodeSubSegment(d + (j * 40), _dp + _dpHead, &(subSegs[j]), _complexity, 
+                        lagHint);
+                }
+            }
+            _dpHead = nextHistoryHead(_dpHead);
+            lagHint = _lastNc = subSegs[j].Nc;
+        }
+
+        if constexpr (Policy::boundsChecking) {
+            assert(Parameters::isInRange(LARc, subSegs));
+            assert(_dpHead == 0 || _dpHead == 40 || _dpHead == 80);
+        }
+
+        // Look at the original input frame to determine if it is a homing frame
+        bool homing = false;
+        if constexpr (Policy::homing == Homing::RUNTIME) {
+            homing = _homingSupported;
+        } else {
+            homing = Policy::homing == Homing::ALWAYS;
+        }
+        if (homing && homingFrame) {
+            reset();
+            _lastFrameHome = true;
+            if constexpr (Policy::instrumentation) {
+                _stats.homingResets++;
+            }
+        }
+    }
 
     bool _homingSupported;
     bool _lastFrameHome;
+    unsigned _complexity;
+    bool _floatAnalysis;
+    // The last Nc, used as a hint by the reduced lag search
+    int16_t _lastNc;
     // State preserved between segments
     int16_t _z1;
     int32_t _L_z2;
     int16_t _mp;
     int16_t _LARpp_last[9];
     int16_t _u[8];
+    // The end of the previous s[] (float analysis only)
+    int16_t _sLast[8];
     // NOTE: Indexing in draft document is -120 to -1, but 
     // we treat this as 0 to 119.
-    int16_t _dp[120];
+    //
+    // This is a mirrored ring buffer: entry [i] is always the same as 
+    // entry [i + 120] for i in [0..119] so the 120 entries starting at 
+    // _dpHead (0, 40 or 80) are always contiguous.  This avoids 
+    // shifting the history after each sub-segment.
+    int16_t _dp[240];
+    uint16_t _dpHead;
+
+    typename std::conditional<Policy::instrumentation, EncoderStats, NoStats>::type _stats;
 };
 
+/**
+ * The encoder with the build policy (see BuildPolicy in Policy.h).
+ */
+typedef BasicEncoder<BuildPolicy> Encoder;
+
 }
 
 #endif
@@ -0,0 +1,188 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#ifndef _EncoderBank_h
+#define _EncoderBank_h
+
+#include "Parameters.h"
+#include "Encoder.h"
+
+namespace kc1fsz {
+
+/**
+ * The parts of the bank that don't depend on the number of channels.
+ *
+ * All of the arrays are in structure-of-arrays form: the channel (lane)
+ * is the fastest-moving index, so x[k][lane] is at x[k * lanes + lane].
+ */
+class EncoderBankBase {
+protected:
+
+    /**
+     * Sections 5.2.1 to 5.2.3 - Scaling, offset compensation and
+     * pre-emphasis for all lanes at once.
+     *
+     * @param pcm The 160-sample input frame of each lane
+     * @param z1 Offset compensation state [lanes]
+     * @param L_z2 Offset compensation state [lanes]
+     * @param mp Pre-emphasis state [lanes]
+     * @param s Receives the pre-emphasized signal [160][lanes]
+     */
+    static void preprocess(unsigned lanes, const int16_t* const pcm[],
+        int16_t z1[], int32_t L_z2[], int16_t mp[], int16_t s[]);
+
+    /**
+     * Section 5.2.10 - Short term analysis filtering for all lanes at once.
+     *
+     * @param rp The reflection coefficients [4][9][lanes]
+     * @param u The filter state [8][lanes]
+     * @param s The signal [160][lanes], receives the residual d[] in place.
+     */
+    static void shortTermAnalysis(unsigned lanes, const int16_t rp[],
+        int16_t u[], int16_t s[]);
+};
+
+/**
+ * Encodes N independent streams in lockstep.  The sample-by-sample
+ * recursions (offset compensation, pre-emphasis and the short term
+ * lattice filter) can't be vectorized within one stream, so here each
+ * stream runs in its own SIMD lane.  The remaining per-frame stages
+ * are shared with Encoder and run one lane at a time.
+ *
+ * The output of each lane is bit-identical to what a standalone Encoder
+ * would produce for the same stream.
+ */
+template <unsigned N> class EncoderBank : public EncoderBankBase {
+public:
+
+    EncoderBank(bool homingSupported = true)
+    :   _homingSupported(homingSupported) {
+        reset();
+    }
+
+    /**
+     * Sets all of the encoders back to the "home" state.
+     */
+    void reset() {
+        for (unsigned lane = 0; lane < N; lane++) {
+            reset(lane);
+        }
+        _dpHead = 0;
+    }
+
+    /**
+     * Sets one encoder back to the "home" state.
+     */
+    void reset(unsigned lane) {
+        _z1[lane] = 0;
+        _L_z2[lane] = 0;
+        _mp[lane] = 0;
+        for (uint16_t i = 0; i < 8; i++) {
+            _u[i][lane] = 0;
+        }
+        for (uint16_t i = 0; i < 9; i++) {
+            _LARpp_last[lane][i] = 0;
+        }
+        // NOTE: The history window is shared by all of the lanes, 
+        // clearing the whole buffer is the same as starting over.
+        for (uint16_t i = 0; i < 240; i++) {
+            _dp[lane][i] = 0;
+        }
+    }
+
+    /**
+     * Encodes one 160-sample frame for each of the N channels.
+     * IMPORTANT: THE CALLER MUST ENSURE THAT EACH inputPcm[] CONTAINS 160 SAMPLES.
+     */
+    void encode(const int16_t* const inputPcm[N], Parameters out[N]) {
+
+        // These grow with N so they are kept off of the stack
+        int16_t (&s)[160][N] = _s;
+        int16_t (&rp)[4][9][N] = _rp;
+
+        // Sections 5.2.1 to 5.2.3
+        preprocess(N, inputPcm, _z1, _L_z2, _mp, &s[0][0]);
+
+        // Sections 5.2.4 to 5.2.8 for each lane
+        for (unsigned lane = 0; lane < N; lane++) {
+            int16_t sl[160];
+            for (uint16_t k = 0; k < 160; k++) {
+                sl[k] = s[k][lane];
+            }
+            Encoder::lpcAnalysis(sl, out[lane].LARc);
+            // The autocorrelation rescales s[] in place
+            for (uint16_t k = 0; k < 160; k++) {
+                s[k][lane] = sl[k];
+            }
+            int16_t rpl[4][9];
+            Encoder::decodeReflectionCoefficients(out[lane].LARc,
+                _LARpp_last[lane], rpl);
+            for (uint16_t zone = 0; zone < 4; zone++) {
+                for (uint16_t i = 0; i < 9; i++) {
+                    rp[zone][i][lane] = rpl[zone][i];
+                }
+            }
+        }
+
+        // Section 5.2.10.  NOTE: s[] is replaced by the residual d[]
+        shortTermAnalysis(N, &rp[0][0][0], &_u[0][0], &s[0][0]);
+
+        // Sections 5.2.11 to 5.2.18 for each lane
+        uint16_t head = _dpHead;
+        for (unsigned lane = 0; lane < N; lane++) {
+            int16_t d[160];
+            for (uint16_t k = 0; k < 160; k++) {
+                d[k] = s[k][lane];
+            }
+            head = _dpHead;
+            for (uint16_t j = 0; j < 4; j++) {
+                Encoder::encodeSubSegment(d + (j * 40), _dp[lane] + head,
+                    &(out[lane].subSegs[j]));
+                head = Encoder::nextHistoryHead(head);
+            }
+            if (_homingSupported && Encoder::isHomingFrame(inputPcm[lane])) {
+                reset(lane);
+            }
+        }
+        _dpHead = head;
+    }
+
+private:
+
+    bool _homingSupported;
+    // State preserved between segments, one per lane
+    int16_t _z1[N];
+    int32_t _L_z2[N];
+    int16_t _mp[N];
+    int16_t _u[8][N];
+    // These are only used one lane at a time so they are kept together
+    int16_t _LARpp_last[N][9];
+    // Mirrored ring buffers, see Encoder::_dp
+    int16_t _dp[N][240];
+    uint16_t _dpHead;
+    // Scratch memory, nothing here is carried between frames.
+    // The pre-emphasized signal, replaced by the short term residual
+    int16_t _s[160][N];
+    // The reflection coefficients for each zone
+    int16_t _rp[4][9][N];
+};
+
+}
+
+#endif
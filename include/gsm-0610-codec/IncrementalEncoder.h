@@ -0,0 +1,146 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#ifndef _IncrementalEncoder_h
+#define _IncrementalEncoder_h
+
+#include <cstdint>
+
+#include "Encoder.h"
+#include "PackedFrame.h"
+
+namespace kc1fsz {
+
+/**
+ * An encoder that takes the PCM one sample at a time and does as much of 
+ * the work as it can as each sample arrives: the offset compensation, 
+ * the pre-emphasis, the search for the maximum and the autocorrelation 
+ * sums (sections 5.2.1 to 5.2.4).  Only the work that needs the whole 
+ * frame (the scaling decision, the Schur recursion, the short term filter,
+ * the LTP and the RPE) is left for the 160th sample, which shortens the 
+ * time from the end of a frame to its parameters.
+ * 
+ * The output is bit-exact with BasicEncoder.  The cost is a little more 
+ * work in total, since the autocorrelation sums are kept for each of 
+ * the scalings that are still possible until the end of the frame.
+ *
+ * The Policy is the same as for BasicEncoder (see Policy.h).  With the 
+ * float analysis the sums aren't used, all of section 5.2.4 is done at 
+ * the end of the frame.
+ */
+template <class Policy> class BasicIncrementalEncoder : protected BasicEncoder<Policy> {
+
+    typedef BasicEncoder<Policy> Base;
+
+public:
+
+    BasicIncrementalEncoder(bool homingSupported = true) 
+    :   Base(homingSupported) {
+        EncoderBase::clearAccumulator(&_acc);
+    }
+
+    /**
+     * Sets the encoder back to the "home" state and drops any samples
+     * that haven't made it into a frame yet.
+     */
+    void reset() {
+        Base::reset();
+        EncoderBase::clearAccumulator(&_acc);
+    }
+
+    using Base::setComplexity;
+    using Base::getComplexity;
+    using Base::setFloatAnalysis;
+    using Base::isFloatAnalysis;
+    using Base::getStats;
+    using Base::clearStats;
+
+    /**
+     * The number of samples waiting for the rest of their frame [0..159].
+     */
+    unsigned pending() const { return _acc.count; }
+
+    /**
+     * Takes the next sample.
+     * 
+     * @returns True if the sample completed a frame, in which case out 
+     *   receives its parameters.
+     */
+    bool push(int16_t sample, Parameters* out) {
+        EncoderBase::accumulate(&_acc, sample, &this->_z1, &this->_L_z2, &this->_mp);
+        if (_acc.count < 160) {
+            return false;
+        }
+        endFrame(out->LARc, out->subSegs);
+        return true;
+    }
+
+    /**
+     * Same as above, but writes the parameters into a 33-byte packed 
+     * frame (RFC 3551).
+     * IMPORTANT: THE CALLER MUST ENSURE THAT packedOut[] HAS 33 BYTES.
+     */
+    bool push(int16_t sample, uint8_t* packedOut) {
+        Parameters params;
+        if (!push(sample, &params)) {
+            return false;
+        }
+        PackedFrame* frame = PackedFrame::at(packedOut);
+        frame->setLARc(params.LARc);
+        for (uint16_t j = 0; j < 4; j++) {
+            frame->setSubSeg(j, params.subSegs[j]);
+        }
+        return true;
+    }
+
+private:
+
+    void endFrame(uint16_t LARc[], SubSegParameters subSegs[]) {
+
+        uint64_t stageStart = 0;
+        if constexpr (Policy::instrumentation) {
+            stageStart = instrumentationNs();
+        }
+        this->countFrame(_acc.smax);
+
+        // Sections 5.2.4 to 5.2.7
+        if (isFloatAnalysis()) {
+            EncoderBase::lpcAnalysisFloat(_acc.s, LARc);
+        } else {
+            EncoderBase::lpcAnalysis(&_acc, LARc);
+        }
+        this->stageEnd(EncoderStats::LPC_ANALYSIS, &stageStart);
+
+        int16_t rp[4][9];
+        this->encodeAnalyzed(_acc.s, rp, LARc, subSegs, _acc.homing, &stageStart);
+
+        EncoderBase::clearAccumulator(&_acc);
+    }
+
+    EncoderBase::Accumulator _acc;
+};
+
+/**
+ * The incremental encoder with the build policy (see BuildPolicy in Policy.h).
+ */
+typedef BasicIncrementalEncoder<BuildPolicy> IncrementalEncoder;
+
+}
+
+#endif
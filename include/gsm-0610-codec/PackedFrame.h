@@ -0,0 +1,86 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#ifndef _PackedFrame_h
+#define _PackedFrame_h
+
+#include <cstdint>
+
+#include "Parameters.h"
+
+namespace kc1fsz {
+
+/**
+ * A frame in its packed (33 byte) RFC 3551 form.  This can be laid 
+ * over an existing payload buffer using at() so that the parameters
+ * can be read/written in place without building a Parameters object.
+ * 
+ * https://datatracker.ietf.org/doc/html/rfc3551#section-4.5.8.1
+ */
+class PackedFrame {
+public:
+
+    static constexpr unsigned BYTES = 33;
+
+    /**
+     * The width of each coded Log-Area Ratio LARc[0..7] in bits.
+     */
+    static constexpr uint16_t LARC_BITS[8] = { 6, 6, 5, 5, 4, 4, 3, 3 };
+
+    uint8_t bytes[BYTES];
+
+    /**
+     * Views a 33-byte payload as a packed frame.
+     */
+    static PackedFrame* at(uint8_t* payload) {
+        return reinterpret_cast<PackedFrame*>(payload);
+    }
+
+    static const PackedFrame* at(const uint8_t* payload) {
+        return reinterpret_cast<const PackedFrame*>(payload);
+    }
+
+    bool isValid() const {
+        return Parameters::isValidFrame(bytes);
+    }
+
+    /**
+     * Extracts the coded Log-Area Ratios LARc[0..7].
+     */
+    void getLARc(uint16_t LARc[]) const;
+
+    /**
+     * Writes the 0xd signature and the coded Log-Area Ratios LARc[0..7].
+     */
+    void setLARc(const uint16_t LARc[]);
+
+    /**
+     * Extracts the parameters of sub-segment j [0..3].
+     */
+    void getSubSeg(uint16_t j, SubSegParameters* out) const;
+
+    /**
+     * Writes the parameters of sub-segment j [0..3].
+     */
+    void setSubSeg(uint16_t j, const SubSegParameters& in);
+};
+
+}
+
+#endif
@@ -55,6 +55,12 @@ public:
 
     bool isEqualTo(const SubSegParameters& other) const;
 
+    /**
+     * Checks that each parameter fits in the number of bits that it is
+     * coded with (table 1.1 on page 11).
+     */
+    bool isInRange() const;
+
     /**
      * Packs the sub-segment parameters into the specified area.
      * Please see table 1.1 on page 11 for full information.
@@ -79,6 +85,17 @@ public:
     SubSegParameters subSegs[4];
 
     bool isEqualTo(const Parameters& other) const;
+
+    /**
+     * Checks that each parameter fits in the number of bits that it is
+     * coded with (table 1.1 on page 11).
+     */
+    bool isInRange() const;
+
+    /**
+     * Same as above, but for the parameters in separate arrays.
+     */
+    static bool isInRange(const uint16_t LARc[], const SubSegParameters subSegs[]);
     
     /**
      * This function will write 33 bytes of the stream area, so the caller 
@@ -95,6 +112,12 @@ public:
      */
     void pack(uint8_t* stream) const;
 
+    /**
+     * Packs count frames into count * 33 consecutive bytes of the stream 
+     * area.
+     */
+    static void packBatch(const Parameters* frames, unsigned count, uint8_t* stream);
+
     static bool isValidFrame(const uint8_t* buf);
 
     /**
@@ -112,6 +135,12 @@ public:
      */
     void unpack(const uint8_t* stream);
 
+    /**
+     * Unpacks count frames from count * 33 consecutive bytes of the stream 
+     * area.
+     */
+    static void unpackBatch(const uint8_t* stream, unsigned count, Parameters* frames);
+
     /**
      * Packs one parameter to the specified stream.
      * NOTE: Only works for parameters <= 8 bits (as needed)
@@ -0,0 +1,110 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#ifndef _Policy_h
+#define _Policy_h
+
+namespace kc1fsz {
+
+/**
+ * How the encoder handles the Encoder Homing Frame (see
+ * Encoder::isHomingFrame()).
+ */
+enum class Homing {
+    // Chosen by the homingSupported constructor argument
+    RUNTIME,
+    // Always reset after a homing frame
+    ALWAYS,
+    // Never look for homing frames
+    NEVER
+};
+
+/**
+ * The arithmetic used for the analysis stages of the encoder.
+ */
+enum class Analysis {
+    // Chosen by Encoder::setFloatAnalysis(), fixed-point to start with
+    RUNTIME,
+    // Always the bit-exact fixed-point analysis
+    FIXED,
+    // Always the single-precision analysis (NOT bit-exact)
+    FLOAT
+};
+
+/**
+ * The compile-time configuration of a BasicEncoder/BasicDecoder.  The
+ * codec only uses the branches that the policy asks for, so a deployment
+ * that needs (for example) neither homing nor the float analysis doesn't
+ * carry the code or the tests for them.
+ *
+ * To make a new policy derive from this one and replace what is needed:
+ *
+ *     struct FixedNoHoming : public DefaultPolicy {
+ *         static constexpr Homing homing = Homing::NEVER;
+ *         static constexpr Analysis analysis = Analysis::FIXED;
+ *     };
+ *     BasicEncoder<FixedNoHoming> encoder;
+ *
+ * Encoder and Decoder are the versions with this policy (or with 
+ * InstrumentedPolicy, see BuildPolicy below), which behave the same as 
+ * before there were policies.
+ *
+ * NOTE: The fixed-point backend (see src/fixed_math.h) is still chosen
+ * for the whole build (GSM_FIXED_MATH_BACKEND) since it is used by the
+ * shared stages.
+ */
+struct DefaultPolicy {
+
+    static constexpr Homing homing = Homing::RUNTIME;
+
+    static constexpr Analysis analysis = Analysis::RUNTIME;
+
+    // Checks (with assert()) the parameters going into the decoder and
+    // coming out of the encoder, and the history window.  The index
+    // checks inside the stages are turned on for the whole build with
+    // GSM_BOUNDS_CHECKING.
+    static constexpr bool boundsChecking = false;
+
+    // Collects the stage timing and counters (see getStats()).
+    static constexpr bool instrumentation = false;
+};
+
+/**
+ * The default policy with the stage timing and counters turned on.
+ */
+struct InstrumentedPolicy : public DefaultPolicy {
+    static constexpr bool instrumentation = true;
+};
+
+/**
+ * The policy of Encoder, Decoder and the other front-end typedefs.  
+ * GSM_INSTRUMENTATION (the CMake option of the same name) picks the 
+ * instrumented one.  Since the two are different types, translation 
+ * units built with and without the option can't silently share an 
+ * Encoder of the wrong layout.
+ */
+#ifdef GSM_INSTRUMENTATION
+typedef InstrumentedPolicy BuildPolicy;
+#else
+typedef DefaultPolicy BuildPolicy;
+#endif
+
+}
+
+#endif
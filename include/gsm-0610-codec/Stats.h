@@ -0,0 +1,116 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#ifndef _Stats_h
+#define _Stats_h
+
+#include <cstdint>
+
+namespace kc1fsz {
+
+/**
+ * Counters collected by an Encoder when its policy has instrumentation
+ * (InstrumentedPolicy, which is what Encoder uses when the codec is built
+ * with GSM_INSTRUMENTATION, the CMake option of the same name).  Otherwise
+ * everything stays at zero.
+ */
+struct EncoderStats {
+
+    // The stages that are timed, by section of the draft
+    enum Stage {
+        // 5.2.1 to 5.2.3
+        PREPROCESS,
+        // 5.2.4 to 5.2.7
+        LPC_ANALYSIS,
+        // 5.2.8 to 5.2.9
+        REFLECTION_COEFFICIENTS,
+        // 5.2.10
+        SHORT_TERM_ANALYSIS,
+        // 5.2.11 to 5.2.12
+        LTP,
+        // 5.2.13 to 5.2.18
+        RPE,
+        STAGE_COUNT
+    };
+
+    static const char* stageName(unsigned stage) {
+        switch (stage) {
+            case PREPROCESS: return "preprocess";
+            case LPC_ANALYSIS: return "lpc_analysis";
+            case REFLECTION_COEFFICIENTS: return "reflection_coefficients";
+            case SHORT_TERM_ANALYSIS: return "short_term_analysis";
+            case LTP: return "ltp";
+            case RPE: return "rpe";
+            default: return "?";
+        }
+    }
+
+    uint64_t frames = 0;
+    uint64_t homingResets = 0;
+    // Frames where the pre-emphasized signal hit full scale, which is 
+    // where the saturating arithmetic comes into play.
+    uint64_t saturatedFrames = 0;
+    // Time spent in each stage
+    uint64_t stageNs[STAGE_COUNT] = { 0 };
+};
+
+/**
+ * Counters collected by a Decoder, see EncoderStats.
+ */
+struct DecoderStats {
+
+    enum Stage {
+        // 5.3.1 to 5.3.2
+        LONG_TERM_SYNTHESIS,
+        // 5.3.3
+        REFLECTION_COEFFICIENTS,
+        // 5.3.4 to 5.3.7
+        SHORT_TERM_SYNTHESIS,
+        STAGE_COUNT
+    };
+
+    static const char* stageName(unsigned stage) {
+        switch (stage) {
+            case LONG_TERM_SYNTHESIS: return "long_term_synthesis";
+            case REFLECTION_COEFFICIENTS: return "reflection_coefficients";
+            case SHORT_TERM_SYNTHESIS: return "short_term_synthesis";
+            default: return "?";
+        }
+    }
+
+    uint64_t frames = 0;
+    // Frames where the output hit full scale
+    uint64_t saturatedFrames = 0;
+    uint64_t stageNs[STAGE_COUNT] = { 0 };
+};
+
+/**
+ * Takes the place of the counters when the policy has no instrumentation.
+ */
+struct NoStats {
+};
+
+/**
+ * The time (in ns) used for the stage timing.
+ */
+uint64_t instrumentationNs();
+
+}
+
+#endif
@@ -0,0 +1,198 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#ifndef _StreamingEncoder_h
+#define _StreamingEncoder_h
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Encoder.h"
+#include "PackedFrame.h"
+
+namespace kc1fsz {
+
+/**
+ * An encoder front-end that takes the PCM in chunks of any size (i.e.
+ * the period of an audio device or a 480-sample capture) and produces
+ * 33-byte packed frames (RFC 3551) as each 160 samples are completed.
+ *
+ * Only the part of a frame that spans two chunks is copied into the
+ * internal buffer.  Whole frames inside a chunk are encoded straight
+ * from the caller's memory, so when the chunks line up with the frames
+ * nothing is copied at all.
+ *
+ * The Policy is the same as for BasicEncoder (see Policy.h).
+ */
+template <class Policy> class BasicStreamingEncoder {
+public:
+
+    BasicStreamingEncoder(bool homingSupported = true)
+    :   _encoder(homingSupported),
+        _pending(0) {
+    }
+
+    /**
+     * Sets the encoder back to the "home" state and drops any samples
+     * that haven't made it into a frame yet.
+     */
+    void reset() {
+        _encoder.reset();
+        _pending = 0;
+    }
+
+    /**
+     * The encoder itself, i.e. to change the complexity or get the stats.
+     */
+    BasicEncoder<Policy>& encoder() { return _encoder; }
+
+    /**
+     * The number of samples waiting for the rest of their frame [0..159].
+     */
+    unsigned pending() const { return _pending; }
+
+    /**
+     * The number of frames that write() will produce for a chunk of the
+     * given size.
+     */
+    size_t framesFor(size_t sampleCount) const {
+        return (_pending + sampleCount) / 160;
+    }
+
+    /**
+     * Takes a chunk of PCM and calls onFrame(const uint8_t* packedFrame)
+     * for each frame that is completed.  The packed frame is only valid
+     * during the call.
+     *
+     * @returns The number of frames produced
+     */
+    template <class F> size_t write(const int16_t* pcm, size_t sampleCount, F onFrame) {
+
+        size_t frames = 0;
+        uint8_t packed[PackedFrame::BYTES];
+
+        // Finish the frame that was started by an earlier chunk
+        if (_pending > 0) {
+            size_t n = 160 - _pending;
+            if (n > sampleCount) {
+                n = sampleCount;
+            }
+            for (size_t k = 0; k < n; k++) {
+                _buffer[_pending + k] = pcm[k];
+            }
+            _pending += n;
+            pcm += n;
+            sampleCount -= n;
+            if (_pending < 160) {
+                return 0;
+            }
+            _encoder.encode(_buffer, packed);
+            onFrame((const uint8_t*)packed);
+            _pending = 0;
+            frames++;
+        }
+
+        // Whole frames are encoded in place
+        for (; sampleCount >= 160; sampleCount -= 160, pcm += 160) {
+            _encoder.encode(pcm, packed);
+            onFrame((const uint8_t*)packed);
+            frames++;
+        }
+
+        keep(pcm, sampleCount);
+        return frames;
+    }
+
+    /**
+     * Same as above, but the packed frames are written one after the other
+     * into packedOut[].
+     * IMPORTANT: THE CALLER MUST ENSURE THAT packedOut[] HAS ROOM FOR
+     * framesFor(sampleCount) FRAMES.
+     */
+    size_t write(const int16_t* pcm, size_t sampleCount, uint8_t* packedOut) {
+
+        size_t frames = 0;
+
+        // Finish the frame that was started by an earlier chunk
+        if (_pending > 0) {
+            size_t n = 160 - _pending;
+            if (n > sampleCount) {
+                n = sampleCount;
+            }
+            frames = write(pcm, n, [&packedOut](const uint8_t* frame) {
+                for (unsigned i = 0; i < PackedFrame::BYTES; i++) {
+                    packedOut[i] = frame[i];
+                }
+                packedOut += PackedFrame::BYTES;
+            });
+            if (_pending > 0) {
+                return 0;
+            }
+            pcm += n;
+            sampleCount -= n;
+        }
+
+        // Whole frames are encoded in place, straight into the output
+        size_t whole = sampleCount / 160;
+        _encoder.encodeFrames(pcm, whole, packedOut);
+        frames += whole;
+
+        keep(pcm + whole * 160, sampleCount - whole * 160);
+        return frames;
+    }
+
+    /**
+     * Completes the pending frame (if any) with silence and calls
+     * onFrame() for it.
+     *
+     * @returns The number of frames produced (0 or 1)
+     */
+    template <class F> size_t flush(F onFrame) {
+        if (_pending == 0) {
+            return 0;
+        }
+        const int16_t silence[160] = { 0 };
+        return write(silence, 160 - _pending, onFrame);
+    }
+
+private:
+
+    /**
+     * Keeps the start of the next frame (less than 160 samples).
+     */
+    void keep(const int16_t* pcm, size_t sampleCount) {
+        for (size_t k = 0; k < sampleCount; k++) {
+            _buffer[k] = pcm[k];
+        }
+        _pending = sampleCount;
+    }
+
+    BasicEncoder<Policy> _encoder;
+    int16_t _buffer[160];
+    unsigned _pending;
+};
+
+/**
+ * The streaming encoder with the build policy (see BuildPolicy in Policy.h).
+ */
+typedef BasicStreamingEncoder<BuildPolicy> StreamingEncoder;
+
+}
+
+#endif
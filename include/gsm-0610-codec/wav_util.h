@@ -22,6 +22,8 @@
 
 #include <cstdint>
 #include <iostream>
+#include <fstream>
+#include <vector>
 
 namespace kc1fsz {
 
@@ -32,10 +34,176 @@ void encodeFromPCM16(const int16_t pcm[], uint32_t samples, std::ostream& str,
     uint16_t samplesPerSecond);
 
 /**
+ * Reads a mono 16-bit PCM .WAV stream.  Chunks other than "fmt " and 
+ * "data" (i.e. LIST or fact) are skipped.
+ *
  * @returns Negative number for error, otherwise the number of samples read.
+ *   -1 Not a .WAV stream (or no "fmt "/"data" chunk)
+ *   -2 Not PCM
+ *   -3 Not mono
+ *   -4 Not 16 bits per sample
  */
 int decodeToPCM16(std::istream& str, int16_t pcm[], uint32_t maxSamples);
 
+/**
+ * Same as above, but for any number of channels.  The samples are 
+ * interleaved.
+ *
+ * @param maxSamples The room in pcm[] (total, for all channels).  At most
+ *   maxSamples / channels samples per channel are read.
+ * @param channels Receives the number of channels
+ * @returns Negative number for error (as above, except for -3), otherwise
+ *   the number of samples read (per channel).
+ */
+int decodeToPCM16(std::istream& str, int16_t pcm[], uint32_t maxSamples, uint16_t* channels);
+
+/**
+ * Takes a list of interleaved PCM samples (16-bit) with any number of 
+ * channels and creates a .WAV stream.
+ *
+ * @param samples The number of samples per channel
+ */
+void encodeFromPCM16(const int16_t pcm[], uint32_t samples, uint16_t channels, 
+    std::ostream& str, uint16_t samplesPerSecond);
+
+/**
+ * Encodes each channel of interleaved PCM (i.e. the caller and callee of a 
+ * call recording) into its own stream of 33-byte packed frames (RFC 3551).
+ * Each channel is encoded in place, without deinterleaving it, by its own
+ * Encoder on its own thread.  A partial frame at the end is dropped.
+ *
+ * @param samples The number of samples per channel
+ * @param packedOut One output per channel, each with room for 
+ *   samples / 160 frames.
+ */
+void encodeChannels(const int16_t pcm[], uint16_t channels, uint32_t samples, 
+    uint8_t* const packedOut[]);
+
+/**
+ * The reverse of encodeChannels(): decodes one stream of packed frames 
+ * per channel (each on its own thread) into interleaved PCM.  Each channel
+ * is decoded into a buffer of its own and then interleaved.
+ *
+ * @param packedIn One input per channel, each with frames * 33 bytes
+ * @param pcm Receives frames * 160 samples per channel
+ */
+void decodeChannels(const uint8_t* const packedIn[], uint16_t channels, uint32_t frames,
+    int16_t pcm[]);
+
+/**
+ * Reads a 16-bit PCM .WAV file of any length.  The file is memory-mapped 
+ * where that is supported (otherwise it is read into memory once) and the 
+ * samples are handed out without copying.  Chunks other than "fmt " and 
+ * "data" are skipped.  The samples of a multi-channel file are 
+ * interleaved.
+ *
+ * NOTE: The samples are only handed out in place on a little-endian 
+ * machine, elsewhere they are converted once by open().
+ */
+class WavReader {
+public:
+
+    WavReader();
+    ~WavReader();
+
+    WavReader(const WavReader&) = delete;
+    WavReader& operator=(const WavReader&) = delete;
+
+    /**
+     * @returns 0 on success, otherwise the same error codes as 
+     *   decodeToPCM16() (except for -3, any number of channels is 
+     *   accepted) or -5 if the file can't be opened.
+     */
+    int open(const char* fileName);
+
+    void close();
+
+    uint16_t channels() const { return _channels; }
+
+    uint32_t sampleRate() const { return _sampleRate; }
+
+    /**
+     * The number of samples in the file (per channel).
+     */
+    uint32_t samples() const { return _samples; }
+
+    /**
+     * All of the samples (interleaved), valid until close().
+     */
+    const int16_t* pcm() const { return _pcm; }
+
+    /**
+     * Hands out the next maxSamples samples (per channel), or less at 
+     * the end of the file.  The samples are valid until close().
+     *
+     * @returns The number of samples (per channel), 0 at the end.
+     */
+    uint32_t next(uint32_t maxSamples, const int16_t** pcm);
+
+    /**
+     * Goes back to the first sample for next().
+     */
+    void rewind() { _position = 0; }
+
+private:
+
+    const uint8_t* _file;
+    size_t _fileSize;
+    bool _mapped;
+    std::vector<uint8_t> _fileCopy;
+    std::vector<int16_t> _pcmCopy;
+    const int16_t* _pcm;
+    uint16_t _channels;
+    uint32_t _sampleRate;
+    uint32_t _samples;
+    uint32_t _position;
+};
+
+/**
+ * Writes a 16-bit PCM .WAV file of any length.  The samples are buffered
+ * and written in large blocks, and the sizes in the header are filled 
+ * in by close().
+ */
+class WavWriter {
+public:
+
+    WavWriter();
+    ~WavWriter();
+
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+
+    /**
+     * @returns 0 on success, -5 if the file can't be created.
+     */
+    int open(const char* fileName, uint32_t sampleRate, uint16_t channels = 1);
+
+    /**
+     * Adds samples (interleaved if there is more than one channel).  
+     * Ignored unless open() succeeded.
+     *
+     * @param samples The number of samples per channel
+     */
+    void write(const int16_t pcm[], uint32_t samples);
+
+    /**
+     * Writes out what is left in the buffer and patches the header.
+     *
+     * @returns 0 on success, -6 if something couldn't be written.
+     */
+    int close();
+
+private:
+
+    void flush();
+
+    std::ofstream _str;
+    std::vector<uint8_t> _buffer;
+    size_t _used;
+    uint16_t _channels;
+    uint32_t _dataBytes;
+};
+
 }
 
 #endif
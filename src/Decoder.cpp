@@ -22,134 +22,100 @@
 
 #include "gsm-0610-codec/Encoder.h"
 #include "gsm-0610-codec/Decoder.h"
+#include "gsm-0610-codec/PackedFrame.h"
 
 // Utility
 //#define q15_to_f32(a) ((float)(a) / 32768.0f)
 
-// Sanity checking function for index bounds
-// USE THIS VERSION FOR DEVELOPMENT/TESTING
-//#define IX(x, lo, hi) (_checkIx(x, lo, hi))
-// USE THIS VERSION FOR PRODUCTION
+// Sanity checking function for index bounds.  Define GSM_BOUNDS_CHECKING 
+// (the CMake option of the same name) for development/testing.
+#ifdef GSM_BOUNDS_CHECKING
+#define IX(x, lo, hi) (_checkIx(x, lo, hi))
+#else
 #define IX(x, lo, hi) (x)
+#endif
 
 namespace kc1fsz {
 
-// Sanity checking function for index bounds
-//static uint16_t _checkIx(uint16_t x, uint16_t lo, uint16_t hi) {
-//    assert(x >= lo && x <= hi);
-//    return x;
-//}
-
-Decoder::Decoder() {
-    reset();
+#ifdef GSM_BOUNDS_CHECKING
+static uint16_t _checkIx(uint16_t x, uint16_t lo, uint16_t hi) {
+    assert(x >= lo && x <= hi);
+    return x;
 }
+#endif
 
-void Decoder::reset() {
-    _nrp = 40;
-    for (uint16_t k = 0; k <= 159; k++) {
-        _drp[k] = 0;
-    }
-    for (uint16_t i = 0; i <= 8; i++) {
-        _LARpp_last[i] = 0;
-    }
-    for (uint16_t i = 0; i <= 8; i++) {
-        _v[i] = 0;
+bool DecoderBase::isSaturated(const int16_t pcm[], uint16_t count, unsigned stride) {
+    for (uint16_t k = 0; k < count; k++) {
+        if (pcm[k * stride] == (int16_t)0x7ff8 || pcm[k * stride] == -32768) {
+            return true;
+        }
     }
-    _msr = 0;
+    return false;
 }
 
-void Decoder::decode(const Parameters* input, int16_t* outputPcm) {
-
-    // This will be filled one sub-segment at a time.  It is 
-    // essentially the dr' signal for each sub-segment.
-    int16_t wt[160];
-
-    // This part runs four times, once for each sub-segment.  In keeping with 
-    // the draft convention, we use "j" to denote the sub-segment.
-    for (uint16_t j = 0; j < 4; j++) {
-
-        // Section 5.3.1 - RPE Decoding 
-        // The goal here is to reconstruct the long-term residual erp[0..39] signal
-        // from the received parameters for this sub-segment (Mc, xmaxc, xMc[]).
-
-        int16_t exp, mant, itest;
-
-        // Compute exponent and mantissa of the decoded version of xmaxc
-        exp = 0;
-        mant = 0;
-
-        if (input->subSegs[j].xmaxc > 15) {
-            exp = sub((input->subSegs[j].xmaxc >> 3), 1);    
-        }
-        mant = sub(input->subSegs[j].xmaxc, (exp << 3));
-
-        // Normalize mantissa0 <= mant <= 7
-        if (mant == 0) {
-            exp = -4;
-            mant = 15;
-        } else {
-            itest = 0;
-            for (uint16_t i = 0; i <= 2; i++) {
-                if (mant > 7) {
-                    itest = 1;
-                }
-                if (itest == 0) {
-                    mant = add((mant << 1), 1);
-                }
-                if (itest == 0) {
-                    exp = sub(exp, 1);
-                }
-            }
-        }
-        mant = sub(mant, 8);
-
-        // Encoder Section 5.2.16 - APCM inverse quantization
-        // Encoder Section 5.2.17 RPE grid positioning
-        int16_t erp[40];
-        Encoder::inverseAPCM(input, j, exp, mant, erp);
-
-        // Section 5.3.2 - Long-Term Synthesis Filtering
-        // Use bc abd Nc to realize the long-term synthesis filtering
-
-        int16_t Nr = input->subSegs[j].Nc;
-        if (input->subSegs[j].Nc < 40) {
-            Nr = _nrp;
-        } else if (input->subSegs[j].Nc > 120) {
-            Nr = _nrp;
-        }
-        _nrp = Nr;
-
-        // Decoding of the LTP gain bc
-        int16_t brp = Encoder::QLB[input->subSegs[j].bc];
+/**
+ * Sections 5.3.1 and 5.3.2 for one sub-segment.
+ */
+void DecoderBase::decodeSubSegment(const SubSegParameters* input, int16_t drp[], int16_t* nrp, 
+    int16_t wt[]) {
 
-        // Computation of the reconstructed short term residual signal drp[0..39]
-        for (int16_t k = 0; k <= 39; k++) {
-            // NOTE: Index for _drp[] is different from draft doc
-            int16_t drpp = mult_r(brp, _drp[IX((k - Nr) + 120, 0, 119)]);
-            // NOTE: Index for _drp[] is different from draft doc
-            _drp[IX((k + 120), 120, 159)] = add(erp[k], drpp);
-        }
+    // Section 5.3.1 - RPE Decoding 
+    // The goal here is to reconstruct the long-term residual erp[0..39] signal
+    // from the received parameters for this sub-segment (Mc, xmaxc, xMc[]).
+    //
+    // The exponent and mantissa of the decoded xmaxc and the APCM inverse 
+    // quantization (encoder section 5.2.16) are done by table lookup, 
+    // followed by the RPE grid positioning (encoder section 5.2.17).
+    int16_t erp[40];
+    Encoder::inverseAPCM(input, erp);
+
+    // Section 5.3.2 - Long-Term Synthesis Filtering
+    // Use bc abd Nc to realize the long-term synthesis filtering
+
+    int16_t Nr = input->Nc;
+    if (input->Nc < 40) {
+        Nr = *nrp;
+    } else if (input->Nc > 120) {
+        Nr = *nrp;
+    }
+    *nrp = Nr;
 
-        // Update the reconstructed short-term residual signal drp[-1..-120]
-        for (int16_t k = 0; k <= 119; k++) {
-            _drp[IX((-120 + k) + 120, 0, 119)] = _drp[IX((-80 + k) + 120, 40, 159)];
-        }
+    // Decoding of the LTP gain bc
+    int16_t brp = Encoder::QLB[input->bc];
 
-        // Load up the right part of the wt[] vector, based on which sub-segment
-        // we are working on.
-        for (int16_t k = 0; k <= 39; k++) {
-            // NOTE: _drp[] index differs from draft
-            wt[IX((j * 40) + k, 0, 159)] = _drp[IX(k + 120, 120, 159)];
-        }
+    // Computation of the reconstructed short term residual signal drp[0..39]
+    //
+    // NOTE: Rather than shifting the history after the sub-segment, each 
+    // new entry is written just past the end of the window at [120..159] 
+    // and also at [0..39] (where the oldest entries were).  The caller 
+    // then moves the window forward by 40.  The read below never touches 
+    // an entry that has already been replaced because Nr >= 40.
+    //
+    // RANGE NOTE: brp is one of QLB[] (all positive) so the mult_r() can't
+    // saturate.  The add() can.
+    for (int16_t k = 0; k <= 39; k++) {
+        // NOTE: Index for drp[] is different from draft doc
+        int16_t drpp = mult_r_nosat(brp, drp[IX((k - Nr) + 120, 0, 119)]);
+        int16_t drpk = add(erp[k], drpp);
+        drp[IX(k + 120, 120, 159)] = drpk;
+        drp[IX(k, 0, 39)] = drpk;
+        wt[k] = drpk;
     }
+}
 
-    // Section 5.3.3 - Computation of the decoded reflection coefficients
-    // The goal is to reconstruct rrp[1..8] 
-
-    int16_t rrp[4][9];
-    Encoder::decodeReflectionCoefficients(input, _LARpp_last, rrp);
+/**
+ * Sections 5.3.4 to 5.3.7
+ */
+void DecoderBase::shortTermSynthesis(const int16_t rrp[][9], int16_t v[], int16_t* msr, 
+    const int16_t wt[], int16_t outputPcm[], unsigned stride) {
+    for (uint16_t j = 0; j < 4; j++) {
+        shortTermSynthesis(rrp, v, msr, j, wt + (j * 40), outputPcm + (j * 40 * stride), 
+            stride);
+    }
+}
 
-    // NUMERICAL NOTE: At this point rrp[] is at full scale
+void DecoderBase::shortTermSynthesis(const int16_t rrp[][9], int16_t v[], int16_t* msr, 
+    uint16_t j, const int16_t wt[], int16_t outputPcm[], unsigned stride) {
 
     // Section 5.3.4 - Short term synthesis filtering section
     //
@@ -158,31 +124,34 @@ void Decoder::decode(const Parameters* input, int16_t* outputPcm) {
     //
     // We also take the chance to perform the post-processing on the
     // output samples.
+    //
+    // RANGE NOTE: rrp[] is never -32768 (see Encoder::shortTermAnalysis())
+    // so the mult_r()s in the lattice can't saturate, and neither can the
+    // one in the deemphasis.  The add()s and sub()s can.
 
-    for (int16_t k = 0; k <= 159; k++) {
+    for (int16_t k = 0; k <= 39; k++) {
         // Remember that the filter coefficients change as we move across 
         // the segment.  IMPORTANT: ZONE != SUB-SEGMENT!!
-        int16_t zone = Encoder::k2zone(k);
+        int16_t zone = Encoder::k2zone(j * 40 + k);
         // See figure 3.5 on page 26 
         int16_t sri = wt[k];
         for (int16_t i = 1; i <= 8; i++) {
-            sri = sub(sri, mult_r(rrp[zone][IX(9 - i, 1, 8)], _v[IX(8 - i, 0, 7)]));
-            // Moving forward on _v[]
-            _v[IX(9 - i, 1, 8)] = add(_v[IX(8 - i, 0, 7)], mult_r(rrp[zone][IX(9 - i, 1, 8)], sri));
+            sri = sub(sri, mult_r_nosat(rrp[zone][IX(9 - i, 1, 8)], v[IX(8 - i, 0, 7)]));
+            // Moving forward on v[]
+            v[IX(9 - i, 1, 8)] = add(v[IX(8 - i, 0, 7)], mult_r_nosat(rrp[zone][IX(9 - i, 1, 8)], sri));
         }
-        _v[0] = sri;
+        v[0] = sri;
 
         // Section 5.3.5 - Deemphasis filtering
         // 28180/32767 = 0.86
-        //int16_t temp = add(sr[k], mult_r(_msr, 28180));
-        int16_t temp = add(sri, mult_r(_msr, 28180));
-        _msr = temp;
+        int16_t temp = add(sri, mult_r_nosat(*msr, 28180));
+        *msr = temp;
 
         // Section 5.3.6 - Up-scaling of the output signal
-        int16_t srop = add(_msr, _msr);
+        int16_t srop = add(*msr, *msr);
 
         // Section 5.3.7 - Truncation of the output variable
-        outputPcm[k] = srop & 0xfff8;
+        outputPcm[k * stride] = srop & 0xfff8;
     }
 }
 
@@ -0,0 +1,101 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#include "fixed_math.h"
+#include "lanes.h"
+#include "gsm-0610-codec/DecoderBank.h"
+
+namespace kc1fsz {
+
+// The lane loop below follows Decoder::shortTermSynthesis() exactly, one 
+// lane at a time.  On SSE4.1 targets the lanes are first handled in groups 
+// of 8 and the scalar loop picks up whatever is left over.
+
+#ifdef __SSE4_1__
+
+/**
+ * Short term synthesis and post-processing for lanes [lane, lane + 7].
+ */
+static void shortTermSynthesis_x8(unsigned lanes, unsigned lane, const int16_t rrp[],
+    int16_t v[], int16_t msr[], int16_t wt[]) {
+
+    __m128i vv[9];
+    for (uint16_t i = 0; i <= 8; i++) {
+        vv[i] = _mm_loadu_si128((const __m128i*)(v + (i * lanes + lane)));
+    }
+    __m128i msrv = _mm_loadu_si128((const __m128i*)(msr + lane));
+    const __m128i deemph = _mm_set1_epi16(28180);
+    const __m128i mask = _mm_set1_epi16((int16_t)0xfff8);
+
+    for (uint16_t k = 0; k <= 159; k++) {
+        int16_t* wtp = wt + (k * lanes + lane);
+        const int16_t* rrpz = rrp + (Encoder::k2zone(k) * 9 * lanes + lane);
+        __m128i sri = _mm_loadu_si128((const __m128i*)wtp);
+        for (uint16_t i = 1; i <= 8; i++) {
+            __m128i rrpi = _mm_loadu_si128((const __m128i*)(rrpz + (9 - i) * lanes));
+            sri = _mm_subs_epi16(sri, mult_r_x8(rrpi, vv[8 - i]));
+            vv[9 - i] = _mm_adds_epi16(vv[8 - i], mult_r_x8(rrpi, sri));
+        }
+        vv[0] = sri;
+
+        // Section 5.3.5 - Deemphasis filtering
+        msrv = _mm_adds_epi16(sri, mult_r_x8(msrv, deemph));
+        // Section 5.3.6 - Up-scaling of the output signal
+        // Section 5.3.7 - Truncation of the output variable
+        _mm_storeu_si128((__m128i*)wtp, _mm_and_si128(_mm_adds_epi16(msrv, msrv), mask));
+    }
+
+    for (uint16_t i = 0; i <= 8; i++) {
+        _mm_storeu_si128((__m128i*)(v + (i * lanes + lane)), vv[i]);
+    }
+    _mm_storeu_si128((__m128i*)(msr + lane), msrv);
+}
+
+#endif
+
+void DecoderBankBase::shortTermSynthesis(unsigned lanes, const int16_t rrp[],
+    int16_t v[], int16_t msr[], int16_t wt[]) {
+
+    unsigned lane = 0;
+#ifdef __SSE4_1__
+    for (; lane + 8 <= lanes; lane += 8) {
+        shortTermSynthesis_x8(lanes, lane, rrp, v, msr, wt);
+    }
+#endif
+
+    // (See the RANGE NOTE in Decoder::shortTermSynthesis())
+    for (; lane < lanes; lane++) {
+        for (uint16_t k = 0; k <= 159; k++) {
+            const int16_t* rrpz = rrp + (Encoder::k2zone(k) * 9 * lanes + lane);
+            int16_t sri = wt[k * lanes + lane];
+            for (uint16_t i = 1; i <= 8; i++) {
+                int16_t rrpi = rrpz[(9 - i) * lanes];
+                sri = sub(sri, mult_r_nosat(rrpi, v[(8 - i) * lanes + lane]));
+                v[(9 - i) * lanes + lane] = add(v[(8 - i) * lanes + lane], mult_r_nosat(rrpi, sri));
+            }
+            v[lane] = sri;
+
+            msr[lane] = add(sri, mult_r_nosat(msr[lane], 28180));
+            int16_t srop = add(msr[lane], msr[lane]);
+            wt[k * lanes + lane] = srop & 0xfff8;
+        }
+    }
+}
+
+}
@@ -20,26 +20,48 @@
 #include <cassert>
 
 #include "fixed_math.h"
+#include "kernels.h"
+#include "float_analysis.h"
+#include "tables.h"
 #include "gsm-0610-codec/Encoder.h"
+#include "gsm-0610-codec/PackedFrame.h"
+
+#ifdef PICO_BUILD
+#include "pico/time.h"
+#else
+#include <chrono>
+#endif
 
 // Utility
 //#define q15_to_f32(a) ((float)(a) / 32768.0f)
 
-// Sanity checking function for index bounds
-// USE THIS VERSION FOR DEVELOPMENT/TESTING
-//#define IX(x, lo, hi) (_checkIx(x, lo, hi))
-// USE THIS VERSION FOR PRODUCTION
+// Sanity checking function for index bounds.  Define GSM_BOUNDS_CHECKING 
+// (the CMake option of the same name) for development/testing.
+#ifdef GSM_BOUNDS_CHECKING
+#define IX(x, lo, hi) (_checkIx(x, lo, hi))
+#else
 #define IX(x, lo, hi) (x)
+#endif
 
 namespace kc1fsz {
 
-// Sanity checking function for index bounds
-//static uint16_t _checkIx(uint16_t x, uint16_t lo, uint16_t hi) {
-//    assert(x >= lo && x <= hi);
-//    return x;
-//}
+#ifdef GSM_BOUNDS_CHECKING
+static uint16_t _checkIx(uint16_t x, uint16_t lo, uint16_t hi) {
+    assert(x >= lo && x <= hi);
+    return x;
+}
+#endif
+
+uint64_t instrumentationNs() {
+#ifdef PICO_BUILD
+    return time_us_64() * 1000;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
 
-uint16_t Encoder::k2zone(uint16_t k) {
+uint16_t EncoderBase::k2zone(uint16_t k) {
     if (k <= 12) {
         return 0;
     } else if (k <= 26) {
@@ -51,51 +73,11 @@ uint16_t Encoder::k2zone(uint16_t k) {
     }
 }
 
-Encoder::Encoder(bool homingSupported) 
-:   _homingSupported(homingSupported),
-    _lastFrameHome(false) {
-    reset();
-}
-
-void Encoder::reset() {
-    _z1 = 0;
-    _L_z2 = 0;
-    _mp = 0;
-    for (uint16_t i = 1; i <= 8; i++) {
-        _LARpp_last[i] = 0;
-    }
-    for (uint16_t i = 0; i < 8; i++) {
-        _u[i] = 0;
-    }
-    for (uint16_t i = 0; i < 120; i++) {
-        _dp[IX(i, 0, 119)] = 0;
-    }
-}
-
 /**
- * Please see https://www.etsi.org/deliver/etsi_EN/300900_300999/300961/08.00.01_40/en_300961v080001o.pdf
- * for the source specification that was used for this CODEC.  References to page/section numbers
- * are taken from that specific version of the document Draft "ETSI EN 300 961 V8.0.1 (2000-07).""
- * 
- * Variable names from the draft are preserved, even when they violate common C++ coding
- * conventions.
-*/
-void Encoder::encode(const int16_t sop[], Parameters* output) {
-
-    int16_t so[160];
-    int16_t sof[160];
-    int16_t s[160];
-    int16_t s1 = 0;
-    int32_t L_s2;
-    int16_t temp, temp1, temp2, di, sav;
-    int16_t smax;
-    int16_t scal;
-    int32_t L_ACF[9];
-    int16_t ACF[9];
-    int16_t P[9];
-    int16_t r[9];
-    int16_t K[9];
-    int32_t L_temp;
+ * Sections 5.2.1 to 5.2.3 for one sample.
+ */
+static inline int16_t preprocessSample(int16_t sop, int16_t* z1, int32_t* L_z2, 
+    int16_t* mp) {
 
     /*
     // Section 5.2.1 - Scaling of the input variable
@@ -108,85 +90,208 @@ void Encoder::encode(const int16_t sop[], Parameters* output) {
     */
 
     // Section 5.2.1 - Scaling of the input variable
+    // Shift away the 3 low-order (don't care) bits
+    // Back in q15 format divided by two
+    int16_t so = sop >> 1;
+
     // Section 5.2.2 - Offset compensation
-    for (uint16_t k = 0; k <= 159; k++) {
+    //
+    // RANGE NOTE: |so| <= 16384 so the difference can't saturate. 
+    // The filter is a DC notch (the sum of its impulse response is 
+    // zero) so |L_z2| stays near 2^30, well away from the 32-bit 
+    // limits, and the L_add()s below can't saturate either.  lsp is 
+    // the low 15 bits of L_z2, so it is never negative.  None of the 
+    // constants are -32768, so none of the mult_r()s can saturate.
+    // This is checked by gsm-range.
+    //
+    // Compute the non-recursive part
+    int16_t s1 = sub_nosat(so, *z1);
+    *z1 = so;
 
-        // Shift away the 3 low-order (don't care) bits
-        // Back in q15 format divided by two
-        so[k] = sop[k] >> 1;
+    // Compute the recursive part
+    int32_t L_s2 = s1;
+    L_s2 = L_s2 << 15;
 
-        // Compute the non-recursive part
-        s1 = sub(so[k], _z1);
-        _z1 = so[k];
+    // Execution of a 31 by 16 bit multiplication
+    int16_t msp = *L_z2 >> 15;
+    int16_t lsp = L_sub_nosat(*L_z2, (msp << 15));
+    int16_t temp = mult_r_nosat(lsp, 32735);
+    L_s2 = L_add_nosat(L_s2, temp);
+    *L_z2 = L_add_nosat(L_mult(msp, 32735) >> 1, L_s2);
 
-        // Compute the recursive part
-        L_s2 = s1;
-        L_s2 = L_s2 << 15;
+    // Compute sof[k] with rounding
+    int16_t sof = L_add_nosat(*L_z2, 16384) >> 15;
 
-        // Execution of a 31 by 16 bit multiplication
-        int16_t msp = _L_z2 >> 15;
-        int16_t lsp = L_sub(_L_z2, (msp << 15));
-        int16_t temp = mult_r(lsp, 32735);
-        L_s2 = L_add(L_s2, temp);
-        _L_z2 = L_add(L_mult(msp, 32735) >> 1, L_s2);
+    // Section 5.2.3 - Pre-emphasis
+    // -28180/32767 = -0.86
+    // (The final add() CAN saturate on a full-scale input)
+    int16_t s = add(sof, mult_r_nosat(*mp, -28180));
+    *mp = sof;
+    return s;
+}
 
-        // Compute sof[k] with rounding
-        sof[k] = L_add(_L_z2, 16384) >> 15;
-    }
+/**
+ * Sections 5.2.1 to 5.2.3, plus the maximum search from 5.2.4.  The input
+ * sample k is sop[k * stride].
+ */
+static inline int16_t preprocessFrame(const int16_t sop[], unsigned stride, int16_t* z1, 
+    int32_t* L_z2, int16_t* mp, int16_t s[], bool* homingFrame) {
+
+    // The preprocessing is done in a single pass over the input.  Along 
+    // the way we also pick up the maximum of |s[]| (needed for the scaling
+    // in section 5.2.4) and check for the homing frame.
+    int16_t smax = 0;
+    bool homing = true;
 
-    // Section 5.2.3 - Pre-emphasis
     for (uint16_t k = 0; k <= 159; k++) {
-        // -28180/32767 = -0.86
-        s[k] = add(sof[k], mult_r(_mp, -28180));
-        _mp = sof[k];
-    }
 
-    // Section 5.2.4 - Autocorrelation
-    //
-    // The goal is to compute the array L_ACF[k].  The signal s[i] shall be scaled in order 
-    // to avoid an overflow situation.
+        const int16_t sopk = sop[k * stride];
 
-    // Search for the maximum
-    smax = 0;
-    for (uint16_t k = 0; k <= 159; k++) {
+        // See isHomingFrame()
+        homing = homing && (sopk == 1);
+
+        s[k] = preprocessSample(sopk, z1, L_z2, mp);
+
+        // Section 5.2.4 - Search for the maximum
         int16_t temp = s_abs(s[k]);
         if (temp > smax) {
             smax = temp;
         }
     }
 
-    // Computation of the scaling factor
-    int16_t scalauto = 0;
-    if (smax == 0) {
-        scalauto = 0;
-    } else {
-        scalauto = sub(4, norm(smax << 16));
+    *homingFrame = homing;
+    return smax;
+}
+
+int16_t EncoderBase::preprocess(const int16_t sop[], int16_t* z1, int32_t* L_z2, int16_t* mp,
+    int16_t s[], bool* homingFrame) {
+    return preprocessFrame(sop, 1, z1, L_z2, mp, s, homingFrame);
+}
+
+int16_t EncoderBase::preprocess(const int16_t sop[], unsigned stride, int16_t* z1, 
+    int32_t* L_z2, int16_t* mp, int16_t s[], bool* homingFrame) {
+    return preprocessFrame(sop, stride, z1, L_z2, mp, s, homingFrame);
+}
+
+void EncoderBase::clearAccumulator(Accumulator* acc) {
+    acc->count = 0;
+    acc->smax = 0;
+    acc->homing = true;
+    for (uint16_t c = 0; c <= 4; c++) {
+        for (uint16_t k = 0; k <= 8; k++) {
+            acc->L_sum[c][k] = 0;
+        }
+        for (uint16_t k = 160; k < 168; k++) {
+            acc->scaled[c][k] = 0;
+        }
     }
+}
 
-    // Scaling of the array s[0..159]
-    if (scalauto > 0) {
-        int16_t temp = 16384 >> sub(scalauto, 1);
-        for (uint16_t k = 0; k <= 159; k++) {
-            s[k] = mult_r(s[k], temp);
+/**
+ * The scaling of section 5.2.4 for one sample: mult_r(s, 16384 >> 
+ * (scalauto - 1)) is the same as a rounding shift to the right.
+ */
+static inline int16_t autocorrelationScaled(int16_t s, int16_t scalauto) {
+    return scalauto > 0 ? (s + (1 << (scalauto - 1))) >> scalauto : s;
+}
+
+void EncoderBase::accumulate(Accumulator* acc, int16_t sop, int16_t* z1, int32_t* L_z2, 
+    int16_t* mp) {
+
+    const uint16_t k = acc->count;
+    int16_t* s = acc->s;
+
+    // See isHomingFrame()
+    acc->homing = acc->homing && (sop == 1);
+
+    s[k] = preprocessSample(sop, z1, L_z2, mp);
+
+    // Section 5.2.4 - Search for the maximum
+    int16_t temp = s_abs(s[k]);
+    if (temp > acc->smax) {
+        acc->smax = temp;
+    }
+
+    // Section 5.2.4 - Autocorrelation
+    //
+    // The scaling isn't known until the end of the frame, but it can only
+    // go up as smax grows, so the sums are kept for every scaling that is 
+    // still possible and the smaller ones are dropped.  The sums of the 
+    // scaling that is finally chosen have seen every sample and are the 
+    // same as the batch version (see the range note in kernels.h).
+    int16_t first = autocorrelationScale(acc->smax);
+    if (first < 0) {
+        first = 0;
+    }
+    for (int16_t c = first; c <= 4; c++) {
+        // The scaled signal is kept in reverse so that x[i] is the sample
+        // at k - i, and it ends with 8 zeros.
+        int16_t* x = acc->scaled[c] + 159 - k;
+        int32_t* L_sum = acc->L_sum[c];
+        x[0] = autocorrelationScaled(s[k], c);
+        for (uint16_t i = 0; i <= 8; i++) {
+            L_sum[i] += (int32_t)x[0] * (int32_t)x[i];
         }
     }
 
-    // Compute the L_ACF[..]
+    acc->count = k + 1;
+}
+
+void EncoderBase::lpcAnalysis(Accumulator* acc, uint16_t LARc_out[]) {
+
+    int16_t scalauto = autocorrelationScale(acc->smax);
+    int16_t c = scalauto > 0 ? scalauto : 0;
+
+    int32_t L_ACF[9];
     for (uint16_t k = 0; k <= 8; k++) {
-        L_ACF[k] = 0;
-        for (uint16_t i = k; i <= 159; i++) {
-            L_temp = L_mult(s[i], s[i - k]);
-            L_ACF[k] = L_add(L_ACF[k], L_temp);
-        }
+        L_ACF[k] = acc->L_sum[c][k] << 1;
     }
 
-    // Rescaling of the array s[0..159]
+    // Scaling and rescaling of the array s[0..159] (the low-order bits 
+    // are lost, exactly as in the batch version)
     if (scalauto > 0) {
+        const int16_t* x = acc->scaled[c];
         for (uint16_t k = 0; k <= 159; k++) {
-            s[k] = s[k] << scalauto;
+            acc->s[k] = x[159 - k] << scalauto;
         }
     }
 
+    lpcFromAutocorrelation(L_ACF, LARc_out);
+}
+
+/**
+ * Sections 5.2.4 to 5.2.7
+ */
+void EncoderBase::lpcAnalysis(int16_t s[], uint16_t LARc_out[]) {
+    lpcAnalysis(s, autocorrelationMax(s), LARc_out);
+}
+
+void EncoderBase::lpcAnalysis(int16_t s[], int16_t smax, uint16_t LARc_out[]) {
+
+    int32_t L_ACF[9];
+
+    // Section 5.2.4 - Autocorrelation
+    //
+    // The goal is to compute the array L_ACF[k].  The signal s[i] shall be scaled in order 
+    // to avoid an overflow situation.
+
+    // The scaling of s[], the computation of L_ACF[0..8] and the 
+    // rescaling of s[] are done by a (possibly vectorized) kernel.
+    autocorrelation(s, smax, L_ACF);
+
+    lpcFromAutocorrelation(L_ACF, LARc_out);
+}
+
+/**
+ * Sections 5.2.5 to 5.2.7
+ */
+void EncoderBase::lpcFromAutocorrelation(const int32_t L_ACF[], uint16_t LARc_out[]) {
+
+    int16_t ACF[9];
+    int16_t P[9];
+    int16_t r[9];
+    int16_t K[9];
+
     // Section 5.2.5 Computation of the reflection coefficients
 
     // Schur recursion with 16 bit arithmetic
@@ -316,371 +421,287 @@ void Encoder::encode(const int16_t sop[], Parameters* output) {
     // Write out the parameters.
     // NOTE: The draft uses index [1..8] for the LARc array
     for (uint16_t i = 0; i < 8; i++) {
-        output->LARc[IX(i, 0, 7)] = LARc[IX(i + 1, 1, 8)];
+        LARc_out[IX(i, 0, 7)] = LARc[IX(i + 1, 1, 8)];
     }
+}
 
-    // ===== SHORT TERM ANALYSIS FILTERING SECTION ===========================
-
-    // Section 5.2.8 - Decoding of the coded Log-Area Ratios.  
-    // This basically reverses the process above to create the r' version
-    // of the reflection coefficients.  These will also be used on the 
-    // decoder side.
-
-    // We get one set of reflection coefficients for each zone.
-    // The coefficients are in rp[0..3][1..8].
-
-    int16_t rp[4][9];
-    decodeReflectionCoefficients(output, _LARpp_last, rp);
+/**
+ * Section 5.2.10
+ */
+void EncoderBase::shortTermAnalysis(const int16_t rp[][9], int16_t u[], const int16_t s[], 
+    int16_t d[]) {
 
-    // NUMERICAL NOTE: At this point rp[] is back to the original 
-    // scale of r[].
+    int16_t temp, di, sav;
 
     // Section 5.2.10 - Short term analysis filtering
 
-    // This is the short-term residual signal that will be computed.
+    // d[] is the short-term residual signal that will be computed.
     // We use the original signal s[] and the INVERSE of the filter
     // that is defined by the coefficients in r'.
-    int16_t d[160];
 
     // NOTE: The zone thing continues here since there are 4 different
     // sets of rp coefficients.
 
     // Calculate d[] which is the short-term residual.
     //
-    // _u[0..7] is used to generate the delay during the application 
-    // of the filter.  Notice that _u[7] will be used during the 
+    // u[0..7] is used to generate the delay during the application 
+    // of the filter.  Notice that u[7] will be used during the 
     // processing of the first sample in the next call (i.e. state
     // be being carried across segments).
 
+    // RANGE NOTE: decodeReflectionCoefficients() negates a value that
+    // is at most 32767, so rp[] is never -32768 and the mult_r()s can't 
+    // saturate.  The add()s can.
     for (uint16_t k = 0; k <= 159; k++) {
         di = s[k];
         sav = di;
         uint16_t zone = k2zone(k);
         for (uint16_t i = 1; i <= 8; i++) {
-            temp = add(_u[IX(i - 1, 0, 7)], mult_r(rp[zone][i], di));
-            di = add(di, mult_r(rp[zone][i], _u[IX(i - 1, 0, 7)]));
-            _u[IX(i - 1, 0, 7)] = sav;
+            temp = add(u[IX(i - 1, 0, 7)], mult_r_nosat(rp[zone][i], di));
+            di = add(di, mult_r_nosat(rp[zone][i], u[IX(i - 1, 0, 7)]));
+            u[IX(i - 1, 0, 7)] = sav;
             sav = temp;
         }
         d[k] = di;
     }
+}
 
-    // ===== LONG TERM PREDICTOR SECTION =====================================
-
-    // This part runs four times, once for each sub-segment.  In keeping with 
-    // the draft convention, we use "j" to denote the sub-segment.
-
-    for (uint16_t j = 0; j < 4; j++) {
+/**
+ * Section 5.2.12, once Nc and bc are known.
+ */
+static inline void longTermAnalysis(const int16_t d[], const int16_t dp[], 
+    const SubSegParameters* out, int16_t e[], int16_t dpp[]) {
 
-        int16_t R, S;
-        int32_t L_max, L_result, L_power;
+    // Section 5.2.12 - Long term analysis filtering
+    //
+    // In this part we have to decode the bc parameter to compute the samples
+    // of the estimate of dpp[0..39].
 
-        int16_t wt[50];
-        int16_t x[40];
-        // Long-term residual signal calculated from d - d''
-        int16_t e[40];
+    // Decoding of the coded LTP gain
+    int16_t bp = Encoder::QLB[out->bc];
+    
+    // Calculating the array e[0..39] and the array dpp[0..39]
+    //
+    // e[] is the long-term residual signal and is defined as 
+    // e = d - d''
+    //
+    // The block of 40 long term residual signal samples is obtained by 
+    // subtracting 40 estimates of the short term residual signal 
+    // from the short term residual signal itself.
+    //
+    // RANGE NOTE: bp is one of QLB[] (all positive) so the mult_r() can't
+    // saturate.  The sub() can.
+    for (uint16_t k = 0; k <= 39; k++) {
+        // NOTE: Index adjustment vs. draft doc
+        // TODO: MAKE SURE WE ARE COMPARING THE RIGHT THINGS HERE
+        dpp[k] = mult_r_nosat(bp, dp[IX((k - out->Nc) + 120, 0, 119)]);
+        e[IX(k, 0, 39)] = sub(d[k], dpp[k]);
+    }
+}
 
-        // Compute the starting index
-        uint16_t kj = j * 40;
+/**
+ * Sections 5.2.13 to 5.2.18.
+ */
+static inline void rpeEncodeResidual(const int16_t e[], const int16_t dpp[], int16_t dp[], 
+    SubSegParameters* out, bool floatAnalysis) {
 
-        // Section 5.2.11 Calculation of the LTP parameters
+    // ===== RPE ENCODING SECTION =============================================
+    //
+    // RPE = "Regular Pulse Excitation"
+    // The input is e[], the long-term residual. The block of 40 input long term 
+    // residual samples are represented by one of 4 candidate sub-sequences of 13 
+    // pulses each. The subsequence selected is identified by the RPE grid position (M).
+
+    // Section 5.2.13 - Weighting filter H(z)
+    // Section 5.2.14 - RPE grid selection
+    // Section 5.2.15 - APCM quantization of the selected RPE sequence.
+    //
+    // The weighting filter, the selection of the grid with the most 
+    // energy and the quantization of xM[0..12] are done by a (possibly 
+    // vectorized) kernel.
+    int16_t Mc, xmaxc, xMc[13];
+    if (floatAnalysis) {
+        rpeEncodeFloat(e, &Mc, &xmaxc, xMc);
+    } else {
+        rpeEncode(e, &Mc, &xmaxc, xMc);
+    }
+    out->Mc = Mc;
+    out->xmaxc = xmaxc;
+    for (uint16_t i = 0; i <= 12; i++) {
+        out->xMc[i] = xMc[i];
+    }
 
-        // Search of the optimum scaling of d(j)[0..39]
-        int16_t dmax = 0;
-        for (uint16_t k = 0; k <= 39; k++) {        
-            // NOTE: Sub-segment index
-            temp = s_abs(d[kj + k]);
-            if (temp > dmax) {
-                dmax = temp;
-            }
-        }
+    // Section 5.2.16 - APCM inverse quantization
+    // Section 5.2.17 RPE grid positioning
+    int16_t ep[40];
+    Encoder::inverseAPCM(out, ep);
 
-        temp = 0;
-        if (dmax == 0) {
-            scal = 0;
-        } else {
-            temp = norm((int32_t)dmax << 16);
-        }
-        if (temp > 6) {
-            scal = 0;
-        } else {
-            scal = sub(6, temp);
-        }
+    // Section 5.2.18 - Update of the reconstructed short term residual
+    // signal dp[-120,1].
+    //
+    // NOTE: Rather than shifting the 80 newest entries down, the new 
+    // entries (d' = d'' + e') are written just past the end of the 
+    // window at [120..159] and also at [0..39] (where the oldest 
+    // entries were).  The caller then moves the window forward by 40.  
+    // See the note on _dp[] in Encoder.h.
+    for (uint16_t k = 0; k <= 39; k++) {
+        int16_t dpk = add(ep[IX(k, 0, 39)], dpp[k]);
+        dp[IX(k + 120, 120, 159)] = dpk;
+        dp[IX(k, 0, 39)] = dpk;
+    }
+}
 
-        // Initialization of a working array wt[0..39]
-        for (uint16_t k = 0; k <= 39; k++) {
-            // NOTE: Sub-segment index
-            wt[k] = d[kj + k] >> scal;
-        }
+// ltpEncode() has several callers, but the fused encodeSubSegment() 
+// is about 3% slower when it isn't inlined.
+#if defined(__GNUC__)
+#define GSM_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define GSM_ALWAYS_INLINE inline
+#endif
 
-        // Search for the maximum cross-correlation and coding of the LTP lag
-        L_max = 0;
-        // Index for max cross-corelation
-        output->subSegs[j].Nc = 40;    
-
-        for (uint16_t lambda = 40; lambda <= 120; lambda++) {
-            // Cross correlate with each distinct lag
-            L_result = 0;
-            for (uint16_t k = 0; k <= 39; k++) {
-                // NOTE: Index adjustment vs. draft doc
-                L_temp = L_mult(wt[k], _dp[IX((k - lambda) + 120, 0, 119)]);
-                L_result = L_add(L_temp, L_result);
-            }
-            if (L_result > L_max) {
-                output->subSegs[j].Nc = lambda;
-                L_max = L_result;
-            }
-        }
+/**
+ * Sections 5.2.11 to 5.2.12.
+ */
+static GSM_ALWAYS_INLINE void ltpEncode(const int16_t d[], const int16_t dp[], SubSegParameters* out, 
+    unsigned complexity, int16_t lagHint, int16_t e[], int16_t dpp[]) {
 
-        // Rescaling of L_max
-        L_max = L_max >> (sub(6, scal));
+    int16_t temp, scal;
+    int32_t L_temp;
 
-        // Initialization of a working array wt[0..39]
-        for (uint16_t k = 0; k <= 39; k++) {
-            // NOTE: Index adjustment vs. draft doc
-            wt[k] = _dp[IX((k - output->subSegs[j].Nc) + 120, 0, 119)] >> 3;
-        }
+    int16_t R, S;
+    int32_t L_max, L_power;
 
-        // Compute the power of the reconstructed short term residual signal dp[..]
-        L_power = 0;
-        for (uint16_t k = 0; k <= 39; k++) {
-            L_temp = L_mult(wt[k], wt[k]);
-            L_power = L_add(L_temp, L_power);
-        }
+    int16_t wt[40];
 
-        // TODO: UNDERSTAND THE SCALING OF wt[], L_max, and L_power at this point.
+    // Section 5.2.11 Calculation of the LTP parameters
 
-        // Normalization of L_max and L_power
-        if (L_max <= 0) {
-            output->subSegs[j].bc = 0;
-        } else if (L_max >= L_power) {
-            output->subSegs[j].bc = 3;
-        } else {
-            temp = norm(L_power);
-            R = (L_max << temp) >> 16;
-            S = (L_power << temp) >> 16;
-
-            // Coding of the LTP gain
-            if (R <= mult(S, DLB[0])) {
-                output->subSegs[j].bc = 0;
-            } else if (R <= mult(S, DLB[1])) {
-                output->subSegs[j].bc = 1;
-            } else if (R <= mult(S, DLB[2])) {
-                output->subSegs[j].bc = 2;
-            } else {
-                output->subSegs[j].bc = 3;
-            }
+    // Search of the optimum scaling of d(j)[0..39]
+    int16_t dmax = 0;
+    for (uint16_t k = 0; k <= 39; k++) {        
+        temp = s_abs(d[k]);
+        if (temp > dmax) {
+            dmax = temp;
         }
+    }
 
-        // Section 5.2.12 - Long term analysis filtering
-        //
-        // In this part we have to decode the bc parameter to compute the samples
-        // of the estimate of dpp[0..39].
+    temp = 0;
+    if (dmax == 0) {
+        scal = 0;
+    } else {
+        temp = norm((int32_t)dmax << 16);
+    }
+    if (temp > 6) {
+        scal = 0;
+    } else {
+        scal = sub(6, temp);
+    }
 
-        // Decoding of the coded LTP gain
-        int16_t bp = QLB[output->subSegs[j].bc];
-        
-        // Calculating the array e[0..39] and the array dpp[0..39]
-        //
-        // e[] is the long-term residual signal and is defined as 
-        // e = d - d''
-        //
-        // The block of 40 long term residual signal samples is obtained by 
-        // subtracting 40 estimates of the short term residual signal 
-        // from the short term residual signal itself.
-        int16_t dpp[40];
-        for (uint16_t k = 0; k <= 39; k++) {
-            // NOTE: Index adjustment vs. draft doc
-            // TODO: MAKE SURE WE ARE COMPARING THE RIGHT THINGS HERE
-            dpp[k] = mult_r(bp, _dp[IX((k - output->subSegs[j].Nc) + 120, 0, 119)]);
-            // NOTE: Sub-segment adjustment 
-            e[IX(k, 0, 39)] = sub(d[kj + k], dpp[k]);
-        }
+    // Initialization of a working array wt[0..39]
+    for (uint16_t k = 0; k <= 39; k++) {
+        wt[k] = d[k] >> scal;
+    }
 
-        // ===== RPE ENCODING SECTION =============================================
-        //
-        // RPE = "Regular Pulse Excitation"
-        // The input is e[], the long-term residual. The block of 40 input long term 
-        // residual samples are represented by one of 4 candidate sub-sequences of 13 
-        // pulses each. The subsequence selected is identified by the RPE grid position (M).
-
-        // Section 5.2.13 - Weighting filter H(z)
-
-        // Initialization of a temporary working array wt[0..49].
-        // The data from e[] is centered in this 50-element array,
-        for (uint16_t k = 0; k <= 4; k++) {
-            wt[k] = 0;
-        }    
-        for (uint16_t k = 5; k <= 44; k++) {
-            wt[k] = e[IX(k - 5, 0, 39)];
-        }
-        for (uint16_t k = 45; k <= 49; k++) {
-            wt[k] = 0;
-        }
+    // Search for the maximum cross-correlation and coding of the LTP lag.
+    // The cross-correlation for each of the lags 40..120 is computed
+    // by a (possibly vectorized) kernel. 
+    // NOTE: The scaling above guarantees |wt[k]| <= 512 (see kernels.h)
+    if (complexity == 0) {
+        out->Nc = ltpLagSearch(wt, dp, &L_max);
+    } else {
+        out->Nc = ltpLagSearchReduced(wt, dp, 1 << complexity, &lagHint, 1, &L_max);
+    }
 
-        // Compute the block-filtered signal x[0..39] via conventional convolution.
-        // Because wt[] has been extended to 50 elements this 
-        // 40x11 convolution results in a 40 element result.
-        for (uint16_t k = 0; k <= 39; k++) {
-            // Rounding of the output of the filter
-            L_result = 8192;
-            for (uint16_t i = 0; i <= 10; i++) {
-                L_temp = L_mult(wt[IX(k + i, 0, 49)], H[IX(i, 0, 10)]);
-                L_result = L_add(L_result, L_temp);
-            }
-            // Scaling x4
-            L_result = L_add(L_result, L_result);
-            L_result = L_add(L_result, L_result);
-            // Drop from 32->16 bits, but we still have the 4x
-            x[IX(k, 0, 39)] = L_result >> 16;
-        }
+    // Rescaling of L_max
+    L_max = L_max >> (sub(6, scal));
 
-        // In this next section, we take the filtered signal x[] and down-sample it
-        // by a ratio of 3, resulting in 3 interleaved sequences of length 14, 13,
-        // and 13, which are split up again into 4 sub-sequences of length 13.
+    // Initialization of a working array wt[0..39]
+    for (uint16_t k = 0; k <= 39; k++) {
+        // NOTE: Index adjustment vs. draft doc
+        wt[k] = dp[IX((k - out->Nc) + 120, 0, 119)] >> 3;
+    }
 
-        // Section 5.2.14 - RPE grid selection
+    // Compute the power of the reconstructed short term residual signal dp[..]
+    L_power = 0;
+    for (uint16_t k = 0; k <= 39; k++) {
+        L_temp = L_mult(wt[k], wt[k]);
+        L_power = L_add(L_temp, L_power);
+    }
 
-        int32_t EM = 0;
-        output->subSegs[j].Mc = 0;
+    // TODO: UNDERSTAND THE SCALING OF wt[], L_max, and L_power at this point.
 
-        // Figure out what has the maximum energy:
-        for (uint16_t m = 0; m <= 3; m++) {
-            L_result = 0;
-            for (uint16_t i = 0; i <= 12; i++) {
-                // Here the 4x gets removed
-                temp1 = x[IX(m + (3 * i), 0, 39)] >> 2;
-                // Square
-                L_temp = L_mult(temp1, temp1);
-                L_result = L_add(L_temp, L_result);
-            }
-            // Is this the max?
-            if (L_result > EM) {
-                output->subSegs[j].Mc = m;
-                EM = L_result;
-            }
+    // Normalization of L_max and L_power
+    if (L_max <= 0) {
+        out->bc = 0;
+    } else if (L_max >= L_power) {
+        out->bc = 3;
+    } else {
+        temp = norm(L_power);
+        R = (L_max << temp) >> 16;
+        S = (L_power << temp) >> 16;
+
+        // Coding of the LTP gain
+        if (R <= mult(S, Encoder::DLB[0])) {
+            out->bc = 0;
+        } else if (R <= mult(S, Encoder::DLB[1])) {
+            out->bc = 1;
+        } else if (R <= mult(S, Encoder::DLB[2])) {
+            out->bc = 2;
+        } else {
+            out->bc = 3;
         }
+    }
 
-        // Down-sampling by a factor 3 to get the selected xM[0..12] RPE 
-        // sequence.
-        // 
-        // Basically, we are pulling a 13-point pulse xM[] out of the 
-        // x[] signal which will be used to represent the entire x[] signal.
-        // This is where the "RPE" term comes from.  We represent x[] 
-        // by a repeated use of the pulse in xM[].
-
-        int16_t xM[13];
-        for (uint16_t i = 0; i <= 12; i++) {
-            xM[i] = x[output->subSegs[j].Mc + (3 * i)];
-        }
+    longTermAnalysis(d, dp, out, e, dpp);
+}
 
-        // Section 5.2.15 - APCM quantization of the selected RPE sequence.
-        // APCM = Adaptive pulse-coded modulation.
+/**
+ * Sections 5.2.11 to 5.2.18 for one sub-segment.
+ */
+void EncoderBase::encodeSubSegment(const int16_t d[], int16_t dp[], SubSegParameters* out) {
+    encodeSubSegment(d, dp, out, 0, 0);
+}
 
-        int16_t xmax = 0;
-        for (uint16_t i = 0; i <= 12; i++) {
-            temp = s_abs(xM[i]);
-            if (temp > xmax) {
-                xmax = temp;
-            }
-        }
-        
-        // Quantizing and coding of xmax to get xmaxc
-        int16_t exp, mant;
-        exp = 0;
-        temp = xmax >> 9;
-        int16_t itest = 0;
-        for (uint16_t i = 0; i <= 5; i++) {
-            if (temp <= 0) {
-                itest = 1;
-            }
-            temp = temp >> 1;
-            if (itest == 0) {
-                exp = add(exp, 1);
-            }
-        }
-        temp = add(exp, 5);
-        output->subSegs[j].xmaxc = add((xmax >> temp), (exp << 3));
-        
-        // Quantizing and coding of the xM[0..12] RPE sequence to get xMc[0..12]
+void EncoderBase::encodeSubSegment(const int16_t d[], int16_t dp[], SubSegParameters* out,
+    unsigned complexity, int16_t lagHint) {
+    int16_t e[40], dpp[40];
+    ltpEncode(d, dp, out, complexity, lagHint, e, dpp);
+    rpeEncodeResidual(e, dpp, dp, out, false);
+}
 
-        // Compute exponent and mantissa of the decoded version of xmaxc
-        exp = 0;
-        mant = 0;
+void EncoderBase::ltpEncodeSubSegment(const int16_t d[], const int16_t dp[], 
+    SubSegParameters* out, unsigned complexity, int16_t lagHint, 
+    int16_t e[], int16_t dpp[]) {
+    ltpEncode(d, dp, out, complexity, lagHint, e, dpp);
+}
 
-        if (output->subSegs[j].xmaxc > 15) {
-            exp = sub((output->subSegs[j].xmaxc >> 3), 1);    
-        }
-        mant = sub(output->subSegs[j].xmaxc, (exp << 3));
+void EncoderBase::rpeEncodeSubSegment(const int16_t e[], const int16_t dpp[], int16_t dp[], 
+    SubSegParameters* out, bool floatAnalysis) {
+    rpeEncodeResidual(e, dpp, dp, out, floatAnalysis);
+}
 
-        // Normalize mantissa0 <= mant <= 7
-        if (mant == 0) {
-            exp = -4;
-            mant = 15;
-        } else {
-            itest = 0;
-            for (uint16_t i = 0; i <= 2; i++) {
-                if (mant > 7) {
-                    itest = 1;
-                }
-                if (itest == 0) {
-                    mant = add((mant << 1), 1);
-                }
-                if (itest == 0) {
-                    exp = sub(exp, 1);
-                }
-            }
-        }
-        mant = sub(mant, 8);
-
-        // Direct computation of xMc[0..12] using table 5.5
-        // Normalized by the exponent
-        temp1 = sub(6, exp);
-        // See table 5.5 (inverse mantissa)
-        temp2 = NRFAC[mant];
-        for (uint16_t i = 0; i <= 12; i++) {
-            temp = xM[i] << temp1;
-            temp = mult(temp, temp2);
-            // This equation is used to make all the xMc[i] positive
-            output->subSegs[j].xMc[i] = add((temp >> 12), 4);
-        }
+void EncoderBase::encodeSubSegmentFloat(const int16_t d[], int16_t dp[], SubSegParameters* out) {
+    int16_t e[40], dpp[40];
+    ltpEncodeSubSegmentFloat(d, dp, out, e, dpp);
+    rpeEncodeResidual(e, dpp, dp, out, true);
+}
 
-        // Section 5.2.16 - APCM inverse quantization
-        // Section 5.2.17 RPE grid positioning
-        int16_t ep[40];
-        inverseAPCM(output, j, exp, mant, ep);
-
-        // Section 5.2.18 - Update of the reconstructed short term residual
-        // signal dp[-120,1].
-        for (uint16_t k = 0; k <= 79; k++) {
-            // Shift 80 items
-            // Original document: 
-            // First index: -120 -> -41
-            // Second index: -80 -> -1
-            //
-            // NOTE: Here we have changed the notation from the draft document!
-            // So we are actually shifting the 80 entries from [40...118] down 
-            // to [0...79].
-            _dp[IX((-120 + k) + 120, 0, 119)] = _dp[IX((-80 + k) + 120, 0, 119)];
-        }
-        // We are filling in 80 to 119
-        // d' = d'' + e'
-        for (uint16_t k = 0; k <= 39; k++) {
-            // NOTE: Here we have changed the notation from the draft document!
-            _dp[IX((-40 + k) + 120, 0, 119)] = add(ep[IX(k, 0, 39)], dpp[k]);
-        }
-    }   
+void EncoderBase::ltpEncodeSubSegmentFloat(const int16_t d[], const int16_t dp[], 
+    SubSegParameters* out, int16_t e[], int16_t dpp[]) {
+    // Section 5.2.11 - Calculation of the LTP parameters
+    ltpParametersFloat(d, dp, &(out->Nc), &(out->bc));
+    longTermAnalysis(d, dp, out, e, dpp);
+}
 
-    // Look at the original input frame to determine if it is a homing frame
-    if (_homingSupported) {
-        if (isHomingFrame(sop)) {
-            reset();
-            _lastFrameHome = true;
-        }
-    }
+void EncoderBase::lpcAnalysisFloat(const int16_t s[], uint16_t LARc[]) {
+    kc1fsz::lpcAnalysisFloat(s, LARc);
 }
 
-bool Encoder::isHomingFrame(const int16_t frame[]) {
+void EncoderBase::shortTermAnalysisFloat(const int16_t rp[][9], int16_t sLast[], 
+    const int16_t s[], int16_t d[]) {
+    kc1fsz::shortTermAnalysisFloat(rp, sLast, s, d);
+}
+
+bool EncoderBase::isHomingFrame(const int16_t frame[]) {
     for (uint16_t i = 0; i < 160; i++) {
         if (frame[i] != 1) {
             return false;
@@ -689,36 +710,27 @@ bool Encoder::isHomingFrame(const int16_t frame[]) {
     return true;
 }
 
-void Encoder::inverseAPCM(const Parameters* params, int16_t j, int16_t exp, int16_t mant, int16_t ep[]) {
+void EncoderBase::inverseAPCM(const SubSegParameters* params, int16_t ep[]) {
 
-    // Section 5.2.16 - APCM inverse quantization
-    int16_t xMp[13];
-    int16_t temp;
-    int16_t temp1 = FAC[mant];
-    int16_t temp2 = sub(6, exp);
-    int16_t temp3 = 1 << sub(temp2, 1);
-    for (uint16_t i = 0; i <= 12; i++) {
-        // This subtraction is used to restore the sign of xMc[i]
-        temp = sub((params->subSegs[j].xMc[i] << 1), 7);
-        temp = temp << 12;
-        temp = mult_r(temp1, temp);
-        temp = add(temp, temp3);
-        xMp[i] = temp >> temp2;
-    }
+    // Section 5.2.16 - APCM inverse quantization.  The arithmetic is done
+    // at compile time, see tables.h.
+    const int16_t* xMp = XMC_TABLE.xMp[params->xmaxc & 0x3f];
 
     // Section 5.2.17 RPE grid positioning
-    // ep[] is the reconstructed long term residual.  The array starts
-    // off with all zeroes and then the pulse values are interspersed
-    // based on the Mc index that was determined by the RPE selection (Mc).
     for (uint16_t k = 0; k <= 39; k++) {
         ep[IX(k, 0, 39)] = 0;
     }
     for (uint16_t i = 0; i <= 12; i++) {
-        ep[IX(params->subSegs[j].Mc + (3 * i), 0, 39)] = xMp[i];
+        ep[IX(params->Mc + (3 * i), 0, 39)] = xMp[params->xMc[i] & 0x7];
     }
 }
 
-void Encoder::decodeReflectionCoefficients(const Parameters* params, 
+void EncoderBase::decodeReflectionCoefficients(const Parameters* params, 
+    int16_t* LARpp_last, int16_t rp[][9]) {
+    decodeReflectionCoefficients(params->LARc, LARpp_last, rp);
+}
+
+void EncoderBase::decodeReflectionCoefficients(const uint16_t LARc[], 
     int16_t* LARpp_last, int16_t rp[][9]) {
 
     int16_t LARpp[9];
@@ -728,21 +740,11 @@ void Encoder::decodeReflectionCoefficients(const Parameters* params,
 
     // Section 5.2.8 - Decoding of the coded Log-Area Ratios
 
-    // Compute the LARpp[1..8] by reversing the LARc[] values
+    // Compute the LARpp[1..8] by reversing the LARc[] values. The 
+    // arithmetic is done at compile time, see tables.h.
     for (uint16_t i = 1; i <= 8; i++) {
-        // NOTE: The addition of MIC[i] is used to restore the sign of LARc[i]
-        int16_t temp1 = add(params->LARc[IX(i - 1, 0, 7)], MIC[IX(i, 1, 8)]) << 10;
-        // Remember that B is scaled down twice as much as A, so we need up 
-        // shift left to get on equal terms
-        int16_t temp2 = B[IX(i, 1, 8)] << 1;
-        // Back out B
-        temp1 = sub(temp1, temp2);
-        // Divide by A 
-        temp1 = mult_r(INVA[IX(i, 1, 8)], temp1);
-        // What is this for?
-        LARpp[IX(i, 1, 8)] = add(temp1, temp1);
-        // IMPORTANT: IT APPEARS THAT WE ARE STILL AT HALF-SCALE of the original r[]
-    }    
+        LARpp[IX(i, 1, 8)] = LARC_TABLE.LARpp[i - 1][LARc[IX(i - 1, 0, 7)] & 0x3f];
+    }
 
     for (uint16_t i = 1; i <= 8; i++) {
 
@@ -0,0 +1,183 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#include "fixed_math.h"
+#include "lanes.h"
+#include "gsm-0610-codec/EncoderBank.h"
+
+namespace kc1fsz {
+
+// The lane loops below follow Encoder::encode() exactly, one lane at a time.
+// On SSE4.1 targets the lanes are first handled in groups (4 lanes for the
+// 32-bit offset compensation, 8 lanes for the 16-bit lattice filter) and
+// the scalar loops pick up whatever is left over.
+
+#ifdef __SSE4_1__
+
+/**
+ * Offset compensation and pre-emphasis for lanes [lane, lane + 3]. s[]
+ * holds the scaled input on the way in.
+ */
+static void preprocess_x4(unsigned lanes, unsigned lane, int16_t z1[],
+    int32_t L_z2[], int16_t mp[], int16_t s[]) {
+
+    __m128i z1v = _mm_set_epi32(z1[lane + 3], z1[lane + 2], z1[lane + 1], z1[lane]);
+    __m128i L_z2v = _mm_loadu_si128((const __m128i*)(L_z2 + lane));
+    __m128i mpv = _mm_set_epi32(mp[lane + 3], mp[lane + 2], mp[lane + 1], mp[lane]);
+
+    for (uint16_t k = 0; k <= 159; k++) {
+
+        int16_t* sp = s + (k * lanes + lane);
+        __m128i so = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)sp));
+
+        // Compute the non-recursive part
+        __m128i s1 = sat16_x4(_mm_sub_epi32(so, z1v));
+        z1v = so;
+
+        // Compute the recursive part
+        __m128i L_s2 = _mm_slli_epi32(s1, 15);
+        __m128i msp = trunc16_x4(_mm_srai_epi32(L_z2v, 15));
+        __m128i lsp = trunc16_x4(L_sub_x4(L_z2v, _mm_slli_epi32(msp, 15)));
+        L_s2 = L_add_x4(L_s2, mult_r_x4(lsp, 32735));
+        // NOTE: L_mult(msp, 32735) >> 1 is exact since |msp * 32735| < 2^30
+        L_z2v = L_add_x4(_mm_mullo_epi32(msp, _mm_set1_epi32(32735)), L_s2);
+
+        // Compute sof[k] with rounding
+        __m128i sof = trunc16_x4(_mm_srai_epi32(L_add_x4(L_z2v, _mm_set1_epi32(16384)), 15));
+
+        // Section 5.2.3 - Pre-emphasis
+        __m128i sv = sat16_x4(_mm_add_epi32(sof, mult_r_x4(mpv, -28180)));
+        mpv = sof;
+
+        _mm_storel_epi64((__m128i*)sp, _mm_packs_epi32(sv, sv));
+    }
+
+    _mm_storeu_si128((__m128i*)(L_z2 + lane), L_z2v);
+    for (unsigned i = 0; i < 4; i++) {
+        z1[lane + i] = (int16_t)_mm_extract_epi32(z1v, 0);
+        mp[lane + i] = (int16_t)_mm_extract_epi32(mpv, 0);
+        z1v = _mm_srli_si128(z1v, 4);
+        mpv = _mm_srli_si128(mpv, 4);
+    }
+}
+
+/**
+ * Short term analysis filtering for lanes [lane, lane + 7].
+ */
+static void shortTermAnalysis_x8(unsigned lanes, unsigned lane, const int16_t rp[],
+    int16_t u[], int16_t s[]) {
+
+    __m128i uv[8];
+    for (uint16_t i = 0; i < 8; i++) {
+        uv[i] = _mm_loadu_si128((const __m128i*)(u + (i * lanes + lane)));
+    }
+
+    for (uint16_t k = 0; k <= 159; k++) {
+        int16_t* sp = s + (k * lanes + lane);
+        const int16_t* rpz = rp + (Encoder::k2zone(k) * 9 * lanes + lane);
+        __m128i di = _mm_loadu_si128((const __m128i*)sp);
+        __m128i sav = di;
+        for (uint16_t i = 1; i <= 8; i++) {
+            __m128i rpi = _mm_loadu_si128((const __m128i*)(rpz + i * lanes));
+            __m128i temp = _mm_adds_epi16(uv[i - 1], mult_r_x8(rpi, di));
+            di = _mm_adds_epi16(di, mult_r_x8(rpi, uv[i - 1]));
+            uv[i - 1] = sav;
+            sav = temp;
+        }
+        _mm_storeu_si128((__m128i*)sp, di);
+    }
+
+    for (uint16_t i = 0; i < 8; i++) {
+        _mm_storeu_si128((__m128i*)(u + (i * lanes + lane)), uv[i]);
+    }
+}
+
+#endif
+
+void EncoderBankBase::preprocess(unsigned lanes, const int16_t* const pcm[],
+    int16_t z1[], int32_t L_z2[], int16_t mp[], int16_t s[]) {
+
+    // Section 5.2.1 - Scaling of the input variable.  This is also where
+    // the input gets transposed into lane order.
+    for (unsigned lane = 0; lane < lanes; lane++) {
+        for (uint16_t k = 0; k <= 159; k++) {
+            s[k * lanes + lane] = pcm[lane][k] >> 1;
+        }
+    }
+
+    unsigned lane = 0;
+#ifdef __SSE4_1__
+    for (; lane + 4 <= lanes; lane += 4) {
+        preprocess_x4(lanes, lane, z1, L_z2, mp, s);
+    }
+#endif
+
+    // Section 5.2.2 - Offset compensation
+    // Section 5.2.3 - Pre-emphasis
+    // (See the RANGE NOTE in Encoder::preprocess())
+    for (; lane < lanes; lane++) {
+        for (uint16_t k = 0; k <= 159; k++) {
+            int16_t so = s[k * lanes + lane];
+            int16_t s1 = sub_nosat(so, z1[lane]);
+            z1[lane] = so;
+
+            int32_t L_s2 = s1;
+            L_s2 = L_s2 << 15;
+            int16_t msp = L_z2[lane] >> 15;
+            int16_t lsp = L_sub_nosat(L_z2[lane], (msp << 15));
+            int16_t temp = mult_r_nosat(lsp, 32735);
+            L_s2 = L_add_nosat(L_s2, temp);
+            L_z2[lane] = L_add_nosat(L_mult(msp, 32735) >> 1, L_s2);
+
+            int16_t sof = L_add_nosat(L_z2[lane], 16384) >> 15;
+            s[k * lanes + lane] = add(sof, mult_r_nosat(mp[lane], -28180));
+            mp[lane] = sof;
+        }
+    }
+}
+
+void EncoderBankBase::shortTermAnalysis(unsigned lanes, const int16_t rp[],
+    int16_t u[], int16_t s[]) {
+
+    unsigned lane = 0;
+#ifdef __SSE4_1__
+    for (; lane + 8 <= lanes; lane += 8) {
+        shortTermAnalysis_x8(lanes, lane, rp, u, s);
+    }
+#endif
+
+    // (See the RANGE NOTE in Encoder::shortTermAnalysis())
+    for (; lane < lanes; lane++) {
+        for (uint16_t k = 0; k <= 159; k++) {
+            const int16_t* rpz = rp + (Encoder::k2zone(k) * 9 * lanes + lane);
+            int16_t di = s[k * lanes + lane];
+            int16_t sav = di;
+            for (uint16_t i = 1; i <= 8; i++) {
+                int16_t* ui = u + ((i - 1) * lanes + lane);
+                int16_t temp = add(*ui, mult_r_nosat(rpz[i * lanes], di));
+                di = add(di, mult_r_nosat(rpz[i * lanes], *ui));
+                *ui = sav;
+                sav = temp;
+            }
+            s[k * lanes + lane] = di;
+        }
+    }
+}
+
+}
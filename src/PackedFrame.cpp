@@ -0,0 +1,100 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#include "gsm-0610-codec/PackedFrame.h"
+
+namespace kc1fsz {
+
+// The RFC 3551 layout is fixed: the 0xd signature and the LARc[] take up 
+// 40 bits and each sub-segment takes up 56 bits, so every group starts on 
+// a byte boundary.  Each group is built in a 64-bit word and then written
+// out MSB first, which avoids the bit-at-a-time loops in pack1()/unpack1().
+
+static constexpr uint16_t HEADER_BYTES = 5;
+static constexpr uint16_t SUBSEG_BYTES = 7;
+
+static void storeBE(uint8_t* p, uint64_t w, uint16_t bytes) {
+    for (uint16_t i = 0; i < bytes; i++) {
+        p[i] = (uint8_t)(w >> (8 * (bytes - 1 - i)));
+    }
+}
+
+static uint64_t loadBE(const uint8_t* p, uint16_t bytes) {
+    uint64_t w = 0;
+    for (uint16_t i = 0; i < bytes; i++) {
+        w = (w << 8) | p[i];
+    }
+    return w;
+}
+
+static uint64_t packHeader(const uint16_t LARc[]) {
+    // There is a hard-coded "0x0d" in the first nibble
+    uint64_t w = 0x0d;
+    for (uint16_t i = 0; i < 8; i++) {
+        w = (w << PackedFrame::LARC_BITS[i]) | (LARc[i] & ((1 << PackedFrame::LARC_BITS[i]) - 1));
+    }
+    return w;
+}
+
+static void unpackHeader(uint64_t w, uint16_t LARc[]) {
+    // NOTE: The 0x0d signature is discarded
+    for (uint16_t i = 8; i > 0; i--) {
+        LARc[i - 1] = w & ((1 << PackedFrame::LARC_BITS[i - 1]) - 1);
+        w >>= PackedFrame::LARC_BITS[i - 1];
+    }
+}
+
+static uint64_t packSubSeg(const SubSegParameters& s) {
+    uint64_t w = s.Nc & 0x7f;
+    w = (w << 2) | (s.bc & 0x3);
+    w = (w << 2) | (s.Mc & 0x3);
+    w = (w << 6) | (s.xmaxc & 0x3f);
+    for (uint16_t i = 0; i < 13; i++) {
+        w = (w << 3) | (s.xMc[i] & 0x7);
+    }
+    return w;
+}
+
+static void unpackSubSeg(uint64_t w, SubSegParameters& s) {
+    for (uint16_t i = 0; i < 13; i++) {
+        s.xMc[i] = (w >> (3 * (12 - i))) & 0x7;
+    }
+    s.xmaxc = (w >> 39) & 0x3f;
+    s.Mc = (w >> 45) & 0x3;
+    s.bc = (w >> 47) & 0x3;
+    s.Nc = (w >> 49) & 0x7f;
+}
+
+void PackedFrame::getLARc(uint16_t LARc[]) const {
+    unpackHeader(loadBE(bytes, HEADER_BYTES), LARc);
+}
+
+void PackedFrame::setLARc(const uint16_t LARc[]) {
+    storeBE(bytes, packHeader(LARc), HEADER_BYTES);
+}
+
+void PackedFrame::getSubSeg(uint16_t j, SubSegParameters* out) const {
+    unpackSubSeg(loadBE(bytes + HEADER_BYTES + (j * SUBSEG_BYTES), SUBSEG_BYTES), *out);
+}
+
+void PackedFrame::setSubSeg(uint16_t j, const SubSegParameters& in) {
+    storeBE(bytes + HEADER_BYTES + (j * SUBSEG_BYTES), packSubSeg(in), SUBSEG_BYTES);
+}
+
+}
@@ -18,6 +18,7 @@
  * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
  */
 #include "gsm-0610-codec/Parameters.h"
+#include "gsm-0610-codec/PackedFrame.h"
 
 namespace kc1fsz {
 
@@ -68,6 +69,18 @@ bool SubSegParameters::isEqualTo(const SubSegParameters& other) const {
         xMc[12] == other.xMc[12];
 }
 
+bool SubSegParameters::isInRange() const {
+    if (Nc > 127 || bc > 3 || Mc > 3 || xmaxc > 63) {
+        return false;
+    }
+    for (uint16_t i = 0; i < 13; i++) {
+        if (xMc[i] > 7) {
+            return false;
+        }
+    }
+    return true;
+}
+
 /**
  * Packs the sub-segment parameters into the specified area.
  * Please see https://datatracker.ietf.org/doc/html/rfc3551#section-4.5.8.1
@@ -113,6 +126,24 @@ bool Parameters::isEqualTo(const Parameters& other) const {
         subSegs[3].isEqualTo(other.subSegs[3]);
 }
 
+bool Parameters::isInRange() const {
+    return isInRange(LARc, subSegs);
+}
+
+bool Parameters::isInRange(const uint16_t LARc[], const SubSegParameters subSegs[]) {
+    for (uint16_t i = 0; i < 8; i++) {
+        if (LARc[i] >= (1 << PackedFrame::LARC_BITS[i])) {
+            return false;
+        }
+    }
+    for (uint16_t j = 0; j < 4; j++) {
+        if (!subSegs[j].isInRange()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 /**
  * Please see https://datatracker.ietf.org/doc/html/rfc3551#section-4.5.8.11
  * 
@@ -122,10 +153,32 @@ bool Parameters::isValidFrame(const uint8_t* buf) {
     return (*buf & 0xf0) == 0xd0;
 }
 
+static void packWords(const Parameters& p, uint8_t* area) {
+    PackedFrame* frame = PackedFrame::at(area);
+    frame->setLARc(p.LARc);
+    for (uint16_t j = 0; j < 4; j++) {
+        frame->setSubSeg(j, p.subSegs[j]);
+    }
+}
+
+static void unpackWords(const uint8_t* area, Parameters& p) {
+    const PackedFrame* frame = PackedFrame::at(area);
+    frame->getLARc(p.LARc);
+    for (uint16_t j = 0; j < 4; j++) {
+        frame->getSubSeg(j, &(p.subSegs[j]));
+    }
+}
+
 /**
  * Please see https://datatracker.ietf.org/doc/html/rfc3551#section-4.5.8.1
  */
 void Parameters::pack(uint8_t* packArea, PackingState* state) const {        
+    // Fast path when the frame starts on a byte boundary
+    if (state->bitPtr == 0) {
+        packWords(*this, packArea + state->bytePtr);
+        state->bytePtr += PackedFrame::BYTES;
+        return;
+    }
     // There is a hard-coded "0x0d" in the first nibble
     Parameters::pack1(packArea, state, 0x0d, 4);
     pack1(packArea, state, LARc[0], 6);
@@ -143,14 +196,25 @@ void Parameters::pack(uint8_t* packArea, PackingState* state) const {
 }
 
 void Parameters::pack(uint8_t* packArea) const {        
-    PackingState state;
-    pack(packArea, &state);
+    packWords(*this, packArea);
+}
+
+void Parameters::packBatch(const Parameters* frames, unsigned count, uint8_t* packArea) {
+    for (unsigned i = 0; i < count; i++) {
+        packWords(frames[i], packArea + (i * PackedFrame::BYTES));
+    }
 }
 
 /**
  * Please see https://datatracker.ietf.org/doc/html/rfc3551#section-4.5.8.11
  */
 void Parameters::unpack(const uint8_t* packArea, PackingState* state) {        
+    // Fast path when the frame starts on a byte boundary
+    if (state->bitPtr == 0) {
+        unpackWords(packArea + state->bytePtr, *this);
+        state->bytePtr += PackedFrame::BYTES;
+        return;
+    }
     // Discard the 0x0d signature
     Parameters::unpack1(packArea, state, 4);
     LARc[0] = unpack1(packArea, state, 6);
@@ -168,8 +232,13 @@ void Parameters::unpack(const uint8_t* packArea, PackingState* state) {
 }
 
 void Parameters::unpack(const uint8_t* packArea) {        
-    PackingState state;
-    unpack(packArea, &state);
+    unpackWords(packArea, *this);
+}
+
+void Parameters::unpackBatch(const uint8_t* packArea, unsigned count, Parameters* frames) {
+    for (unsigned i = 0; i < count; i++) {
+        unpackWords(packArea + (i * PackedFrame::BYTES), frames[i]);
+    }
 }
 
 /**
@@ -23,6 +23,10 @@
 
 namespace kc1fsz {
 
+// These are the reference implementations, please see fixed_math.h for the
+// inline versions that are used by the codec.
+namespace ref {
+
 /**
  * Performs the addition (var1+var2) with overflow control and saturation; the result is set at +32767
  * when overflow occurs or at -32768 when underflow occurs.
@@ -170,14 +174,13 @@ int32_t L_add(int32_t L_var1, int32_t L_var2) {
     int L_res;
 
     bool of = __builtin_sadd_overflow(L_var1, L_var2, &L_res);
-    // On overflow we can saturate the result
+    // On overflow we can saturate the result.  NOTE: The wrapped result 
+    // is zero for -2147483648 + -2147483648, which is a negative overflow.
     if (of) {
         if (L_res < 0) {
             return 2147483647;
-        } else if (L_res > 0) {
-            return -2147483648;
         } else {
-            return 0;
+            return -2147483648;
         }
     } else {
         return L_res;
@@ -247,3 +250,5 @@ int16_t norm(int32_t L_var1) {
 }
 
 }
+
+}
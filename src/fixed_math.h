@@ -1,6 +1,6 @@
 /**
  * GSM 06.10 CODEC
- * Copyright (C) 2024, Bruce MacKinnon 
+ * Copyright (C) 2024, Bruce MacKinnon
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -21,9 +21,373 @@
 #define _common_h
 
 #include <cstdint>
+#include <cassert>
+
+// The fixed-point operations are implemented inline in this header so that
+// the hot loops of the codec compile down to a few instructions per operation.
+// The backend is selected at build time by defining GSM_FIXED_MATH_BACKEND to
+// one of the values below, otherwise it is chosen from the target.
+#define GSM_FM_PORTABLE 0
+#define GSM_FM_X86 1
+#define GSM_FM_ARMV6M 2
+#define GSM_FM_ARMV7EM 3
+
+#ifndef GSM_FIXED_MATH_BACKEND
+#if defined(__ARM_FEATURE_DSP) && defined(__ARM_FEATURE_SAT)
+#define GSM_FIXED_MATH_BACKEND GSM_FM_ARMV7EM
+#elif defined(__ARM_ARCH_6M__)
+#define GSM_FIXED_MATH_BACKEND GSM_FM_ARMV6M
+#elif defined(__x86_64__) || defined(__i386__)
+#define GSM_FIXED_MATH_BACKEND GSM_FM_X86
+#else
+#define GSM_FIXED_MATH_BACKEND GSM_FM_PORTABLE
+#endif
+#endif
+
+#if GSM_FIXED_MATH_BACKEND == GSM_FM_ARMV7EM
+#include <arm_acle.h>
+#endif
+
+#ifdef GSM_RANGE_PROFILE
+#include "range_profile.h"
+#endif
 
 namespace kc1fsz {
 
+/**
+ * Standard C++ versions of all of the operations.  These are always
+ * available (and constexpr) so they can also be used to build tables
+ * at compile time.
+ */
+namespace portable {
+
+constexpr int16_t sat16(int32_t x) {
+    return x > 32767 ? 32767 : (x < -32768 ? -32768 : (int16_t)x);
+}
+
+constexpr int16_t add(int16_t var1, int16_t var2) {
+    return sat16((int32_t)var1 + (int32_t)var2);
+}
+
+constexpr int16_t sub(int16_t var1, int16_t var2) {
+    return sat16((int32_t)var1 - (int32_t)var2);
+}
+
+constexpr int16_t mult(int16_t var1, int16_t var2) {
+    // Special case of -1 x -1
+    if (var1 == -32768 && var2 == -32768) {
+        return 32767;
+    }
+    return (int16_t)(((int32_t)var1 * (int32_t)var2) >> 15);
+}
+
+constexpr int16_t mult_r(int16_t var1, int16_t var2) {
+    // Special case of -1 x -1
+    if (var1 == -32768 && var2 == -32768) {
+        return 32767;
+    }
+    // Add the 0.5 to force a round of the final LSB
+    return (int16_t)((((int32_t)var1 * (int32_t)var2) + 16384) >> 15);
+}
+
+constexpr int16_t s_abs(int16_t var1) {
+    return var1 == -32768 ? 32767 : (var1 < 0 ? -var1 : var1);
+}
+
+/**
+ * The 15-step restoring division in the draft is the same thing as
+ * a single integer division of (num << 15) by denum.
+ */
+constexpr int16_t div(int16_t num, int16_t denum) {
+    assert(num >= 0);
+    assert(denum >= num);
+    // Special case
+    if (num == denum) {
+        return 32767;
+    }
+    return (int16_t)(((int32_t)num << 15) / (int32_t)denum);
+}
+
+constexpr int32_t L_mult(int16_t var1, int16_t var2) {
+    // NOTE: The shift is done unsigned so that the -32768 x -32768 case
+    // wraps (it doesn't occur in the GSM algorithm)
+    return (int32_t)((uint32_t)((int32_t)var1 * (int32_t)var2) << 1);
+}
+
+constexpr int32_t L_add(int32_t L_var1, int32_t L_var2) {
+    int64_t L_res = (int64_t)L_var1 + (int64_t)L_var2;
+    return L_res > 2147483647 ? 2147483647 :
+        (L_res < -2147483647 - 1 ? -2147483647 - 1 : (int32_t)L_res);
+}
+
+constexpr int32_t L_sub(int32_t L_var1, int32_t L_var2) {
+    int64_t L_res = (int64_t)L_var1 - (int64_t)L_var2;
+    return L_res > 2147483647 ? 2147483647 :
+        (L_res < -2147483647 - 1 ? -2147483647 - 1 : (int32_t)L_res);
+}
+
+/**
+ * Number of leading zeros of a non-zero value, by binary search.
+ */
+constexpr int16_t clz32(uint32_t x) {
+    int16_t n = 0;
+    if ((x & 0xffff0000) == 0) { n += 16; x <<= 16; }
+    if ((x & 0xff000000) == 0) { n += 8; x <<= 8; }
+    if ((x & 0xf0000000) == 0) { n += 4; x <<= 4; }
+    if ((x & 0xc0000000) == 0) { n += 2; x <<= 2; }
+    if ((x & 0x80000000) == 0) { n += 1; }
+    return n;
+}
+
+/**
+ * The left shifts needed to bring bit 30 to one (positive) or zero
+ * (negative) are the leading zeros/ones less the sign bit.
+ */
+constexpr int16_t norm(int32_t L_var1) {
+    if (L_var1 == 0 || L_var1 == -2147483647 - 1 || L_var1 == -1073741824) {
+        return 0;
+    } else if (L_var1 > 0) {
+        return clz32((uint32_t)L_var1) - 1;
+    } else if (L_var1 == -1) {
+        return 31;
+    } else {
+        return clz32(~(uint32_t)L_var1) - 1;
+    }
+}
+
+}
+
+#ifdef GSM_RANGE_PROFILE
+
+// The range profiling build (see range_profile.h and the gsm-range target). 
+// Each operation records the exact (unsaturated) result at its call site, 
+// which the default arguments pick up, and then does the portable version.
+
+inline int16_t add(int16_t var1, int16_t var2,
+    const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+    range::record("add", file, line, (int64_t)var1 + var2);
+    return portable::add(var1, var2);
+}
+
+inline int16_t sub(int16_t var1, int16_t var2,
+    const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+    range::record("sub", file, line, (int64_t)var1 - var2);
+    return portable::sub(var1, var2);
+}
+
+inline int16_t mult(int16_t var1, int16_t var2,
+    const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+    range::record("mult", file, line, ((int64_t)var1 * var2) >> 15);
+    return portable::mult(var1, var2);
+}
+
+inline int16_t mult_r(int16_t var1, int16_t var2,
+    const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+    range::record("mult_r", file, line, ((int64_t)var1 * var2 + 16384) >> 15);
+    return portable::mult_r(var1, var2);
+}
+
+inline int16_t s_abs(int16_t var1,
+    const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+    range::record("s_abs", file, line, var1 < 0 ? -(int64_t)var1 : var1);
+    return portable::s_abs(var1);
+}
+
+inline int32_t L_mult(int16_t var1, int16_t var2,
+    const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+    range::record32("L_mult", file, line, (int64_t)var1 * var2 * 2);
+    return portable::L_mult(var1, var2);
+}
+
+inline int32_t L_add(int32_t L_var1, int32_t L_var2,
+    const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+    range::record32("L_add", file, line, (int64_t)L_var1 + L_var2);
+    return portable::L_add(L_var1, L_var2);
+}
+
+inline int32_t L_sub(int32_t L_var1, int32_t L_var2,
+    const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+    range::record32("L_sub", file, line, (int64_t)L_var1 - L_var2);
+    return portable::L_sub(L_var1, L_var2);
+}
+
+using portable::div;
+using portable::norm;
+
+#elif GSM_FIXED_MATH_BACKEND == GSM_FM_X86 || GSM_FIXED_MATH_BACKEND == GSM_FM_ARMV6M
+
+// The 16-bit operations are the branch-free portable versions (cmov on
+// x86, the M0+ has no saturating instructions).  The compiler builtins
+// are used for the 32-bit overflow checks and for counting leading
+// zeros (on the RP2040 the SDK routes __builtin_clz to the fast
+// bootrom implementation).
+
+using portable::add;
+using portable::sub;
+using portable::mult;
+using portable::mult_r;
+using portable::s_abs;
+using portable::div;
+using portable::L_mult;
+
+constexpr int32_t L_add(int32_t L_var1, int32_t L_var2) {
+    int32_t L_res = 0;
+    if (__builtin_add_overflow(L_var1, L_var2, &L_res)) {
+        // Overflow is only possible when both have the same sign
+        return L_var1 < 0 ? -2147483647 - 1 : 2147483647;
+    }
+    return L_res;
+}
+
+constexpr int32_t L_sub(int32_t L_var1, int32_t L_var2) {
+    int32_t L_res = 0;
+    if (__builtin_sub_overflow(L_var1, L_var2, &L_res)) {
+        // Overflow is only possible when the signs are different
+        return L_var1 < 0 ? -2147483647 - 1 : 2147483647;
+    }
+    return L_res;
+}
+
+constexpr int16_t norm(int32_t L_var1) {
+    if (L_var1 == 0 || L_var1 == -2147483647 - 1 || L_var1 == -1073741824) {
+        return 0;
+    } else if (L_var1 > 0) {
+        return __builtin_clz((uint32_t)L_var1) - 1;
+    } else if (L_var1 == -1) {
+        return 31;
+    } else {
+        return __builtin_clz(~(uint32_t)L_var1) - 1;
+    }
+}
+
+#elif GSM_FIXED_MATH_BACKEND == GSM_FM_ARMV7EM
+
+// Cortex-M4/M7 with the DSP extension: SSAT, QADD, QSUB and CLZ.
+
+inline int16_t add(int16_t var1, int16_t var2) {
+    return (int16_t)__ssat((int32_t)var1 + (int32_t)var2, 16);
+}
+
+inline int16_t sub(int16_t var1, int16_t var2) {
+    return (int16_t)__ssat((int32_t)var1 - (int32_t)var2, 16);
+}
+
+using portable::mult;
+using portable::mult_r;
+using portable::s_abs;
+using portable::div;
+using portable::L_mult;
+
+inline int32_t L_add(int32_t L_var1, int32_t L_var2) {
+    return __qadd(L_var1, L_var2);
+}
+
+inline int32_t L_sub(int32_t L_var1, int32_t L_var2) {
+    return __qsub(L_var1, L_var2);
+}
+
+inline int16_t norm(int32_t L_var1) {
+    if (L_var1 == 0 || L_var1 == -2147483647 - 1 || L_var1 == -1073741824) {
+        return 0;
+    } else if (L_var1 > 0) {
+        return __clz((uint32_t)L_var1) - 1;
+    } else if (L_var1 == -1) {
+        return 31;
+    } else {
+        return __clz(~(uint32_t)L_var1) - 1;
+    }
+}
+
+#else
+
+using portable::add;
+using portable::sub;
+using portable::mult;
+using portable::mult_r;
+using portable::s_abs;
+using portable::div;
+using portable::L_mult;
+using portable::L_add;
+using portable::L_sub;
+using portable::norm;
+
+#endif
+
+/**
+ * Unsaturated versions of the operations, for the call sites where a range
+ * argument (the RANGE NOTE at each one) shows that the saturation can never
+ * trigger.  These are plain integer arithmetic, so they are only bit-exact
+ * with the versions above when the argument holds.  In the range profiling
+ * build they are checked: gsm-range reports any call whose exact result 
+ * doesn't fit.
+ */
+#ifdef GSM_RANGE_PROFILE
+
+inline int16_t add_nosat(int16_t var1, int16_t var2,
+    const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+    range::record("add_nosat", file, line, (int64_t)var1 + var2, true);
+    return (int16_t)(var1 + var2);
+}
+
+inline int16_t sub_nosat(int16_t var1, int16_t var2,
+    const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+    range::record("sub_nosat", file, line, (int64_t)var1 - var2, true);
+    return (int16_t)(var1 - var2);
+}
+
+inline int16_t mult_r_nosat(int16_t var1, int16_t var2,
+    const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+    range::record("mult_r_nosat", file, line, ((int64_t)var1 * var2 + 16384) >> 15, true);
+    return (int16_t)(((int32_t)var1 * var2 + 16384) >> 15);
+}
+
+inline int32_t L_add_nosat(int32_t L_var1, int32_t L_var2,
+    const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+    range::record32("L_add_nosat", file, line, (int64_t)L_var1 + L_var2, true);
+    return (int32_t)((uint32_t)L_var1 + (uint32_t)L_var2);
+}
+
+inline int32_t L_sub_nosat(int32_t L_var1, int32_t L_var2,
+    const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+    range::record32("L_sub_nosat", file, line, (int64_t)L_var1 - L_var2, true);
+    return (int32_t)((uint32_t)L_var1 - (uint32_t)L_var2);
+}
+
+#else
+
+constexpr int16_t add_nosat(int16_t var1, int16_t var2) {
+    return (int16_t)(var1 + var2);
+}
+
+constexpr int16_t sub_nosat(int16_t var1, int16_t var2) {
+    return (int16_t)(var1 - var2);
+}
+
+/**
+ * Neither input may be -32768 (the special case of mult_r()).
+ */
+constexpr int16_t mult_r_nosat(int16_t var1, int16_t var2) {
+    return (int16_t)(((int32_t)var1 * var2 + 16384) >> 15);
+}
+
+constexpr int32_t L_add_nosat(int32_t L_var1, int32_t L_var2) {
+    return L_var1 + L_var2;
+}
+
+constexpr int32_t L_sub_nosat(int32_t L_var1, int32_t L_var2) {
+    return L_var1 - L_var2;
+}
+
+#endif
+
+/**
+ * The original out-of-line implementations that follow the draft
+ * literally (bit-by-bit norm(), 15-step div(), etc.).  These are not
+ * used by the codec, they are kept as the reference that the inline
+ * backends are tested against.
+ */
+namespace ref {
+
 /**
  * Performs the addition (var1+var2) with overflow control and saturation; the result is set at +32767
  * when overflow occurs or at -32768 when underflow occurs.
@@ -48,10 +412,10 @@ int16_t mult(int16_t var1, int16_t var2);
  */
 int16_t mult_r(int16_t var1, int16_t var2);
 
-/** 
+/**
  * Absolute value of var1; abs(-32768) = 32767
- */ 
-int16_t s_abs(int16_t var1); 
+ */
+int16_t s_abs(int16_t var1);
 
 /**
  * div produces a result which is the fractional integer division of var1 by var2; var1 and var2 shall
@@ -60,11 +424,11 @@ int16_t s_abs(int16_t var1);
  */
 int16_t div(int16_t var1, int16_t var2);
 
-/** 
+/**
  * L_mult is a 32 bit result for the multiplication of var1 times var2 with a one bit shift left.
  * L_mult( var1, var2 ) = ( var1 times var2 ) << 1. The condition L_mult (-32768, -32768 ) does not
  * occur in the [GSM] algorithm.
- * 
+ *
  * NOTE: This function incorporates multiplication and switching from q15 to q31 in a single
  * operation.
  */
@@ -95,5 +459,6 @@ int16_t norm(int32_t L_var1);
 
 }
 
-#endif
+}
 
+#endif
@@ -0,0 +1,411 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+#include "kernels.h"
+#include "float_analysis.h"
+#include "gsm-0610-codec/Encoder.h"
+
+namespace kc1fsz {
+
+/**
+ * Rounds to the nearest int16_t with saturation, like the fixed-point
+ * arithmetic would.
+ */
+static inline int16_t toInt16(float x) {
+    x = x > 32767.0f ? 32767.0f : (x < -32768.0f ? -32768.0f : x);
+    return (int16_t)(x < 0 ? x - 0.5f : x + 0.5f);
+}
+
+// ===== Vector helpers =======================================================
+// The buffers below are all sized in multiples of 8 so that they work for
+// every width.
+
+#if defined(__AVX2__)
+
+typedef __m256 vf;
+static constexpr uint16_t W = 8;
+
+static inline vf vzero() { return _mm256_setzero_ps(); }
+static inline vf vset1(float a) { return _mm256_set1_ps(a); }
+static inline vf vload(const float* p) { return _mm256_loadu_ps(p); }
+static inline void vstore(float* p, vf a) { _mm256_storeu_ps(p, a); }
+static inline vf vadd(vf a, vf b) { return _mm256_add_ps(a, b); }
+static inline vf vmaximum(vf a, vf b) { return _mm256_max_ps(a, b); }
+
+// a * b + c
+static inline vf vmadd(vf a, vf b, vf c) {
+#ifdef __FMA__
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+static inline float vsum(vf a) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+// Rounds to int16_t with saturation
+static inline void vstore16(int16_t* p, vf a) {
+    a = _mm256_min_ps(_mm256_max_ps(a, _mm256_set1_ps(-32768.0f)), _mm256_set1_ps(32767.0f));
+    __m256i i = _mm256_cvtps_epi32(a);
+    _mm_storeu_si128((__m128i*)p, _mm_packs_epi32(_mm256_castsi256_si128(i), 
+        _mm256_extracti128_si256(i, 1)));
+}
+
+static inline float hmax(vf a) {
+    __m128 s = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    s = _mm_max_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_max_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+#elif defined(__SSE4_1__)
+
+typedef __m128 vf;
+static constexpr uint16_t W = 4;
+
+static inline vf vzero() { return _mm_setzero_ps(); }
+static inline vf vset1(float a) { return _mm_set1_ps(a); }
+static inline vf vload(const float* p) { return _mm_loadu_ps(p); }
+static inline void vstore(float* p, vf a) { _mm_storeu_ps(p, a); }
+static inline vf vadd(vf a, vf b) { return _mm_add_ps(a, b); }
+static inline vf vmaximum(vf a, vf b) { return _mm_max_ps(a, b); }
+static inline vf vmadd(vf a, vf b, vf c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+static inline float vsum(vf a) {
+    __m128 s = _mm_add_ps(a, _mm_movehl_ps(a, a));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+static inline void vstore16(int16_t* p, vf a) {
+    a = _mm_min_ps(_mm_max_ps(a, _mm_set1_ps(-32768.0f)), _mm_set1_ps(32767.0f));
+    __m128i i = _mm_cvtps_epi32(a);
+    _mm_storel_epi64((__m128i*)p, _mm_packs_epi32(i, i));
+}
+
+static inline float hmax(vf a) {
+    __m128 s = _mm_max_ps(a, _mm_movehl_ps(a, a));
+    s = _mm_max_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+#else
+
+typedef float vf;
+static constexpr uint16_t W = 1;
+
+static inline vf vzero() { return 0; }
+static inline vf vset1(float a) { return a; }
+static inline vf vload(const float* p) { return *p; }
+static inline void vstore(float* p, vf a) { *p = a; }
+static inline vf vadd(vf a, vf b) { return a + b; }
+static inline vf vmaximum(vf a, vf b) { return a > b ? a : b; }
+static inline vf vmadd(vf a, vf b, vf c) { return a * b + c; }
+static inline float vsum(vf a) { return a; }
+static inline float hmax(vf a) { return a; }
+static inline void vstore16(int16_t* p, vf a) { *p = toInt16(a); }
+
+#endif
+
+
+// ===== Sections 5.2.4 to 5.2.7 ==============================================
+
+void lpcAnalysisFloat(const int16_t s[], uint16_t LARc[]) {
+
+    // Section 5.2.4 - Autocorrelation. The signal is preceded by 8 zeros
+    // so that every lag uses the same loop.
+    float x[8 + 160];
+    for (uint16_t k = 0; k < 8; k++) {
+        x[k] = 0;
+    }
+    for (uint16_t k = 0; k <= 159; k++) {
+        x[8 + k] = s[k];
+    }
+    float ACF[9];
+    for (uint16_t i = 0; i <= 8; i++) {
+        // Two sums to shorten the dependency chain
+        vf acc0 = vzero(), acc1 = vzero();
+        for (uint16_t k = 0; k <= 159; k += 2 * W) {
+            acc0 = vmadd(vload(x + 8 + k), vload(x + 8 + k - i), acc0);
+            acc1 = vmadd(vload(x + 8 + k + W), vload(x + 8 + k + W - i), acc1);
+        }
+        ACF[i] = vsum(vadd(acc0, acc1));
+    }
+
+    // Section 5.2.5 - Computation of the reflection coefficients using the
+    // same Schur recursion as the draft.
+    float r[9] = { 0 };
+    if (ACF[0] > 0) {
+        float P[9], K[9];
+        for (uint16_t i = 1; i <= 7; i++) {
+            K[9 - i] = ACF[i];
+        }
+        for (uint16_t i = 0; i <= 8; i++) {
+            P[i] = ACF[i];
+        }
+        for (uint16_t n = 1; n <= 8; n++) {
+            // The rest of r[] stays at zero
+            if (P[0] < std::fabs(P[1])) {
+                break;
+            }
+            r[n] = -P[1] / P[0];
+            if (n == 8) {
+                break;
+            }
+            P[0] = P[0] + P[1] * r[n];
+            for (uint16_t m = 1; m <= 8 - n; m++) {
+                P[m] = P[m + 1] + K[9 - m] * r[n];
+                K[9 - m] = K[9 - m] + P[m + 1] * r[n];
+            }
+        }
+    }
+
+    for (uint16_t i = 1; i <= 8; i++) {
+
+        // Section 5.2.6 - The piecewise linear approximation of the
+        // Log-Area Ratio (at full scale here).
+        float temp = std::fabs(r[i]);
+        if (temp >= 0.950f) {
+            temp = 8.0f * temp - 6.375f;
+        } else if (temp >= 0.675f) {
+            temp = 2.0f * temp - 0.675f;
+        }
+        if (r[i] < 0) {
+            temp = -temp;
+        }
+
+        // Section 5.2.7 - LARc[i] = nint(A[i] * LAR[i] + B[i]).  The
+        // tables are scaled, see Encoder.h.
+        temp = temp * ((float)Encoder::A[i] / 1024.0f) + (float)Encoder::B[i] / 512.0f;
+        int16_t c = (int16_t)std::floor(temp + 0.5f);
+        if (c > Encoder::MAC[i]) {
+            c = Encoder::MAC[i];
+        }
+        if (c < Encoder::MIC[i]) {
+            c = Encoder::MIC[i];
+        }
+        LARc[i - 1] = c - Encoder::MIC[i];
+    }
+}
+
+// ===== Section 5.2.10 =======================================================
+
+void shortTermAnalysisFloat(const int16_t rp[][9], int16_t sLast[], const int16_t s[],
+    int16_t d[]) {
+
+    // The end of the previous frame, the signal and then room for the
+    // last vector.
+    float x[8 + 160 + 8];
+    for (uint16_t k = 0; k < 8; k++) {
+        x[k] = sLast[k];
+        x[168 + k] = 0;
+    }
+    for (uint16_t k = 0; k <= 159; k++) {
+        x[8 + k] = s[k];
+    }
+
+    // Step-up recursion from the reflection coefficients to the direct
+    // form d[k] = s[k] + a[1] * s[k - 1] + ... + a[8] * s[k - 8], for all
+    // of the zones at once.  a[j] and a[i - j] are updated as a pair.
+    float a[9][4];
+    for (uint16_t i = 1; i <= 8; i++) {
+        float ri[4];
+        for (uint16_t zone = 0; zone < 4; zone++) {
+            ri[zone] = (float)rp[zone][i] / 32768.0f;
+        }
+        for (uint16_t j = 1; 2 * j <= i; j++) {
+            for (uint16_t zone = 0; zone < 4; zone++) {
+                float lo = a[j][zone], hi = a[i - j][zone];
+                a[j][zone] = lo + ri[zone] * hi;
+                a[i - j][zone] = hi + ri[zone] * lo;
+            }
+        }
+        for (uint16_t zone = 0; zone < 4; zone++) {
+            a[i][zone] = ri[zone];
+        }
+    }
+
+    // The zones (see Encoder::k2zone()) are done in order and each one is
+    // rounded up to whole vectors.  The extra outputs are overwritten by
+    // the next zone (the last one ends on a whole vector).
+    static constexpr uint16_t ZONE_START[5] = { 0, 13, 27, 40, 160 };
+    for (uint16_t zone = 0; zone < 4; zone++) {
+        vf av[9];
+        for (uint16_t i = 1; i <= 8; i++) {
+            av[i] = vset1(a[i][zone]);
+        }
+
+        for (uint16_t k = ZONE_START[zone]; k < ZONE_START[zone + 1]; k += W) {
+            vf acc = vload(x + 8 + k);
+            for (uint16_t i = 1; i <= 8; i++) {
+                acc = vmadd(av[i], vload(x + 8 + k - i), acc);
+            }
+            vstore16(d + k, acc);
+        }
+    }
+
+    // NOTE: s[] may have been overwritten by d[]
+    for (uint16_t k = 0; k < 8; k++) {
+        sLast[k] = (int16_t)x[160 + k];
+    }
+}
+
+// ===== Section 5.2.11 =======================================================
+
+void ltpParametersFloat(const int16_t d[], const int16_t dp[], uint16_t* Nc, uint16_t* bc) {
+
+    // The history padded out for the last block of lags
+    float h[40 + 96];
+    for (uint16_t k = 0; k <= 119; k++) {
+        h[k] = dp[k];
+    }
+    for (uint16_t k = 120; k < 136; k++) {
+        h[k] = 0;
+    }
+    float w[40];
+    for (uint16_t k = 0; k <= 39; k++) {
+        w[k] = d[k];
+    }
+
+    // The cross-correlation for lag 120 - j goes to R[j] (j > 80 is 
+    // ignored).  Four vectors of lags are done at a time, with separate 
+    // accumulators for the even and odd samples so that there are enough
+    // independent sums to keep the multipliers busy.
+    float R[96];
+    for (uint16_t j = 0; j < 88; j += 4 * W) {
+        const float* hj = h + j;
+        vf a0 = vzero(), a1 = vzero(), a2 = vzero(), a3 = vzero();
+        vf b0 = vzero(), b1 = vzero(), b2 = vzero(), b3 = vzero();
+        for (uint16_t k = 0; k <= 39; k += 2) {
+            vf wk = vset1(w[k]);
+            a0 = vmadd(wk, vload(hj + k), a0);
+            a1 = vmadd(wk, vload(hj + k + W), a1);
+            a2 = vmadd(wk, vload(hj + k + 2 * W), a2);
+            a3 = vmadd(wk, vload(hj + k + 3 * W), a3);
+            wk = vset1(w[k + 1]);
+            b0 = vmadd(wk, vload(hj + k + 1), b0);
+            b1 = vmadd(wk, vload(hj + k + 1 + W), b1);
+            b2 = vmadd(wk, vload(hj + k + 1 + 2 * W), b2);
+            b3 = vmadd(wk, vload(hj + k + 1 + 3 * W), b3);
+        }
+        vstore(R + j, vadd(a0, b0));
+        vstore(R + j + W, vadd(a1, b1));
+        vstore(R + j + 2 * W, vadd(a2, b2));
+        vstore(R + j + 3 * W, vadd(a3, b3));
+    }
+
+    // The first lag with the largest positive cross-correlation.  The 
+    // maximum is found first since a running comparison is one long
+    // dependency chain.
+    vf vmax = vzero();
+    for (uint16_t j = 0; j < 80; j += W) {
+        vmax = vmaximum(vmax, vload(R + j));
+    }
+    float Rmax = hmax(vmax);
+    Rmax = R[80] > Rmax ? R[80] : Rmax;
+    int16_t lag = 40;
+    if (Rmax > 0) {
+        while (R[120 - lag] != Rmax) {
+            lag++;
+        }
+    }
+    *Nc = lag;
+
+    // Coding of the LTP gain Rmax / S, where S is the power of the
+    // reconstructed short term residual at that lag.
+    const float* hl = h + 120 - lag;
+    vf acc = vzero();
+    for (uint16_t k = 0; k <= 39; k += W) {
+        vf temp = vload(hl + k);
+        acc = vmadd(temp, temp, acc);
+    }
+    float S = vsum(acc);
+    if (Rmax <= 0) {
+        *bc = 0;
+        return;
+    }
+    *bc = 3;
+    for (uint16_t i = 0; i <= 2; i++) {
+        if (Rmax <= S * ((float)Encoder::DLB[i] / 32768.0f)) {
+            *bc = i;
+            break;
+        }
+    }
+}
+
+// ===== Sections 5.2.13 to 5.2.15 ============================================
+
+void rpeEncodeFloat(const int16_t e[], int16_t* Mc, int16_t* xmaxc, int16_t xMc[]) {
+
+    // Section 5.2.13 - Weighting filter H(z). The data from e[] is centered
+    // in wt[].
+    float wt[5 + 40 + 5];
+    for (uint16_t k = 0; k <= 4; k++) {
+        wt[k] = 0;
+        wt[45 + k] = 0;
+    }
+    for (uint16_t k = 0; k <= 39; k++) {
+        wt[5 + k] = e[k];
+    }
+    float x[40];
+    for (uint16_t k = 0; k <= 39; k += W) {
+        vf acc = vzero();
+        for (uint16_t i = 0; i <= 10; i++) {
+            // H[5] is 1.0
+            if (Encoder::H[i] != 0) {
+                acc = vmadd(vset1((float)Encoder::H[i] / 8192.0f), vload(wt + k + i), acc);
+            }
+        }
+        vstore(x + k, acc);
+    }
+
+    // Section 5.2.14 - RPE grid selection
+    float EM = 0;
+    *Mc = 0;
+    for (uint16_t m = 0; m <= 3; m++) {
+        float sum = 0;
+        for (uint16_t i = 0; i <= 12; i++) {
+            sum += x[m + (3 * i)] * x[m + (3 * i)];
+        }
+        if (sum > EM) {
+            *Mc = m;
+            EM = sum;
+        }
+    }
+
+    // Section 5.2.15 - APCM quantization of the selected RPE sequence.
+    int16_t xM[13];
+    for (uint16_t i = 0; i <= 12; i++) {
+        xM[i] = toInt16(x[*Mc + (3 * i)]);
+    }
+    apcmQuantize(xM, xmaxc, xMc);
+}
+
+}
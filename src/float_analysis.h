@@ -0,0 +1,81 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#ifndef _float_analysis_h
+#define _float_analysis_h
+
+#include <cstdint>
+
+namespace kc1fsz {
+
+/**
+ * Single-precision versions of the analysis stages of the encoder, used
+ * when Encoder::setFloatAnalysis() is on.  These are NOT bit-exact with
+ * the draft.  Everything that goes into the bitstream is still quantized
+ * using the rules (and tables) of the draft, so the output can be decoded
+ * by any GSM 06.10 decoder.
+ *
+ * The code is written once for a generic vector width: 8 (__AVX2__),
+ * 4 (__SSE4_1__) or 1 (everything else).  The summation order depends on
+ * the width, so the output can differ slightly between builds.
+ */
+
+/**
+ * Sections 5.2.4 to 5.2.7 - Autocorrelation, reflection coefficients and
+ * the quantization of the Log-Area Ratios.  No scaling of s[] is needed.
+ *
+ * @param s The pre-emphasized signal [0..159]
+ * @param LARc Receives the coded Log-Area Ratios [0..7]
+ */
+void lpcAnalysisFloat(const int16_t s[], uint16_t LARc[]);
+
+/**
+ * Section 5.2.10 - Short term analysis filtering.  The lattice of each
+ * zone is converted to the equivalent direct form (FIR) filter, which has
+ * no recursion and so can be vectorized across the samples.
+ *
+ * @param rp The reflection coefficients for each zone, rp[0..3][1..8]
+ * @param sLast The last 8 samples of the previous s[], carried between frames
+ * @param s The pre-emphasized signal [0..159]
+ * @param d Receives the short term residual [0..159]. This may be the same
+ *   array as s[].
+ */
+void shortTermAnalysisFloat(const int16_t rp[][9], int16_t sLast[], const int16_t s[],
+    int16_t d[]);
+
+/**
+ * Section 5.2.11 - Calculation of the LTP lag (full search) and gain.
+ *
+ * @param d The short term residual of the sub-segment [0..39]
+ * @param dp The reconstructed short term residual history [0..119]
+ * @param Nc Receives the lag [40..120]
+ * @param bc Receives the coded gain [0..3]
+ */
+void ltpParametersFloat(const int16_t d[], const int16_t dp[], uint16_t* Nc, uint16_t* bc);
+
+/**
+ * Sections 5.2.13 to 5.2.15 - Same as rpeEncode() (see kernels.h).  The
+ * weighting filter and the grid selection are done in float and the
+ * selected sequence is then quantized by apcmQuantize().
+ */
+void rpeEncodeFloat(const int16_t e[], int16_t* Mc, int16_t* xmaxc, int16_t xMc[]);
+
+}
+
+#endif
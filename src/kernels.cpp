@@ -0,0 +1,738 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+#include "fixed_math.h"
+#include "kernels.h"
+#include "gsm-0610-codec/Encoder.h"
+
+namespace kc1fsz {
+
+// ===== Section 5.2.11 - LTP lag search ======================================
+
+/**
+ * Picks the first lag with the largest positive cross-correlation. This
+ * matches the strict ">" comparison used in the draft.
+ */
+static int16_t selectLag(const int32_t L_result[81], int32_t* L_max) {
+    int16_t Nc = 40;
+    int32_t max = 0;
+    for (uint16_t i = 0; i <= 80; i++) {
+        if (L_result[i] > max) {
+            Nc = 40 + i;
+            max = L_result[i];
+        }
+    }
+    *L_max = max;
+    return Nc;
+}
+
+/**
+ * One lag at a time. Please see the range note in the header for the
+ * justification of the non-saturating accumulation.
+ */
+static int32_t ltpCorrelation(const int16_t wt[], const int16_t dp[], uint16_t lambda) {
+    // NOTE: Index adjustment vs. draft doc
+    const int16_t* dpl = dp + (120 - lambda);
+    int32_t L_result = 0;
+    for (uint16_t k = 0; k <= 39; k++) {
+        L_result += (int32_t)wt[k] * (int32_t)dpl[k];
+    }
+    // The L_mult() shift is applied once at the end
+    return L_result << 1;
+}
+
+int16_t ltpLagSearchScalar(const int16_t wt[], const int16_t dp[], int32_t* L_max) {
+    int32_t L_result[81];
+    for (uint16_t lambda = 40; lambda <= 120; lambda++) {
+        L_result[lambda - 40] = ltpCorrelation(wt, dp, lambda);
+    }
+    return selectLag(L_result, L_max);
+}
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+
+/**
+ * Collapses the partial sums for four lags into one vector of four
+ * (already L_mult scaled) cross-correlations.
+ */
+static inline __m128i reduce4(__m128i a0, __m128i a1, __m128i a2, __m128i a3) {
+    __m128i t0 = _mm_hadd_epi32(a0, a1);
+    __m128i t1 = _mm_hadd_epi32(a2, a3);
+    return _mm_slli_epi32(_mm_hadd_epi32(t0, t1), 1);
+}
+
+#ifdef __AVX2__
+
+/**
+ * Partial sums of wt[0..39] * dpl[0..39] using 16+16+8 lanes.  _mm256_madd_epi16
+ * is the widening 16x16->32 multiply with pairwise accumulation.
+ */
+static inline __m128i ltpPartial(__m256i w0, __m256i w1, __m128i w2, const int16_t* dpl) {
+    __m256i acc = _mm256_madd_epi16(w0, _mm256_loadu_si256((const __m256i*)dpl));
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(w1, _mm256_loadu_si256((const __m256i*)(dpl + 16))));
+    __m128i r = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    return _mm_add_epi32(r, _mm_madd_epi16(w2, _mm_loadu_si128((const __m128i*)(dpl + 32))));
+}
+
+int16_t ltpLagSearch(const int16_t wt[], const int16_t dp[], int32_t* L_max) {
+    alignas(16) int32_t L_result[84];
+    const __m256i w0 = _mm256_loadu_si256((const __m256i*)wt);
+    const __m256i w1 = _mm256_loadu_si256((const __m256i*)(wt + 16));
+    const __m128i w2 = _mm_loadu_si128((const __m128i*)(wt + 32));
+    // Four lags per pass, 80 of the 81 lags
+    for (uint16_t lambda = 40; lambda < 120; lambda += 4) {
+        const int16_t* dpl = dp + (120 - lambda);
+        __m128i r = reduce4(ltpPartial(w0, w1, w2, dpl),
+            ltpPartial(w0, w1, w2, dpl - 1),
+            ltpPartial(w0, w1, w2, dpl - 2),
+            ltpPartial(w0, w1, w2, dpl - 3));
+        _mm_store_si128((__m128i*)(L_result + (lambda - 40)), r);
+    }
+    L_result[80] = ltpCorrelation(wt, dp, 120);
+    return selectLag(L_result, L_max);
+}
+
+/**
+ * The cross-correlations for the lags 40, 40 + step, ... 120 (L_result[i]
+ * is for lag 40 + i * step), four at a time.
+ */
+static void ltpGrid(const int16_t wt[], const int16_t dp[], uint16_t step, 
+    int32_t L_result[]) {
+    const __m256i w0 = _mm256_loadu_si256((const __m256i*)wt);
+    const __m256i w1 = _mm256_loadu_si256((const __m256i*)(wt + 16));
+    const __m128i w2 = _mm_loadu_si128((const __m128i*)(wt + 32));
+    uint16_t i = 0;
+    for (uint16_t lambda = 40; lambda + 3 * step <= 120; lambda += 4 * step, i += 4) {
+        const int16_t* dpl = dp + (120 - lambda);
+        _mm_storeu_si128((__m128i*)(L_result + i), reduce4(ltpPartial(w0, w1, w2, dpl),
+            ltpPartial(w0, w1, w2, dpl - step),
+            ltpPartial(w0, w1, w2, dpl - 2 * step),
+            ltpPartial(w0, w1, w2, dpl - 3 * step)));
+    }
+    for (uint16_t lambda = 40 + i * step; lambda <= 120; lambda += step, i++) {
+        L_result[i] = ltpCorrelation(wt, dp, lambda);
+    }
+}
+
+/**
+ * The cross-correlations for a list of lags (L_result[i] is for lags[i]),
+ * four at a time.
+ */
+static void ltpCorrelations(const int16_t wt[], const int16_t dp[], const int16_t lags[],
+    uint16_t n, int32_t L_result[]) {
+    const __m256i w0 = _mm256_loadu_si256((const __m256i*)wt);
+    const __m256i w1 = _mm256_loadu_si256((const __m256i*)(wt + 16));
+    const __m128i w2 = _mm_loadu_si128((const __m128i*)(wt + 32));
+    // NOTE: The caller pads the list to a multiple of four
+    for (uint16_t i = 0; i < n; i += 4) {
+        _mm_storeu_si128((__m128i*)(L_result + i), reduce4(ltpPartial(w0, w1, w2, dp + (120 - lags[i])),
+            ltpPartial(w0, w1, w2, dp + (120 - lags[i + 1])),
+            ltpPartial(w0, w1, w2, dp + (120 - lags[i + 2])),
+            ltpPartial(w0, w1, w2, dp + (120 - lags[i + 3]))));
+    }
+}
+
+#else
+
+static inline __m128i ltpPartial(const __m128i w[5], const int16_t* dpl) {
+    __m128i acc = _mm_madd_epi16(w[0], _mm_loadu_si128((const __m128i*)dpl));
+    for (uint16_t c = 1; c < 5; c++) {
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(w[c], _mm_loadu_si128((const __m128i*)(dpl + 8 * c))));
+    }
+    return acc;
+}
+
+int16_t ltpLagSearch(const int16_t wt[], const int16_t dp[], int32_t* L_max) {
+    alignas(16) int32_t L_result[84];
+    __m128i w[5];
+    for (uint16_t c = 0; c < 5; c++) {
+        w[c] = _mm_loadu_si128((const __m128i*)(wt + 8 * c));
+    }
+    // Four lags per pass, 80 of the 81 lags
+    for (uint16_t lambda = 40; lambda < 120; lambda += 4) {
+        const int16_t* dpl = dp + (120 - lambda);
+        __m128i r = reduce4(ltpPartial(w, dpl), ltpPartial(w, dpl - 1),
+            ltpPartial(w, dpl - 2), ltpPartial(w, dpl - 3));
+        _mm_store_si128((__m128i*)(L_result + (lambda - 40)), r);
+    }
+    L_result[80] = ltpCorrelation(wt, dp, 120);
+    return selectLag(L_result, L_max);
+}
+
+static void ltpGrid(const int16_t wt[], const int16_t dp[], uint16_t step, 
+    int32_t L_result[]) {
+    __m128i w[5];
+    for (uint16_t c = 0; c < 5; c++) {
+        w[c] = _mm_loadu_si128((const __m128i*)(wt + 8 * c));
+    }
+    uint16_t i = 0;
+    for (uint16_t lambda = 40; lambda + 3 * step <= 120; lambda += 4 * step, i += 4) {
+        const int16_t* dpl = dp + (120 - lambda);
+        _mm_storeu_si128((__m128i*)(L_result + i), reduce4(ltpPartial(w, dpl),
+            ltpPartial(w, dpl - step), ltpPartial(w, dpl - 2 * step),
+            ltpPartial(w, dpl - 3 * step)));
+    }
+    for (uint16_t lambda = 40 + i * step; lambda <= 120; lambda += step, i++) {
+        L_result[i] = ltpCorrelation(wt, dp, lambda);
+    }
+}
+
+static void ltpCorrelations(const int16_t wt[], const int16_t dp[], const int16_t lags[],
+    uint16_t n, int32_t L_result[]) {
+    __m128i w[5];
+    for (uint16_t c = 0; c < 5; c++) {
+        w[c] = _mm_loadu_si128((const __m128i*)(wt + 8 * c));
+    }
+    // NOTE: The caller pads the list to a multiple of four
+    for (uint16_t i = 0; i < n; i += 4) {
+        _mm_storeu_si128((__m128i*)(L_result + i), reduce4(ltpPartial(w, dp + (120 - lags[i])),
+            ltpPartial(w, dp + (120 - lags[i + 1])),
+            ltpPartial(w, dp + (120 - lags[i + 2])),
+            ltpPartial(w, dp + (120 - lags[i + 3]))));
+    }
+}
+
+#endif
+
+#else
+
+int16_t ltpLagSearch(const int16_t wt[], const int16_t dp[], int32_t* L_max) {
+    return ltpLagSearchScalar(wt, dp, L_max);
+}
+
+static void ltpGrid(const int16_t wt[], const int16_t dp[], uint16_t step, 
+    int32_t L_result[]) {
+    for (uint16_t lambda = 40, i = 0; lambda <= 120; lambda += step, i++) {
+        L_result[i] = ltpCorrelation(wt, dp, lambda);
+    }
+}
+
+static void ltpCorrelations(const int16_t wt[], const int16_t dp[], const int16_t lags[],
+    uint16_t n, int32_t L_result[]) {
+    for (uint16_t i = 0; i < n; i++) {
+        L_result[i] = ltpCorrelation(wt, dp, lags[i]);
+    }
+}
+
+#endif
+
+int16_t ltpLagSearchReduced(const int16_t wt[], const int16_t dp[], uint16_t step,
+    const int16_t hints[], uint16_t hintCount, int32_t* L_max) {
+
+    // Coarse grid.  The lags are in order, so the strict ">" picks the 
+    // first maximum like selectLag().
+    int32_t L_result[84];
+    ltpGrid(wt, dp, step, L_result);
+    int16_t Nc = 40;
+    int32_t max = 0;
+    for (uint16_t i = 0, lambda = 40; lambda <= 120; i++, lambda += step) {
+        if (L_result[i] > max) {
+            Nc = lambda;
+            max = L_result[i];
+        }
+    }
+
+    // The rest are off the grid.  A lag may end up being evaluated twice, 
+    // which is harmless.
+    int16_t lags[16];
+    uint16_t n = 0;
+    auto add = [&](int16_t lambda) {
+        if (lambda >= 40 && lambda <= 120 && ((lambda - 40) & (step - 1)) != 0) {
+            lags[n++] = lambda;
+        }
+    };
+    // Repeats the last lag so that the SIMD versions can go four at a time,
+    // then evaluates the list.  These lags aren't in order so ties go to the
+    // smaller lag explicitly.
+    auto evaluate = [&]() {
+        for (uint16_t i = n; i % 4 != 0; i++) {
+            lags[i] = lags[n - 1];
+        }
+        ltpCorrelations(wt, dp, lags, n, L_result);
+        for (uint16_t i = 0; i < n; i++) {
+            int32_t r = L_result[i];
+            if (r > max || (r == max && r > 0 && lags[i] < Nc)) {
+                Nc = lags[i];
+                max = r;
+            }
+        }
+        n = 0;
+    };
+
+    // The neighborhood of each hint
+    for (uint16_t h = 0; h < hintCount; h++) {
+        if (hints[h] != 0) {
+            for (int16_t i = -1; i <= 1; i++) {
+                add(hints[h] + i);
+            }
+        }
+    }
+    if (n > 0) {
+        evaluate();
+    }
+
+    // Fill in the gaps around the best so far
+    int16_t center = Nc;
+    for (int16_t i = 1 - (int16_t)step; i < (int16_t)step; i++) {
+        add(center + i);
+    }
+    if (n > 0) {
+        evaluate();
+    }
+
+    *L_max = max;
+    return Nc;
+}
+
+// ===== Section 5.2.4 - Autocorrelation ======================================
+
+int16_t autocorrelationScale(int16_t smax) {
+    if (smax == 0) {
+        return 0;
+    } else {
+        return sub(4, norm((int32_t)smax << 16));
+    }
+}
+
+int16_t autocorrelationMaxScalar(const int16_t s[]) {
+    int16_t smax = 0;
+    for (uint16_t k = 0; k <= 159; k++) {
+        int16_t temp = s_abs(s[k]);
+        if (temp > smax) {
+            smax = temp;
+        }
+    }
+    return smax;
+}
+
+void autocorrelationScalar(int16_t s[], int32_t L_ACF[]) {
+    autocorrelationScalar(s, autocorrelationMaxScalar(s), L_ACF);
+}
+
+void autocorrelationScalar(int16_t s[], int16_t smax, int32_t L_ACF[]) {
+
+    int16_t scalauto = autocorrelationScale(smax);
+
+    // Scaling of the array s[0..159]
+    if (scalauto > 0) {
+        int16_t temp = 16384 >> sub(scalauto, 1);
+        for (uint16_t k = 0; k <= 159; k++) {
+            s[k] = mult_r(s[k], temp);
+        }
+    }
+
+    // Compute the L_ACF[..].  Please see the range note in the header.
+    for (uint16_t k = 0; k <= 8; k++) {
+        int32_t L_sum = 0;
+        for (uint16_t i = k; i <= 159; i++) {
+            L_sum += (int32_t)s[i] * (int32_t)s[i - k];
+        }
+        L_ACF[k] = L_sum << 1;
+    }
+
+    // Rescaling of the array s[0..159]
+    if (scalauto > 0) {
+        for (uint16_t k = 0; k <= 159; k++) {
+            s[k] = s[k] << scalauto;
+        }
+    }
+}
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+
+#ifdef __AVX2__
+
+/**
+ * Partial sums of sp[0..159] * sp[k..k+159].  The tail of sp[] is zero so 
+ * this is the same as the draft's sum over i = k..159.
+ */
+static inline __m128i acfPartial(const int16_t* sp, uint16_t k) {
+    __m256i acc = _mm256_setzero_si256();
+    for (uint16_t i = 0; i < 160; i += 16) {
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(
+            _mm256_load_si256((const __m256i*)(sp + i)),
+            _mm256_loadu_si256((const __m256i*)(sp + i + k))));
+    }
+    return _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+}
+
+#else
+
+static inline __m128i acfPartial(const int16_t* sp, uint16_t k) {
+    __m128i acc = _mm_setzero_si128();
+    for (uint16_t i = 0; i < 160; i += 8) {
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(
+            _mm_load_si128((const __m128i*)(sp + i)),
+            _mm_loadu_si128((const __m128i*)(sp + i + k))));
+    }
+    return acc;
+}
+
+#endif
+
+int16_t autocorrelationMax(const int16_t s[]) {
+    // The absolute value is treated as unsigned so |-32768| comes out as 
+    // 32768 and is then limited to 32767, consistent with s_abs().
+    __m128i vmax = _mm_setzero_si128();
+    for (uint16_t k = 0; k < 160; k += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + k));
+        vmax = _mm_max_epu16(vmax, _mm_abs_epi16(v));
+    }
+    vmax = _mm_max_epu16(vmax, _mm_srli_si128(vmax, 8));
+    vmax = _mm_max_epu16(vmax, _mm_srli_si128(vmax, 4));
+    vmax = _mm_max_epu16(vmax, _mm_srli_si128(vmax, 2));
+    uint16_t umax = (uint16_t)_mm_extract_epi16(vmax, 0);
+    return umax > 32767 ? 32767 : (int16_t)umax;
+}
+
+void autocorrelation(int16_t s[], int32_t L_ACF[]) {
+    autocorrelation(s, autocorrelationMax(s), L_ACF);
+}
+
+void autocorrelation(int16_t s[], int16_t smax, int32_t L_ACF[]) {
+
+    // Working copy of s[], padded with zeros so that every lag can be 
+    // computed over the full 160 samples.
+    alignas(32) int16_t sp[160 + 16];
+
+    int16_t scalauto = autocorrelationScale(smax);
+
+    // Scaling of the array s[0..159].  The scale factor is a positive 
+    // power of two so _mm_mulhrs_epi16() is identical to mult_r().
+    if (scalauto > 0) {
+        const __m128i temp = _mm_set1_epi16(16384 >> sub(scalauto, 1));
+        for (uint16_t k = 0; k < 160; k += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(s + k));
+            _mm_store_si128((__m128i*)(sp + k), _mm_mulhrs_epi16(v, temp));
+        }
+    } else {
+        for (uint16_t k = 0; k < 160; k += 8) {
+            _mm_store_si128((__m128i*)(sp + k), _mm_loadu_si128((const __m128i*)(s + k)));
+        }
+    }
+    _mm_store_si128((__m128i*)(sp + 160), _mm_setzero_si128());
+    _mm_store_si128((__m128i*)(sp + 168), _mm_setzero_si128());
+
+    // Compute the L_ACF[..], four lags per pass
+    for (uint16_t k = 0; k < 8; k += 4) {
+        __m128i r = reduce4(acfPartial(sp, k), acfPartial(sp, k + 1),
+            acfPartial(sp, k + 2), acfPartial(sp, k + 3));
+        _mm_storeu_si128((__m128i*)(L_ACF + k), r);
+    }
+    __m128i r8 = acfPartial(sp, 8);
+    r8 = _mm_hadd_epi32(r8, r8);
+    r8 = _mm_hadd_epi32(r8, r8);
+    L_ACF[8] = _mm_cvtsi128_si32(r8) << 1;
+
+    // Rescaling of the array s[0..159]
+    if (scalauto > 0) {
+        const __m128i count = _mm_cvtsi32_si128(scalauto);
+        for (uint16_t k = 0; k < 160; k += 8) {
+            __m128i v = _mm_load_si128((const __m128i*)(sp + k));
+            _mm_storeu_si128((__m128i*)(s + k), _mm_sll_epi16(v, count));
+        }
+    }
+}
+
+#else
+
+int16_t autocorrelationMax(const int16_t s[]) {
+    return autocorrelationMaxScalar(s);
+}
+
+void autocorrelation(int16_t s[], int32_t L_ACF[]) {
+    autocorrelationScalar(s, L_ACF);
+}
+
+void autocorrelation(int16_t s[], int16_t smax, int32_t L_ACF[]) {
+    autocorrelationScalar(s, smax, L_ACF);
+}
+
+#endif
+
+// ===== Sections 5.2.13 to 5.2.15 - RPE encoding ============================
+
+/**
+ * Section 5.2.15 - Quantizing and coding of xmax to get xmaxc, followed by 
+ * the computation of the exponent and mantissa of the decoded xmaxc.
+ */
+static int16_t rpeQuantizeXmax(int16_t xmax, int16_t* exp_out, int16_t* mant_out) {
+
+    int16_t exp = 0;
+    int16_t temp = xmax >> 9;
+    int16_t itest = 0;
+    for (uint16_t i = 0; i <= 5; i++) {
+        if (temp <= 0) {
+            itest = 1;
+        }
+        temp = temp >> 1;
+        if (itest == 0) {
+            exp = add(exp, 1);
+        }
+    }
+    temp = add(exp, 5);
+    int16_t xmaxc = add((xmax >> temp), (exp << 3));
+
+    // Compute exponent and mantissa of the decoded version of xmaxc
+    exp = 0;
+    if (xmaxc > 15) {
+        exp = sub((xmaxc >> 3), 1);    
+    }
+    int16_t mant = sub(xmaxc, (exp << 3));
+
+    // Normalize mantissa0 <= mant <= 7
+    if (mant == 0) {
+        exp = -4;
+        mant = 15;
+    } else {
+        itest = 0;
+        for (uint16_t i = 0; i <= 2; i++) {
+            if (mant > 7) {
+                itest = 1;
+            }
+            if (itest == 0) {
+                mant = add((mant << 1), 1);
+            }
+            if (itest == 0) {
+                exp = sub(exp, 1);
+            }
+        }
+    }
+    mant = sub(mant, 8);
+
+    *exp_out = exp;
+    *mant_out = mant;
+    return xmaxc;
+}
+
+void rpeEncodeScalar(const int16_t e[], int16_t* Mc, int16_t* xmaxc, int16_t xMc[]) {
+
+    // Section 5.2.13 - Weighting filter H(z)
+    // The data from e[] is centered in the 50-element array wt[].
+    int16_t wt[50];
+    for (uint16_t k = 0; k <= 4; k++) {
+        wt[k] = 0;
+        wt[45 + k] = 0;
+    }    
+    for (uint16_t k = 0; k <= 39; k++) {
+        wt[k + 5] = e[k];
+    }
+
+    int16_t x[40];
+    for (uint16_t k = 0; k <= 39; k++) {
+        // Rounding of the output of the filter.  Please see the range 
+        // note in the header.
+        int32_t L_result = 8192;
+        for (uint16_t i = 0; i <= 10; i++) {
+            L_result += L_mult(wt[k + i], Encoder::H[i]);
+        }
+        // Scaling x4 (this one can saturate)
+        L_result = L_add(L_result, L_result);
+        L_result = L_add(L_result, L_result);
+        x[k] = L_result >> 16;
+    }
+
+    // Section 5.2.14 - RPE grid selection
+    int32_t EM = 0;
+    *Mc = 0;
+    for (uint16_t m = 0; m <= 3; m++) {
+        int32_t L_result = 0;
+        for (uint16_t i = 0; i <= 12; i++) {
+            // Here the 4x gets removed
+            int16_t temp1 = x[m + (3 * i)] >> 2;
+            L_result += L_mult(temp1, temp1);
+        }
+        if (L_result > EM) {
+            *Mc = m;
+            EM = L_result;
+        }
+    }
+
+    // Down-sampling by a factor 3 to get the selected xM[0..12] RPE sequence.
+    int16_t xM[13];
+    for (uint16_t i = 0; i <= 12; i++) {
+        xM[i] = x[*Mc + (3 * i)];
+    }
+
+    // Section 5.2.15 - APCM quantization of the selected RPE sequence.
+    apcmQuantize(xM, xmaxc, xMc);
+}
+
+void apcmQuantize(const int16_t xM[], int16_t* xmaxc, int16_t xMc[]) {
+
+    int16_t xmax = 0;
+    for (uint16_t i = 0; i <= 12; i++) {
+        int16_t temp = s_abs(xM[i]);
+        if (temp > xmax) {
+            xmax = temp;
+        }
+    }
+    int16_t exp, mant;
+    *xmaxc = rpeQuantizeXmax(xmax, &exp, &mant);
+
+    // Direct computation of xMc[0..12] using table 5.5
+    int16_t temp1 = sub(6, exp);
+    int16_t temp2 = Encoder::NRFAC[mant];
+    for (uint16_t i = 0; i <= 12; i++) {
+        int16_t temp = xM[i] << temp1;
+        temp = mult(temp, temp2);
+        // This equation is used to make all the xMc[i] positive
+        xMc[i] = add((temp >> 12), 4);
+    }
+}
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+
+/**
+ * The non-zero taps of H[] in pairs (H[2] and H[8] are zero).  The last 
+ * pair has a zero coefficient in the second position.
+ */
+static constexpr uint16_t H_PAIR_TAPS[5][2] = { { 0, 1 }, { 3, 4 }, { 5, 6 }, { 7, 9 }, { 10, 10 } };
+
+/**
+ * 0xffff in the positions k = m + 3i (i = 0..12) of grid m, zero elsewhere.
+ */
+struct GridMasks {
+    int16_t mask[4][40];
+    constexpr GridMasks() : mask() {
+        for (uint16_t m = 0; m <= 3; m++) {
+            for (uint16_t i = 0; i <= 12; i++) {
+                mask[m][m + (3 * i)] = -1;
+            }
+        }
+    }
+};
+
+static constexpr GridMasks GRID_MASKS;
+
+void rpeEncode(const int16_t e[], int16_t* Mc, int16_t* xmaxc, int16_t xMc[]) {
+
+    // Section 5.2.13 - Weighting filter H(z)
+    // The data from e[] is centered in the array wt[].  There is extra 
+    // zero padding at the end so that full vectors can always be loaded.
+    alignas(16) int16_t wt[64] = { 0 };
+    for (uint16_t k = 0; k < 40; k += 8) {
+        _mm_storeu_si128((__m128i*)(wt + 5 + k), _mm_loadu_si128((const __m128i*)(e + k)));
+    }
+
+    __m128i h[5];
+    for (uint16_t p = 0; p < 5; p++) {
+        int16_t h1 = (p == 4) ? 0 : Encoder::H[H_PAIR_TAPS[p][1]];
+        h[p] = _mm_set1_epi32(((uint32_t)(uint16_t)h1 << 16) | (uint16_t)Encoder::H[H_PAIR_TAPS[p][0]]);
+    }
+
+    // Eight outputs per pass.  Each _mm_madd_epi16 applies two taps to 
+    // four outputs.
+    alignas(16) int16_t x[40];
+    const __m128i round = _mm_set1_epi32(4096);
+    for (uint16_t k = 0; k < 40; k += 8) {
+        __m128i lo = round, hi = round;
+        for (uint16_t p = 0; p < 5; p++) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(wt + k + H_PAIR_TAPS[p][0]));
+            __m128i b = _mm_loadu_si128((const __m128i*)(wt + k + H_PAIR_TAPS[p][1]));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), h[p]));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), h[p]));
+        }
+        // L_result = 2 * sum + 8192 and x = sat(4 * L_result) >> 16, which 
+        // is the same as sat16((sum + 4096) >> 13)
+        lo = _mm_srai_epi32(lo, 13);
+        hi = _mm_srai_epi32(hi, 13);
+        _mm_store_si128((__m128i*)(x + k), _mm_packs_epi32(lo, hi));
+    }
+
+    // Section 5.2.14 - RPE grid selection
+    __m128i xs[5];
+    for (uint16_t c = 0; c < 5; c++) {
+        // Here the 4x gets removed
+        xs[c] = _mm_srai_epi16(_mm_load_si128((const __m128i*)(x + 8 * c)), 2);
+    }
+    __m128i em[4];
+    for (uint16_t m = 0; m <= 3; m++) {
+        __m128i acc = _mm_setzero_si128();
+        for (uint16_t c = 0; c < 5; c++) {
+            __m128i mask = _mm_loadu_si128((const __m128i*)(GRID_MASKS.mask[m] + 8 * c));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_and_si128(xs[c], mask), xs[c]));
+        }
+        em[m] = acc;
+    }
+    alignas(16) int32_t EMs[4];
+    _mm_store_si128((__m128i*)EMs, reduce4(em[0], em[1], em[2], em[3]));
+
+    int32_t EM = 0;
+    *Mc = 0;
+    for (uint16_t m = 0; m <= 3; m++) {
+        if (EMs[m] > EM) {
+            *Mc = m;
+            EM = EMs[m];
+        }
+    }
+
+    // Down-sampling by a factor 3 to get the selected xM[0..12] RPE sequence.
+    alignas(16) int16_t xM[16] = { 0 };
+    for (uint16_t i = 0; i <= 12; i++) {
+        xM[i] = x[*Mc + (3 * i)];
+    }
+    const __m128i xM0 = _mm_load_si128((const __m128i*)xM);
+    const __m128i xM1 = _mm_load_si128((const __m128i*)(xM + 8));
+
+    // Section 5.2.15 - APCM quantization of the selected RPE sequence.
+    // The absolute value is treated as unsigned, see autocorrelation().
+    __m128i vmax = _mm_max_epu16(_mm_abs_epi16(xM0), _mm_abs_epi16(xM1));
+    vmax = _mm_max_epu16(vmax, _mm_srli_si128(vmax, 8));
+    vmax = _mm_max_epu16(vmax, _mm_srli_si128(vmax, 4));
+    vmax = _mm_max_epu16(vmax, _mm_srli_si128(vmax, 2));
+    uint16_t umax = (uint16_t)_mm_extract_epi16(vmax, 0);
+    int16_t xmax = umax > 32767 ? 32767 : (int16_t)umax;
+
+    int16_t exp, mant;
+    *xmaxc = rpeQuantizeXmax(xmax, &exp, &mant);
+
+    // Direct computation of xMc[0..12] using table 5.5.  NRFAC[] is 
+    // positive so mult() is (a * b) >> 15 without the special case.
+    const __m128i temp1 = _mm_cvtsi32_si128(sub(6, exp));
+    const __m128i temp2 = _mm_set1_epi16(Encoder::NRFAC[mant]);
+    const __m128i four = _mm_set1_epi16(4);
+    alignas(16) int16_t out[16];
+    for (uint16_t c = 0; c < 2; c++) {
+        __m128i temp = _mm_sll_epi16(c == 0 ? xM0 : xM1, temp1);
+        __m128i plo = _mm_mullo_epi16(temp, temp2);
+        __m128i phi = _mm_mulhi_epi16(temp, temp2);
+        temp = _mm_or_si128(_mm_slli_epi16(phi, 1), _mm_srli_epi16(plo, 15));
+        // This equation is used to make all the xMc[i] positive
+        temp = _mm_adds_epi16(_mm_srai_epi16(temp, 12), four);
+        _mm_store_si128((__m128i*)(out + 8 * c), temp);
+    }
+    for (uint16_t i = 0; i <= 12; i++) {
+        xMc[i] = out[i];
+    }
+}
+
+#else
+
+void rpeEncode(const int16_t e[], int16_t* Mc, int16_t* xmaxc, int16_t xMc[]) {
+    rpeEncodeScalar(e, Mc, xmaxc, xMc);
+}
+
+#endif
+
+}
@@ -0,0 +1,140 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#ifndef _kernels_h
+#define _kernels_h
+
+#include <cstdint>
+
+namespace kc1fsz {
+
+/**
+ * Hot inner loops of the codec.  Each kernel is bit-exact with the
+ * straight-line fixed-point code in the draft.  The vectorized versions
+ * are selected at compile time from the target instruction set
+ * (__AVX2__ or __SSE4_1__) and a portable scalar version is used
+ * everywhere else (i.e. the Pico).
+ *
+ * The ...Scalar() versions are always available so that the two
+ * implementations can be compared in the unit tests.
+ */
+
+/**
+ * Section 5.2.11 - Search for the maximum cross-correlation between
+ * the scaled sub-segment wt[0..39] and the reconstructed short term
+ * residual dp[-120..-1] for lags 40..120.
+ *
+ * RANGE NOTE: The caller scales wt[] so that |wt[k]| <= 512.  Each
+ * L_mult() is then bounded by 2^25 and the sum of 40 of them is bounded
+ * by 40 * 2^25 < 2^31, so the L_add() saturation can never trigger and
+ * a plain (wide) multiply-accumulate gives identical results.
+ *
+ * @param wt The scaled sub-segment [0..39]
+ * @param dp The residual history. NOTE: Indexed 0..119 rather than -120..-1.
+ * @param L_max Receives the maximum cross-correlation (0 if nothing is positive)
+ * @returns The lag Nc[40..120] of the first maximum.
+ */
+int16_t ltpLagSearch(const int16_t wt[], const int16_t dp[], int32_t* L_max);
+
+int16_t ltpLagSearchScalar(const int16_t wt[], const int16_t dp[], int32_t* L_max);
+
+/**
+ * A non-exhaustive version of the above (NOT bit-exact with the draft).  
+ * The cross-correlation is computed for every step'th lag, for the lags 
+ * next to each hint and then for the lags around the best of those.
+ * The result is always a valid lag [40..120].
+ *
+ * @param step The spacing of the coarse search grid, a power of two (1 = everything)
+ * @param hints Likely lags (i.e. the previous Nc), 0 entries are ignored
+ * @param hintCount The number of hints
+ */
+int16_t ltpLagSearchReduced(const int16_t wt[], const int16_t dp[], uint16_t step,
+    const int16_t hints[], uint16_t hintCount, int32_t* L_max);
+
+/**
+ * Section 5.2.4 - Autocorrelation. Searches for the maximum of |s[]|, 
+ * scales s[0..159] to avoid overflow, computes L_ACF[0..8] and then 
+ * rescales s[] in place (the low-order bits lost in the scaling are NOT 
+ * restored, exactly as in the draft).
+ *
+ * RANGE NOTE: After scaling |s[k]| <= 2048, so each L_mult() is bounded 
+ * by 2^23 and the sum of 160 of them stays below 2^31.  The L_add() 
+ * saturation can't trigger so a plain multiply-accumulate is used.
+ *
+ * @param s The pre-emphasized signal [0..159], modified in place.
+ * @param L_ACF Receives the autocorrelation for lags [0..8]
+ */
+void autocorrelation(int16_t s[], int32_t L_ACF[]);
+
+void autocorrelationScalar(int16_t s[], int32_t L_ACF[]);
+
+/**
+ * Same as above, but for callers that have already found the maximum
+ * of |s[]| (i.e. during the preprocessing).
+ */
+void autocorrelation(int16_t s[], int16_t smax, int32_t L_ACF[]);
+
+void autocorrelationScalar(int16_t s[], int16_t smax, int32_t L_ACF[]);
+
+/**
+ * The scaling factor of section 5.2.4 (scalauto) for the maximum of 
+ * |s[]|.  s[] is only scaled when this is positive [1..4].
+ */
+int16_t autocorrelationScale(int16_t smax);
+
+/**
+ * The maximum of |s[0..159]| (using s_abs()).
+ */
+int16_t autocorrelationMax(const int16_t s[]);
+
+int16_t autocorrelationMaxScalar(const int16_t s[]);
+
+/**
+ * Sections 5.2.13 to 5.2.15 - RPE encoding of one sub-segment. Applies the 
+ * weighting filter H(z) to the long-term residual e[0..39], selects the 
+ * RPE grid with the most energy and APCM-quantizes the selected sequence.
+ *
+ * RANGE NOTE: The sum of |H[i]| is 24798, so every partial sum of the 
+ * weighting filter is bounded by 2 * 32768 * 24798 + 8192 < 2^31. The only 
+ * place that can saturate is the final x4 scaling, which is done with an 
+ * explicit clamp. In the grid selection |x[k] >> 2| <= 8192, so the 13 
+ * squares sum to less than 2^31.
+ *
+ * @param e The long-term residual [0..39]
+ * @param Mc Receives the RPE grid position [0..3]
+ * @param xmaxc Receives the coded block amplitude [0..63]
+ * @param xMc Receives the coded RPE pulses [0..12], each [0..7]
+ */
+void rpeEncode(const int16_t e[], int16_t* Mc, int16_t* xmaxc, int16_t xMc[]);
+
+void rpeEncodeScalar(const int16_t e[], int16_t* Mc, int16_t* xmaxc, int16_t xMc[]);
+
+/**
+ * Section 5.2.15 - APCM quantization of the selected RPE sequence (the last
+ * step of rpeEncodeScalar()).
+ *
+ * @param xM The selected RPE sequence [0..12]
+ * @param xmaxc Receives the coded block amplitude [0..63]
+ * @param xMc Receives the coded RPE pulses [0..12], each [0..7]
+ */
+void apcmQuantize(const int16_t xM[], int16_t* xmaxc, int16_t xMc[]);
+
+}
+
+#endif
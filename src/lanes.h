@@ -0,0 +1,96 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#ifndef _lanes_h
+#define _lanes_h
+
+// Fixed-point operations on SSE4.1 registers, one independent value per
+// lane.  Each one is bit-exact with the scalar function of the same
+// name in fixed_math.h. These are shared by the encoder/decoder banks.
+
+#ifdef __SSE4_1__
+
+#include <cstdint>
+#include <immintrin.h>
+
+namespace kc1fsz {
+
+/**
+ * L_add() on four lanes.  Overflow happened if the result has a different
+ * sign from both inputs, in which case it saturates in the direction of
+ * the inputs.
+ */
+inline __m128i L_add_x4(__m128i a, __m128i b) {
+    __m128i r = _mm_add_epi32(a, b);
+    __m128i ovf = _mm_and_si128(_mm_xor_si128(a, r), _mm_xor_si128(b, r));
+    __m128i sat = _mm_xor_si128(_mm_srai_epi32(a, 31), _mm_set1_epi32(0x7fffffff));
+    return _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(r),
+        _mm_castsi128_ps(sat), _mm_castsi128_ps(ovf)));
+}
+
+/**
+ * L_sub() on four lanes.  Overflow is only possible when the signs of
+ * the inputs differ.
+ */
+inline __m128i L_sub_x4(__m128i a, __m128i b) {
+    __m128i r = _mm_sub_epi32(a, b);
+    __m128i ovf = _mm_and_si128(_mm_xor_si128(a, b), _mm_xor_si128(a, r));
+    __m128i sat = _mm_xor_si128(_mm_srai_epi32(a, 31), _mm_set1_epi32(0x7fffffff));
+    return _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(r),
+        _mm_castsi128_ps(sat), _mm_castsi128_ps(ovf)));
+}
+
+/**
+ * Saturation of 32-bit lanes to the 16-bit range.
+ */
+inline __m128i sat16_x4(__m128i a) {
+    return _mm_min_epi32(_mm_max_epi32(a, _mm_set1_epi32(-32768)), _mm_set1_epi32(32767));
+}
+
+/**
+ * The (int16_t) cast on 32-bit lanes.
+ */
+inline __m128i trunc16_x4(__m128i a) {
+    return _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+}
+
+/**
+ * mult_r() with a constant on 32-bit lanes.  The constant is never -32768
+ * so the special case doesn't apply.
+ */
+inline __m128i mult_r_x4(__m128i a, int32_t c) {
+    return _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(a, _mm_set1_epi32(c)),
+        _mm_set1_epi32(16384)), 15);
+}
+
+/**
+ * mult_r() on eight 16-bit lanes.  pmulhrsw is identical except that
+ * -32768 x -32768 comes out as -32768 instead of 32767.  That is the only
+ * way to get -32768 out, so those lanes are flipped.
+ */
+inline __m128i mult_r_x8(__m128i a, __m128i b) {
+    __m128i r = _mm_mulhrs_epi16(a, b);
+    return _mm_xor_si128(r, _mm_cmpeq_epi16(r, _mm_set1_epi16(-32768)));
+}
+
+}
+
+#endif
+
+#endif
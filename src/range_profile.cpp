@@ -0,0 +1,119 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <tuple>
+#include <algorithm>
+
+#include "range_profile.h"
+
+namespace kc1fsz {
+
+namespace range {
+
+struct Site {
+    uint64_t calls = 0;
+    uint64_t saturations = 0;
+    int64_t min = INT64_MAX;
+    int64_t max = INT64_MIN;
+    bool checked = false;
+};
+
+// Keyed on the pointers that __builtin_FILE() and the operation name give, 
+// which are stable for the life of the program. The same file can appear 
+// under more than one pointer (i.e. an inline function in a header), so 
+// the sites are merged by name when they are reported.
+typedef std::tuple<const char*, int, const char*> Key;
+
+static std::map<Key, Site>& sites() {
+    static std::map<Key, Site> s;
+    return s;
+}
+
+static void recordSite(const char* op, const char* file, int line, int64_t exact,
+    bool saturated, bool checked) {
+    Site& site = sites()[Key(file, line, op)];
+    site.calls++;
+    if (saturated) {
+        site.saturations++;
+    }
+    site.min = std::min(site.min, exact);
+    site.max = std::max(site.max, exact);
+    site.checked = checked;
+}
+
+void record(const char* op, const char* file, int line, int64_t exact, bool checked) {
+    recordSite(op, file, line, exact, exact < INT16_MIN || exact > INT16_MAX, checked);
+}
+
+void record32(const char* op, const char* file, int line, int64_t exact, bool checked) {
+    recordSite(op, file, line, exact, exact < INT32_MIN || exact > INT32_MAX, checked);
+}
+
+void clear() {
+    sites().clear();
+}
+
+static std::string baseName(const char* file) {
+    const char* p = strrchr(file, '/');
+    return p ? p + 1 : file;
+}
+
+unsigned report(std::ostream& str) {
+
+    std::map<std::tuple<std::string, int, std::string>, Site> merged;
+    for (const auto& [key, site] : sites()) {
+        Site& m = merged[std::make_tuple(baseName(std::get<0>(key)), std::get<1>(key), 
+            std::string(std::get<2>(key)))];
+        m.calls += site.calls;
+        m.saturations += site.saturations;
+        m.min = std::min(m.min, site.min);
+        m.max = std::max(m.max, site.max);
+        m.checked = site.checked;
+    }
+
+    char line[160];
+    snprintf(line, sizeof(line), "%-24s %-13s %12s %12s %12s %8s\n", 
+        "Site", "Operation", "Calls", "Min", "Max", "Sat");
+    str << line;
+
+    unsigned violations = 0;
+    for (const auto& [key, site] : merged) {
+        std::string where = std::get<0>(key) + ":" + std::to_string(std::get<1>(key));
+        const char* flag = "";
+        if (site.checked && site.saturations) {
+            violations++;
+            flag = "  VIOLATION";
+        }
+        snprintf(line, sizeof(line), "%-24s %-13s %12llu %12lld %12lld %8llu%s\n", 
+            where.c_str(), std::get<2>(key).c_str(), 
+            (unsigned long long)site.calls, (long long)site.min, (long long)site.max, 
+            (unsigned long long)site.saturations, flag);
+        str << line;
+    }
+    return violations;
+}
+
+}
+
+}
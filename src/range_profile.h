@@ -0,0 +1,72 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#ifndef _range_profile_h
+#define _range_profile_h
+
+#include <cstdint>
+#include <iostream>
+
+namespace kc1fsz {
+
+/**
+ * Range profiling of the fixed-point operations.  When the codec is built
+ * with GSM_RANGE_PROFILE defined (see fixed_math.h) every call of add(),
+ * sub(), mult(), mult_r(), s_abs(), L_mult(), L_add(), L_sub() and of the
+ * ..._nosat() versions records the exact result at its call site (file and
+ * line).  This is used to find (and check) the call sites where the
+ * saturation never triggers.  See bench/gsm-range.cpp.
+ */
+namespace range {
+
+/**
+ * Records one call of a 16-bit operation.
+ *
+ * @param exact The result before any saturation
+ * @param checked True for the ..._nosat() versions, where a result that
+ *   doesn't fit is a violation of the range argument.
+ */
+void record(const char* op, const char* file, int line, int64_t exact,
+    bool checked = false);
+
+/**
+ * Same as above, for a 32-bit operation.
+ */
+void record32(const char* op, const char* file, int line, int64_t exact,
+    bool checked = false);
+
+/**
+ * Forgets everything recorded so far.
+ */
+void clear();
+
+/**
+ * Prints one line per call site (file:line, operation, number of calls,
+ * minimum and maximum of the exact result, number of saturations).
+ *
+ * @returns The number of violations (..._nosat() calls that would have
+ *   saturated).
+ */
+unsigned report(std::ostream& str);
+
+}
+
+}
+
+#endif
@@ -0,0 +1,133 @@
+/**
+ * GSM 06.10 CODEC
+ * Copyright (C) 2024, Bruce MacKinnon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * NOT FOR COMMERCIAL USE WITHOUT PERMISSION.
+ */
+#ifndef _tables_h
+#define _tables_h
+
+#include <cstdint>
+
+#include "fixed_math.h"
+#include "gsm-0610-codec/Encoder.h"
+
+namespace kc1fsz {
+
+/**
+ * Dequantization tables that are generated at compile time.  Both of 
+ * the decoding steps below only depend on small coded values so the 
+ * arithmetic from the draft is done once for every possible input by 
+ * the constexpr functions (using the portable:: operations) and the 
+ * codec just does lookups.
+ */
+
+/**
+ * Section 5.2.8 - Decoding of the coded Log-Area Ratios, for LARc[i - 1]
+ * where i is [1..8].
+ * 
+ * NOTE: The shifts of negative values in the draft are done as 
+ * multiplications since they aren't allowed in a constant expression.
+ */
+constexpr int16_t decodeLARc(uint16_t i, uint16_t LARc) {
+    // NOTE: The addition of MIC[i] is used to restore the sign of LARc[i]
+    int16_t temp1 = (int16_t)(portable::add((int16_t)LARc, Encoder::MIC[i]) * 1024);
+    int16_t temp2 = (int16_t)(Encoder::B[i] * 2);
+    temp1 = portable::sub(temp1, temp2);
+    temp1 = portable::mult_r(Encoder::INVA[i], temp1);
+    return portable::add(temp1, temp1);
+}
+
+/**
+ * Section 5.3.1 / 5.2.16 - The exponent/mantissa of the decoded xmaxc 
+ * followed by the APCM inverse quantization of one pulse xMc.
+ * 
+ * NOTE: The draft computes 1 << (temp2 - 1) for the rounding term, which 
+ * is a shift by -1 when exp == 6.  That comes out as zero on the 
+ * targets, and that is what is used here.
+ */
+constexpr int16_t decodeXMc(int16_t xmaxc, int16_t xMc) {
+
+    int16_t exp = 0;
+    if (xmaxc > 15) {
+        exp = portable::sub((xmaxc >> 3), 1);
+    }
+    int16_t mant = portable::sub(xmaxc, (exp << 3));
+
+    // Normalize mantissa0 <= mant <= 7
+    if (mant == 0) {
+        exp = -4;
+        mant = 15;
+    } else {
+        while (mant <= 7) {
+            mant = portable::add((mant << 1), 1);
+            exp = portable::sub(exp, 1);
+        }
+    }
+    mant = portable::sub(mant, 8);
+
+    int16_t temp1 = Encoder::FAC[mant];
+    int16_t temp2 = portable::sub(6, exp);
+    int16_t temp3 = temp2 == 0 ? 0 : (int16_t)(1 << portable::sub(temp2, 1));
+    // This subtraction is used to restore the sign of xMc
+    int16_t temp = (int16_t)(portable::sub((xMc << 1), 7) * 4096);
+    temp = portable::mult_r(temp1, temp);
+    temp = portable::add(temp, temp3);
+    return temp >> temp2;
+}
+
+struct LARcTable {
+    // Indexed by [i - 1][LARc]
+    int16_t LARpp[8][64];
+};
+
+constexpr LARcTable makeLARcTable() {
+    LARcTable t {};
+    for (uint16_t i = 1; i <= 8; i++) {
+        for (uint16_t LARc = 0; LARc < 64; LARc++) {
+            t.LARpp[i - 1][LARc] = decodeLARc(i, LARc);
+        }
+    }
+    return t;
+}
+
+struct XMcTable {
+    // Indexed by [xmaxc][xMc]
+    int16_t xMp[64][8];
+};
+
+constexpr XMcTable makeXMcTable() {
+    XMcTable t {};
+    for (int16_t xmaxc = 0; xmaxc < 64; xmaxc++) {
+        for (int16_t xMc = 0; xMc < 8; xMc++) {
+            t.xMp[xmaxc][xMc] = decodeXMc(xmaxc, xMc);
+        }
+    }
+    return t;
+}
+
+/**
+ * NOTE: Coded values are looked up modulo their field width (6 bits for 
+ * LARc/xmaxc and 3 bits for xMc) so out-of-range parameters can't index
+ * past the tables.  This is the same thing that happens when a frame is
+ * packed.
+ */
+inline constexpr LARcTable LARC_TABLE = makeLARcTable();
+inline constexpr XMcTable XMC_TABLE = makeXMcTable();
+
+}
+
+#endif
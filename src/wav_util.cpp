@@ -19,7 +19,19 @@
  */
 #include <cstdint>
 #include <cstring>
-
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define WAV_MMAP 1
+#endif
+
+#include "gsm-0610-codec/Encoder.h"
+#include "gsm-0610-codec/Decoder.h"
 #include "gsm-0610-codec/wav_util.h"
 
 using namespace std;
@@ -27,182 +39,494 @@ using namespace std;
 namespace kc1fsz {
 
 /**
- * Writes a 32-bit integer in little-endian format.
+ * Reads a 16-bit integer in little-endian format.
  */
-static void write32LE(ostream& str, uint32_t i) {
-    uint8_t b;
-    b = i & 0xff;
-    str.write((char*)&b, 1);
-    b = (i >> 8) & 0xff;
-    str.write((char*)&b, 1);
-    b = (i >> 16) & 0xff;
-    str.write((char*)&b, 1);
-    b = (i >> 24) & 0xff;
-    str.write((char*)&b, 1);
+static uint16_t get16LE(const uint8_t* b) {
+    return (uint16_t)(((uint16_t)b[1] << 8) | b[0]);
 }
 
 /**
- * Writes a 16-bit integer in little-endian format.
+ * Reads a 32-bit integer in little-endian format.
  */
-static void write16LE(ostream& str, uint16_t i) {
-    uint8_t b;
-    b = i & 0xff;
-    str.write((char*)&b, 1);
-    b = (i >> 8) & 0xff;
-    str.write((char*)&b, 1);
+static uint32_t get32LE(const uint8_t* b) {
+    return ((uint32_t)b[3] << 24) | ((uint32_t)b[2] << 16) | ((uint32_t)b[1] << 8) | b[0];
 }
 
-static uint32_t read32LE(istream& str) {
-    uint32_t result;
-    uint8_t b[4];
-    str.read((char*)b, 4);
-    result = b[3];
-    result <<= 8;
-    result |= b[2];
-    result <<= 8;
-    result |= b[1];
-    result <<= 8;
-    result |= b[0];
-    return result;
-}
-
-static uint16_t read16LE(istream& str) {
-    uint16_t result;
-    uint8_t b[2];
-    str.read((char*)b, 2);
-    result = b[1];
-    result <<= 8;
-    result |= b[0];
-    return result;
+/**
+ * Writes a 16-bit integer in little-endian format.
+ */
+static void put16LE(uint8_t* b, uint16_t i) {
+    b[0] = i & 0xff;
+    b[1] = (i >> 8) & 0xff;
 }
 
 /**
- * Here is a decent reference: http://soundfile.sapp.org/doc/WaveFormat/
+ * Writes a 32-bit integer in little-endian format.
  */
-void encodeFromPCM16(const int16_t pcm[], uint32_t samples, std::ostream& str, 
-    uint16_t samplesPerSecond) {
-
-    uint32_t len = (samples * 2) + 36;
-
-    str.write("RIFF", 4);
-    write32LE(str, len);
-    str.write("WAVE", 4);
+static void put32LE(uint8_t* b, uint32_t i) {
+    put16LE(b, i & 0xffff);
+    put16LE(b + 2, i >> 16);
+}
 
-    uint16_t i16;
-    uint32_t i32;
+static bool isLittleEndian() {
+    const uint16_t one = 1;
+    return *(const uint8_t*)&one == 1;
+}
 
-    str.write("fmt ", 4);
+/**
+ * The length of the header written by encodeFromPCM16() and WavWriter.
+ */
+static const unsigned HEADER_BYTES = 44;
 
+/**
+ * Here is a decent reference: http://soundfile.sapp.org/doc/WaveFormat/
+ */
+static void makeHeader(uint8_t h[HEADER_BYTES], uint32_t samplesPerSecond, uint16_t channels,
+    uint32_t dataBytes) {
+    memcpy(h, "RIFF", 4);
+    put32LE(h + 4, dataBytes + 36);
+    memcpy(h + 8, "WAVE", 4);
+    memcpy(h + 12, "fmt ", 4);
     // Sub Chunk 1 size
-    i32 = 16;
-    write32LE(str, i32);
-
+    put32LE(h + 16, 16);
     // PCM format
-    i16 = 1;
-    write16LE(str, i16);
-
+    put16LE(h + 20, 1);
     // Number of channels
-    i16 = 1;
-    write16LE(str, i16);
-
+    put16LE(h + 22, channels);
     // Sample rate
-    i32 = samplesPerSecond;
-    write32LE(str, i32);
-
+    put32LE(h + 24, samplesPerSecond);
     // Byte rate
-    i32 = samplesPerSecond * 2;
-    write32LE(str, i32);
-
+    put32LE(h + 28, samplesPerSecond * 2 * channels);
     // Block align
-    i16 = 2;
-    write16LE(str, i16);
-
+    put16LE(h + 32, 2 * channels);
     // Bits per sample
-    i16 = 16;
-    write16LE(str, i16);
-
-    str.write("data", 4);
+    put16LE(h + 34, 16);
+    memcpy(h + 36, "data", 4);
     // Bytes of audio
-    i32 = samples * 2;
-    write32LE(str, i32);
-    // The actual data 
-    for (uint32_t i = 0; i < samples; i++) {
-        write16LE(str, pcm[i]);
-    }   
+    put32LE(h + 40, dataBytes);
 }
 
-int decodeToPCM16(std::istream& str, int16_t pcm[], uint32_t maxSamples) {
+/**
+ * The parts of the "fmt " chunk that are used.
+ */
+struct WavFormat {
+    uint16_t format;
+    uint16_t channels;
+    uint32_t sampleRate;
+    uint16_t bitsPerSample;
+};
+
+/**
+ * Walks the chunks of a .WAV stream up to the start of the samples in the
+ * "data" chunk.  read(uint8_t* b, uint32_t n) and skip(uint64_t n) return 
+ * false if the stream ends.
+ *
+ * @returns 0 or an error code (see decodeToPCM16()).
+ */
+template <class R, class S> static int parseHeader(R read, S skip, WavFormat* fmt, 
+    uint32_t* dataBytes) {
 
-    char buf[4];
-    // RIFF
-    str.read(buf, 4);
-    if (!memcmp(buf, "RIFF", 4) == 0) {
+    uint8_t b[16];
+    if (!read(b, 12) || memcmp(b, "RIFF", 4) != 0 || memcmp(b + 8, "WAVE", 4) != 0) {
         return -1;
     }
 
-    //uint32_t totalLen = read32LE(str);
-    read32LE(str);
+    bool haveFormat = false;
+    while (read(b, 8)) {
+        uint32_t size = get32LE(b + 4);
+        if (memcmp(b, "fmt ", 4) == 0) {
+            if (size < 16 || !read(b, 16)) {
+                return -1;
+            }
+            fmt->format = get16LE(b);
+            fmt->channels = get16LE(b + 2);
+            fmt->sampleRate = get32LE(b + 4);
+            fmt->bitsPerSample = get16LE(b + 14);
+            if (!skip((uint64_t)size - 16 + (size & 1))) {
+                return -1;
+            }
+            haveFormat = true;
+        } else if (memcmp(b, "data", 4) == 0) {
+            if (!haveFormat) {
+                return -1;
+            }
+            if (fmt->format != 1) {
+                return -2;
+            }
+            if (fmt->bitsPerSample != 16) {
+                return -4;
+            }
+            *dataBytes = size;
+            return 0;
+        } else {
+            // Anything else (LIST, fact, ...) is skipped.  Chunks are 
+            // padded to an even length.
+            if (!skip((uint64_t)size + (size & 1))) {
+                return -1;
+            }
+        }
+    }
+    return -1;
+}
 
-    // WAVE
-    str.read(buf, 4);
-    if (!memcmp(buf, "WAVE", 4) == 0) {
-        return -1;
+void encodeFromPCM16(const int16_t pcm[], uint32_t samples, std::ostream& str, 
+    uint16_t samplesPerSecond) {
+    encodeFromPCM16(pcm, samples, 1, str, samplesPerSecond);
+}
+
+void encodeFromPCM16(const int16_t pcm[], uint32_t samples, uint16_t channels, 
+    std::ostream& str, uint16_t samplesPerSecond) {
+
+    uint8_t h[HEADER_BYTES];
+    makeHeader(h, samplesPerSecond, channels, samples * 2 * channels);
+    str.write((const char*)h, HEADER_BYTES);
+    samples *= channels;
+
+    // The actual data, converted a block at a time
+    uint8_t block[4096];
+    const uint32_t blockSamples = sizeof(block) / 2;
+    for (uint32_t i = 0; i < samples; i += blockSamples) {
+        uint32_t n = samples - i < blockSamples ? samples - i : blockSamples;
+        for (uint32_t k = 0; k < n; k++) {
+            put16LE(block + 2 * k, pcm[i + k]);
+        }
+        str.write((const char*)block, n * 2);
     }
+}
 
-    // fmt
-    str.read(buf, 4);
-    if (!memcmp(buf, "fmt ", 4) == 0) {
-        return -1;
+/**
+ * Reads the header of a .WAV stream, leaving it at the start of the samples.
+ * 
+ * @returns 0 or an error code (see decodeToPCM16()).
+ */
+static int readHeader(std::istream& str, WavFormat* fmt, uint32_t* dataBytes) {
+    return parseHeader(
+        [&str](uint8_t* b, uint32_t n) { 
+            return (bool)str.read((char*)b, n); 
+        },
+        [&str](uint64_t n) {
+            str.ignore(n);
+            return (uint64_t)str.gcount() == n;
+        },
+        fmt, dataBytes);
+}
+
+/**
+ * Reads the interleaved samples that follow the header.
+ * 
+ * @param maxSamples The room in pcm[] (total)
+ * @returns The number of samples read (per channel)
+ */
+static int readSamples(std::istream& str, int16_t pcm[], uint32_t maxSamples, 
+    uint16_t channels, uint32_t dataBytes) {
+
+    // One read for all of the samples (a stream may end before the 
+    // size in the header, i.e. a recording that wasn't closed)
+    const uint32_t frameBytes = 2 * channels;
+    uint32_t samples = dataBytes / frameBytes;
+    if (samples > maxSamples / channels) {
+        samples = maxSamples / channels;
     }
+    str.read((char*)pcm, (std::streamsize)samples * frameBytes);
+    samples = str.gcount() / frameBytes;
 
-    // Sub Chunk 1 size
-    //uint32_t subChunkSize1 = read32LE(str);
-    read32LE(str);
+    if (!isLittleEndian()) {
+        for (uint32_t i = 0; i < samples * channels; i++) {
+            pcm[i] = get16LE((const uint8_t*)&pcm[i]);
+        }
+    }
+    return samples;
+}
 
-    // Format
-    uint16_t format = read16LE(str);
-    if (format != 1) {
-        std::cout << "Format " << format << std::endl;
-        return -2;
+int decodeToPCM16(std::istream& str, int16_t pcm[], uint32_t maxSamples) {
+    WavFormat fmt = {};
+    uint32_t bytes = 0;
+    int rc = readHeader(str, &fmt, &bytes);
+    if (rc != 0) {
+        return rc;
     }
+    // NOTE: This is checked before anything is read into pcm[]
+    if (fmt.channels != 1) {
+        return -3;
+    }
+    return readSamples(str, pcm, maxSamples, 1, bytes);
+}
 
-    // Channels
-    uint16_t channels = read16LE(str);
-    if (channels != 1) {
+int decodeToPCM16(std::istream& str, int16_t pcm[], uint32_t maxSamples, uint16_t* channels) {
+    WavFormat fmt = {};
+    uint32_t bytes = 0;
+    int rc = readHeader(str, &fmt, &bytes);
+    if (rc != 0) {
+        return rc;
+    }
+    *channels = fmt.channels;
+    if (fmt.channels == 0) {
         return -3;
     }
+    return readSamples(str, pcm, maxSamples, fmt.channels, bytes);
+}
 
-    //uint32_t sampleRate = read32LE(str);
-    read32LE(str);
-    //uint32_t byteRate = read32LE(str);
-    read32LE(str);
-    //uint16_t blockAlign = read16LE(str);
-    read16LE(str);
+// ----- Multi-channel ---------------------------------------------------------
 
-    uint16_t bitsPerSample = read16LE(str);
-    if (bitsPerSample != 16) {
-        return -4;
+/**
+ * Runs f(c) for each channel c, on its own thread when there is more than 
+ * one.
+ */
+template <class F> static void forEachChannel(uint16_t channels, F f) {
+    if (channels == 1) {
+        f(0);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (uint16_t c = 0; c < channels; c++) {
+        threads.emplace_back(f, c);
     }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
 
-    // data
-    str.read(buf, 4);
-    if (!memcmp(buf, "data", 4) == 0) {
-        return -1;
+void encodeChannels(const int16_t pcm[], uint16_t channels, uint32_t samples, 
+    uint8_t* const packedOut[]) {
+    const uint32_t frames = samples / 160;
+    forEachChannel(channels, [=](uint16_t c) {
+        Encoder encoder;
+        encoder.encodeFrames(pcm + c, frames, packedOut[c], channels);
+    });
+}
+
+void decodeChannels(const uint8_t* const packedIn[], uint16_t channels, uint32_t frames,
+    int16_t pcm[]) {
+    if (channels == 1) {
+        Decoder decoder;
+        decoder.decodeFrames(packedIn[0], frames, pcm);
+        return;
+    }
+    // Each thread decodes into its own buffer, since the threads writing 
+    // neighbouring samples of the interleaved output would be fighting 
+    // over the same cache lines.  The channels are interleaved once they 
+    // are all done.
+    const size_t samples = (size_t)frames * 160;
+    std::vector<std::vector<int16_t>> mono(channels);
+    forEachChannel(channels, [=, &mono](uint16_t c) {
+        mono[c].resize(samples);
+        Decoder decoder;
+        decoder.decodeFrames(packedIn[c], frames, mono[c].data());
+    });
+    for (uint16_t c = 0; c < channels; c++) {
+        const int16_t* in = mono[c].data();
+        for (size_t k = 0; k < samples; k++) {
+            pcm[k * channels + c] = in[k];
+        }
     }
+}
 
-    uint32_t bytes = read32LE(str);
-    uint32_t samples = bytes / 2;
+// ----- WavReader -------------------------------------------------------------
+
+WavReader::WavReader()
+:   _file(0),
+    _fileSize(0),
+    _mapped(false),
+    _pcm(0),
+    _channels(0),
+    _sampleRate(0),
+    _samples(0),
+    _position(0) {
+}
+
+WavReader::~WavReader() {
+    close();
+}
+
+int WavReader::open(const char* fileName) {
 
-    for (uint32_t i = 0; i < samples && i < maxSamples; i++) {
-        pcm[i] = read16LE(str);
+    close();
+
+#ifdef WAV_MMAP
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) {
+        return -5;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return -5;
+    }
+    _fileSize = st.st_size;
+    if (_fileSize > 0) {
+        void* p = mmap(0, _fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            return -5;
+        }
+        madvise(p, _fileSize, MADV_SEQUENTIAL);
+        _file = (const uint8_t*)p;
+        _mapped = true;
     }
+    // The mapping stays valid after the file is closed
+    ::close(fd);
+#else
+    std::ifstream str(fileName, std::ios::binary);
+    if (!str.good()) {
+        return -5;
+    }
+    str.seekg(0, std::ios::end);
+    _fileCopy.resize((size_t)str.tellg());
+    str.seekg(0);
+    str.read((char*)_fileCopy.data(), _fileCopy.size());
+    _file = _fileCopy.data();
+    _fileSize = str.gcount();
+#endif
+
+    size_t pos = 0;
+    WavFormat fmt = {};
+    uint32_t bytes = 0;
+    int rc = parseHeader(
+        [this, &pos](uint8_t* b, uint32_t n) {
+            if (_fileSize - pos < n) {
+                return false;
+            }
+            memcpy(b, _file + pos, n);
+            pos += n;
+            return true;
+        },
+        [this, &pos](uint64_t n) {
+            if (_fileSize - pos < n) {
+                return false;
+            }
+            pos += n;
+            return true;
+        },
+        &fmt, &bytes);
+    if (rc != 0) {
+        close();
+        return rc;
+    }
+
+    _channels = fmt.channels;
+    _sampleRate = fmt.sampleRate;
+    // The data chunk may claim more than the file has (i.e. a recording
+    // that wasn't closed)
+    size_t available = _fileSize - pos;
+    if (bytes > available) {
+        bytes = available;
+    }
+    _samples = _channels ? bytes / (2 * _channels) : 0;
 
-    if (samples > maxSamples) {
-        return maxSamples;
+    // Chunks start on even offsets so the samples are normally aligned
+    const uint8_t* data = _file + pos;
+    if (isLittleEndian() && ((uintptr_t)data & 1) == 0) {
+        _pcm = (const int16_t*)data;
     } else {
-        return samples;        
+        _pcmCopy.resize((size_t)_samples * _channels);
+        for (size_t i = 0; i < _pcmCopy.size(); i++) {
+            _pcmCopy[i] = get16LE(data + 2 * i);
+        }
+        _pcm = _pcmCopy.data();
     }
+    return 0;
 }
 
+void WavReader::close() {
+#ifdef WAV_MMAP
+    if (_mapped) {
+        munmap((void*)_file, _fileSize);
+    }
+#endif
+    _mapped = false;
+    _file = 0;
+    _fileSize = 0;
+    _fileCopy.clear();
+    _pcmCopy.clear();
+    _pcm = 0;
+    _channels = 0;
+    _sampleRate = 0;
+    _samples = 0;
+    _position = 0;
 }
 
+uint32_t WavReader::next(uint32_t maxSamples, const int16_t** pcm) {
+    uint32_t n = _samples - _position;
+    if (n > maxSamples) {
+        n = maxSamples;
+    }
+    *pcm = _pcm + (size_t)_position * _channels;
+    _position += n;
+    return n;
+}
+
+// ----- WavWriter -------------------------------------------------------------
+
+WavWriter::WavWriter()
+:   _used(0),
+    _channels(1),
+    _dataBytes(0) {
+}
+
+WavWriter::~WavWriter() {
+    close();
+}
+
+int WavWriter::open(const char* fileName, uint32_t sampleRate, uint16_t channels) {
+
+    close();
+
+    _str.open(fileName, std::ios::binary | std::ios::trunc);
+    if (!_str.good()) {
+        return -5;
+    }
+    _channels = channels;
+    _dataBytes = 0;
+    _used = 0;
+    _buffer.resize(64 * 1024);
+
+    // The sizes are filled in by close()
+    uint8_t h[HEADER_BYTES];
+    makeHeader(h, sampleRate, channels, 0);
+    _str.write((const char*)h, HEADER_BYTES);
+    return 0;
+}
+
+void WavWriter::write(const int16_t pcm[], uint32_t samples) {
+    // Nothing to write to (open() wasn't called or failed)
+    if (!_str.is_open()) {
+        return;
+    }
+    size_t n = (size_t)samples * _channels;
+    for (size_t i = 0; i < n; i++) {
+        if (_used == _buffer.size()) {
+            flush();
+        }
+        put16LE(&_buffer[_used], pcm[i]);
+        _used += 2;
+    }
+    _dataBytes += n * 2;
+}
+
+void WavWriter::flush() {
+    _str.write((const char*)_buffer.data(), _used);
+    _used = 0;
+}
+
+int WavWriter::close() {
+
+    if (!_str.is_open()) {
+        return 0;
+    }
+
+    flush();
+
+    uint8_t b[4];
+    put32LE(b, _dataBytes + 36);
+    _str.seekp(4);
+    _str.write((const char*)b, 4);
+    put32LE(b, _dataBytes);
+    _str.seekp(40);
+    _str.write((const char*)b, 4);
+
+    int rc = _str.good() ? 0 : -6;
+    _str.close();
+    return rc;
+}
+
+}
@@ -30,6 +30,7 @@ const uint LED_PIN = 25;
 #endif
 
 #include "fixed_math.h"
+#include "tables.h"
 #include "gsm-0610-codec/Parameters.h"
 #include "gsm-0610-codec/Encoder.h"
 #include "gsm-0610-codec/Decoder.h"
@@ -197,6 +198,9 @@ static void math_tests() {
         b = -1;
         // We should saturate here
         assert(L_add(a, b) == a);
+
+        // The wrapped result is zero in this case
+        assert(L_add(a, a) == a);
     }
 
     // 32-bit subtraction
@@ -252,6 +256,100 @@ static void math_tests() {
     }
 }
 
+// The portable backend can be evaluated at compile time
+static_assert(portable::add(32000, 1000) == 32767, "add");
+static_assert(portable::norm(1) == 30, "norm");
+static_assert(portable::div(8192, 16384) == 16384, "div");
+
+/**
+ * A simple deterministic generator so that failures can be reproduced.
+ */
+static uint32_t lcg_state = 1;
+
+static uint32_t rand32() {
+    lcg_state = lcg_state * 1664525 + 1013904223;
+    return lcg_state;
+}
+
+/**
+ * Makes sure that the inline fixed-point backend that was selected for this
+ * build is bit-for-bit identical to the reference implementations.
+ */
+static void backend_tests() {
+
+    const int16_t edges[] = { -32768, -32767, -16384, -2, -1, 0, 1, 2, 16383, 16384, 32766, 32767 };
+
+    // Every var1 against the edge cases and a few random var2
+    for (int32_t i = -32768; i <= 32767; i++) {
+        int16_t a = (int16_t)i;
+        assert(s_abs(a) == ref::s_abs(a));
+        for (uint16_t j = 0; j < sizeof(edges) / sizeof(int16_t) + 4; j++) {
+            int16_t b = (j < sizeof(edges) / sizeof(int16_t)) ? edges[j] : (int16_t)rand32();
+            assert(add(a, b) == ref::add(a, b));
+            assert(sub(a, b) == ref::sub(a, b));
+            assert(mult(a, b) == ref::mult(a, b));
+            assert(mult_r(a, b) == ref::mult_r(a, b));
+            assert(L_mult(a, b) == ref::L_mult(a, b));
+            // The unsaturated versions agree wherever the result fits
+            if (a + b >= -32768 && a + b <= 32767) {
+                assert(add_nosat(a, b) == ref::add(a, b));
+            }
+            if (a - b >= -32768 && a - b <= 32767) {
+                assert(sub_nosat(a, b) == ref::sub(a, b));
+            }
+            if (a != -32768 || b != -32768) {
+                assert(mult_r_nosat(a, b) == ref::mult_r(a, b));
+            }
+        }
+        // norm() of the values used by the codec (x << 16) and a spread 
+        // of other bit patterns
+        int32_t L_a = (int32_t)((uint32_t)(uint16_t)a << 16);
+        assert(norm(L_a) == ref::norm(L_a));
+        assert(norm(L_a | 0x8000) == ref::norm(L_a | 0x8000));
+        assert(norm(a) == ref::norm(a));
+        int32_t L_b = (int32_t)rand32() >> (i & 31);
+        assert(norm(L_b) == ref::norm(L_b));
+    }
+
+    // The powers of two (and their neighbors) are the edges for norm()
+    for (uint16_t k = 0; k < 32; k++) {
+        int32_t L_a = (int32_t)((uint32_t)1 << k);
+        for (int32_t d = -1; d <= 1; d++) {
+            assert(norm(L_a + d) == ref::norm(L_a + d));
+            assert(norm(-L_a + d) == ref::norm(-L_a + d));
+        }
+    }
+
+    // Randomized 32-bit operations, including the saturation edges
+    const int32_t L_edges[] = { -2147483647 - 1, -2147483647, -1073741824, -1, 0, 1, 1073741824, 2147483647 };
+    for (uint32_t i = 0; i < 200000; i++) {
+        int32_t L_a = (i < 64) ? L_edges[i % 8] : (int32_t)rand32();
+        int32_t L_b = (i < 64) ? L_edges[i / 8] : (int32_t)rand32();
+        assert(L_add(L_a, L_b) == ref::L_add(L_a, L_b));
+        assert(L_sub(L_a, L_b) == ref::L_sub(L_a, L_b));
+        if ((int64_t)L_a + L_b == (int32_t)((int64_t)L_a + L_b)) {
+            assert(L_add_nosat(L_a, L_b) == ref::L_add(L_a, L_b));
+        }
+        if ((int64_t)L_a - L_b == (int32_t)((int64_t)L_a - L_b)) {
+            assert(L_sub_nosat(L_a, L_b) == ref::L_sub(L_a, L_b));
+        }
+        assert(norm(L_a) == ref::norm(L_a));
+    }
+
+    // div: every numerator for a spread of denominators, plus random pairs
+    for (int32_t denum = 1; denum <= 32767; denum += (denum < 64) ? 1 : 997) {
+        for (int32_t num = 0; num <= denum; num++) {
+            assert(div((int16_t)num, (int16_t)denum) == ref::div((int16_t)num, (int16_t)denum));
+        }
+    }
+    assert(div((int16_t)32767, (int16_t)32767) == ref::div(32767, 32767));
+    for (uint32_t i = 0; i < 100000; i++) {
+        int16_t denum = (int16_t)(rand32() % 32767) + 1;
+        int16_t num = (int16_t)(rand32() % (denum + 1));
+        assert(div(num, denum) == ref::div(num, denum));
+    }
+}
+
 // This is the first frame of DISK1 SEQ01 in the official test vectors
 const int16_t test_pcm_0[160] = {
     32256,
@@ -426,6 +524,70 @@ static void gsm_tests() {
            parms.LARc[3] == 11);
 }
 
+/**
+ * Checks the compile-time tables against the draft arithmetic (done 
+ * with the reference operations) and reports their sizes.
+ */
+static void table_tests() {
+
+    // Section 5.2.8
+    for (uint16_t i = 1; i <= 8; i++) {
+        for (uint16_t LARc = 0; LARc < 64; LARc++) {
+            int16_t temp1 = ref::add(LARc, Encoder::MIC[i]) << 10;
+            int16_t temp2 = Encoder::B[i] << 1;
+            temp1 = ref::sub(temp1, temp2);
+            temp1 = ref::mult_r(Encoder::INVA[i], temp1);
+            assert(LARC_TABLE.LARpp[i - 1][LARc] == ref::add(temp1, temp1));
+        }
+    }
+
+    // Section 5.3.1 + 5.2.16, against the draft's arithmetic on the 
+    // exponent and mantissa
+    for (int16_t xmaxc = 0; xmaxc < 64; xmaxc++) {
+        int16_t exp = 0;
+        if (xmaxc > 15) {
+            exp = ref::sub((xmaxc >> 3), 1);    
+        }
+        int16_t mant = ref::sub(xmaxc, (exp << 3));
+        if (mant == 0) {
+            exp = -4;
+            mant = 15;
+        } else {
+            while (mant <= 7) {
+                mant = ref::add((mant << 1), 1);
+                exp = ref::sub(exp, 1);
+            }
+        }
+        mant = ref::sub(mant, 8);
+
+        int16_t temp1 = Encoder::FAC[mant];
+        int16_t temp2 = ref::sub(6, exp);
+        // NOTE: The draft shifts by -1 when temp2 is 0, which is a right shift
+        int16_t temp3 = temp2 == 0 ? 0 : 1 << ref::sub(temp2, 1);
+        for (int16_t xMc = 0; xMc < 8; xMc++) {
+            SubSegParameters p;
+            p.Mc = xMc % 4;
+            p.xmaxc = xmaxc;
+            for (uint16_t i = 0; i < 13; i++) {
+                p.xMc[i] = (xMc + i) % 8;
+            }
+            int16_t ep[40];
+            Encoder::inverseAPCM(&p, ep);
+            for (uint16_t i = 0; i < 13; i++) {
+                // This subtraction is used to restore the sign of xMc[i]
+                int16_t temp = ref::sub((p.xMc[i] << 1), 7);
+                temp = temp << 12;
+                temp = ref::mult_r(temp1, temp);
+                temp = ref::add(temp, temp3);
+                assert(ep[p.Mc + (3 * i)] == (temp >> temp2));
+            }
+        }
+    }
+
+    cout << "LARc table bytes: " << sizeof(LARC_TABLE) << endl;
+    cout << "xMc table bytes: " << sizeof(XMC_TABLE) << endl;
+}
+
 static void platform_init() {
 #ifdef PICO_BUILD
     stdio_init_all();
@@ -454,7 +616,9 @@ int main(int, const char**) {
 
     cout << "Running tests" << endl;
     math_tests();
+    backend_tests();
     gsm_tests();
+    table_tests();
     cout << "Done" << endl;
 
     platform_shutdown();
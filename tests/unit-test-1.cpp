@@ -22,12 +22,21 @@
 #include <bitset>
 #include <string>
 #include <fstream>
+#include <sstream>
 #include <cstring>
+#include <vector>
+#include <algorithm>
 
 #include "fixed_math.h"
+#include "kernels.h"
 #include "gsm-0610-codec/Parameters.h"
+#include "gsm-0610-codec/PackedFrame.h"
 #include "gsm-0610-codec/Encoder.h"
+#include "gsm-0610-codec/EncoderBank.h"
 #include "gsm-0610-codec/Decoder.h"
+#include "gsm-0610-codec/DecoderBank.h"
+#include "gsm-0610-codec/StreamingEncoder.h"
+#include "gsm-0610-codec/IncrementalEncoder.h"
 #include "gsm-0610-codec/wav_util.h"
 
 // Utility
@@ -35,6 +44,31 @@
 
 using namespace kc1fsz;
 
+/**
+ * A simple deterministic generator so that failures can be reproduced.
+ */
+static uint32_t lcg_state = 1;
+
+static int16_t rand16(int16_t lo, int16_t hi) {
+    lcg_state = lcg_state * 1664525 + 1013904223;
+    return lo + (int16_t)((lcg_state >> 8) % (uint32_t)(hi - lo + 1));
+}
+
+static void random_params(Parameters* p) {
+    for (uint16_t i = 0; i < 8; i++) {
+        p->LARc[i] = rand16(0, (1 << PackedFrame::LARC_BITS[i]) - 1);
+    }
+    for (uint16_t j = 0; j < 4; j++) {
+        p->subSegs[j].Nc = rand16(0, 127);
+        p->subSegs[j].bc = rand16(0, 3);
+        p->subSegs[j].Mc = rand16(0, 3);
+        p->subSegs[j].xmaxc = rand16(0, 63);
+        for (uint16_t i = 0; i < 13; i++) {
+            p->subSegs[j].xMc[i] = rand16(0, 7);
+        }
+    }
+}
+
 static void pack_tests() {
 
     {    
@@ -68,6 +102,614 @@ static void pack_tests() {
         assert(parms2.isEqualTo(parms));
    }
 
+    // The word-wise packer against the one-bit-at-a-time layout
+    for (uint16_t t = 0; t < 500; t++) {
+        Parameters parms;
+        random_params(&parms);
+
+        uint8_t expected[33];
+        PackingState state;
+        Parameters::pack1(expected, &state, 0x0d, 4);
+        for (uint16_t i = 0; i < 8; i++) {
+            Parameters::pack1(expected, &state, parms.LARc[i], PackedFrame::LARC_BITS[i]);
+        }
+        for (uint16_t j = 0; j < 4; j++) {
+            parms.subSegs[j].pack(expected, &state);
+        }
+        assert(state.bitsUsed() == 264);
+
+        uint8_t area[33];
+        parms.pack(area);
+        assert(memcmp(area, expected, 33) == 0);
+
+        Parameters parms2;
+        parms2.unpack(area);
+        assert(parms2.isEqualTo(parms));
+
+        // Frames that don't start on a byte boundary take the slow path
+        uint8_t area2[34];
+        PackingState state2;
+        Parameters::pack1(area2, &state2, 0b101, 3);
+        parms.pack(area2, &state2);
+        assert(state2.bitsUsed() == 267);
+        state2.reset();
+        assert(Parameters::unpack1(area2, &state2, 3) == 0b101);
+        Parameters parms3;
+        parms3.unpack(area2, &state2);
+        assert(parms3.isEqualTo(parms));
+    }
+
+    // Batches
+    {
+        Parameters frames[16];
+        for (uint16_t i = 0; i < 16; i++) {
+            random_params(&frames[i]);
+        }
+        uint8_t area[16 * 33];
+        Parameters::packBatch(frames, 16, area);
+        for (uint16_t i = 0; i < 16; i++) {
+            uint8_t one[33];
+            frames[i].pack(one);
+            assert(memcmp(one, area + (i * 33), 33) == 0);
+            assert(Parameters::isValidFrame(area + (i * 33)));
+        }
+        Parameters frames2[16];
+        Parameters::unpackBatch(area, 16, frames2);
+        for (uint16_t i = 0; i < 16; i++) {
+            assert(frames2[i].isEqualTo(frames[i]));
+        }
+    }
+
+}
+
+/**
+ * Compares the vectorized kernels to the scalar versions using random
+ * data that respects the documented input ranges.
+ */
+static void kernel_tests() {
+
+    // LTP lag search, including full-scale history and the |wt| == 512 limit
+    for (uint16_t t = 0; t < 2000; t++) {
+        int16_t wt[40], dp[120];
+        int16_t wtLimit = (t % 4 == 0) ? 512 : rand16(0, 512);
+        for (uint16_t k = 0; k < 40; k++) {
+            wt[k] = (t % 8 == 1) ? -512 : rand16(-wtLimit, wtLimit);
+        }
+        for (uint16_t k = 0; k < 120; k++) {
+            dp[k] = (t % 8 == 1) ? -32768 : rand16(-32768, 32767);
+        }
+        int32_t L_max0, L_max1;
+        int16_t Nc0 = ltpLagSearchScalar(wt, dp, &L_max0);
+        int16_t Nc1 = ltpLagSearch(wt, dp, &L_max1);
+        assert(Nc0 == Nc1);
+        assert(L_max0 == L_max1);
+        assert(Nc0 >= 40 && Nc0 <= 120);
+
+        // The reduced search is exhaustive at step 1 and always finds the
+        // maximum when it is hinted
+        int16_t noHints[2] = { 0, 0 };
+        assert(ltpLagSearchReduced(wt, dp, 1, noHints, 2, &L_max1) == Nc0);
+        assert(L_max1 == L_max0);
+        for (uint16_t step = 2; step <= 8; step *= 2) {
+            int16_t hints[2] = { 0, Nc0 };
+            assert(ltpLagSearchReduced(wt, dp, step, hints, 2, &L_max1) == Nc0);
+            assert(L_max1 == L_max0);
+            int16_t Nc2 = ltpLagSearchReduced(wt, dp, step, noHints, 2, &L_max1);
+            assert(Nc2 >= 40 && Nc2 <= 120);
+            assert(L_max1 <= L_max0);
+        }
+    }
+
+    // Autocorrelation across every scaling factor, including silence 
+    // and the -32768 special case of s_abs()
+    for (uint16_t t = 0; t < 2000; t++) {
+        int16_t s0[160], s1[160];
+        int16_t limit = (t % 16 == 0) ? 0 : (int16_t)(32767 >> (t % 6));
+        for (uint16_t k = 0; k < 160; k++) {
+            s0[k] = rand16(-limit, limit);
+        }
+        if (t % 16 == 3) {
+            s0[t % 160] = -32768;
+        }
+        memcpy(s1, s0, sizeof(s0));
+        assert(autocorrelationMaxScalar(s0) == autocorrelationMax(s1));
+        int32_t L_ACF0[9], L_ACF1[9];
+        autocorrelationScalar(s0, L_ACF0);
+        autocorrelation(s1, L_ACF1);
+        assert(memcmp(L_ACF0, L_ACF1, sizeof(L_ACF0)) == 0);
+        assert(memcmp(s0, s1, sizeof(s0)) == 0);
+    }
+
+    // RPE encoding, including residuals large enough to saturate the 
+    // weighting filter
+    for (uint16_t t = 0; t < 2000; t++) {
+        int16_t e[40];
+        int16_t limit = (t % 16 == 0) ? 0 : (int16_t)(32767 >> (t % 12));
+        for (uint16_t k = 0; k < 40; k++) {
+            e[k] = rand16(-limit, limit);
+        }
+        if (t % 16 == 5) {
+            e[t % 40] = -32768;
+        }
+        int16_t Mc0, xmaxc0, xMc0[13];
+        int16_t Mc1, xmaxc1, xMc1[13];
+        rpeEncodeScalar(e, &Mc0, &xmaxc0, xMc0);
+        rpeEncode(e, &Mc1, &xmaxc1, xMc1);
+        assert(Mc0 == Mc1);
+        assert(xmaxc0 == xmaxc1);
+        assert(memcmp(xMc0, xMc1, sizeof(xMc0)) == 0);
+    }
+}
+
+/**
+ * Loads a raw little-endian 16-bit PCM file.
+ */
+static std::vector<int16_t> load_pcm(const char* fn) {
+    std::ifstream inp_file(fn, std::ios::binary);
+    if (!inp_file.good()) {
+        assert(false);
+    }
+    std::vector<int16_t> result;
+    uint8_t f[2];
+    while (inp_file.read((char*)f, 2)) {
+        result.push_back((int16_t)(((uint16_t)f[1] << 8) | (uint16_t)f[0]));
+    }
+    return result;
+}
+
+/**
+ * Runs a bank of encoders/decoders next to standalone encoders/decoders 
+ * and makes sure that every lane comes out the same.  13 lanes are used so that the 
+ * vectorized groups and the scalar leftovers are both covered.
+ */
+static void bank_tests() {
+
+    const unsigned N = 13;
+    const unsigned frames = 300;
+
+    std::vector<int16_t> seqs[4] = {
+        load_pcm("../tests/data/Seq01.inp"),
+        load_pcm("../tests/data/Seq02.inp"),
+        load_pcm("../tests/data/Seq03.inp"),
+        load_pcm("../tests/data/Seq04.inp")
+    };
+
+    EncoderBank<N> bank;
+    Encoder encoders[N];
+    DecoderBank<N> decoderBank;
+    Decoder decoders[N];
+
+    for (unsigned frame = 0; frame < frames; frame++) {
+
+        int16_t pcm[N][160];
+        for (unsigned lane = 0; lane < N; lane++) {
+            for (uint16_t k = 0; k < 160; k++) {
+                if (lane < 8) {
+                    // The ETSI sequences, each lane at a different offset
+                    const std::vector<int16_t>& seq = seqs[lane % 4];
+                    pcm[lane][k] = seq[((frame + lane * 17) * 160 + k) % seq.size()];
+                } else if (lane == 8) {
+                    // Full-scale noise
+                    pcm[lane][k] = rand16(-32768, 32767);
+                } else if (lane == 9) {
+                    // Full-scale square wave to push the offset compensation
+                    pcm[lane][k] = ((frame * 160 + k) / 400) % 2 ? 32767 : -32768;
+                } else if (lane == 10) {
+                    // Silence
+                    pcm[lane][k] = 0;
+                } else {
+                    pcm[lane][k] = rand16(-(int16_t)(4096 >> (frame % 8)), 4096 >> (frame % 8));
+                }
+            }
+            // Drop in the occasional homing frame
+            if (frame % 37 == lane) {
+                for (uint16_t k = 0; k < 160; k++) {
+                    pcm[lane][k] = 1;
+                }
+            }
+        }
+
+        const int16_t* inputs[N];
+        for (unsigned lane = 0; lane < N; lane++) {
+            inputs[lane] = pcm[lane];
+        }
+        Parameters bankParams[N];
+        bank.encode(inputs, bankParams);
+
+        for (unsigned lane = 0; lane < N; lane++) {
+            Parameters params;
+            encoders[lane].encode(pcm[lane], &params);
+            assert(bankParams[lane].isEqualTo(params));
+        }
+
+        // Decode what was just encoded.  Every so often a lane is 
+        // given random parameters to exercise the full range of the 
+        // synthesis filter.
+        if (frame % 5 == 0) {
+            random_params(&bankParams[frame % N]);
+        }
+
+        int16_t bankPcm[N][160];
+        int16_t* outputs[N];
+        for (unsigned lane = 0; lane < N; lane++) {
+            outputs[lane] = bankPcm[lane];
+        }
+        decoderBank.decode(bankParams, outputs);
+
+        for (unsigned lane = 0; lane < N; lane++) {
+            int16_t outPcm[160];
+            decoders[lane].decode(&(bankParams[lane]), outPcm);
+            assert(memcmp(outPcm, bankPcm[lane], sizeof(outPcm)) == 0);
+        }
+    }
+}
+
+static void batch_tests() {
+
+    std::vector<int16_t> pcm = load_pcm("../tests/data/Seq02.inp");
+    const size_t frames = pcm.size() / 160;
+
+    // The whole sequence in one call vs. one frame at a time
+    Encoder batchEncoder, encoder;
+    std::vector<uint8_t> batchPacked(frames * 33), packed(frames * 33);
+    batchEncoder.encodeFrames(pcm.data(), frames, batchPacked.data());
+    for (size_t f = 0; f < frames; f++) {
+        encoder.encode(&pcm[f * 160], &packed[f * 33]);
+    }
+    assert(batchPacked == packed);
+
+    // Also in uneven pieces, to check that the state carries over
+    Encoder pieceEncoder;
+    for (size_t f = 0; f < frames; f += 7) {
+        size_t n = std::min<size_t>(7, frames - f);
+        pieceEncoder.encodeFrames(&pcm[f * 160], n, &packed[f * 33]);
+    }
+    assert(batchPacked == packed);
+
+    Decoder batchDecoder, decoder;
+    std::vector<int16_t> batchOut(frames * 160), out(frames * 160);
+    batchDecoder.decodeFrames(packed.data(), frames, batchOut.data());
+    for (size_t f = 0; f < frames; f++) {
+        decoder.decode(&packed[f * 33], &out[f * 160]);
+    }
+    assert(batchOut == out);
+}
+
+static void streaming_tests() {
+
+    std::vector<int16_t> pcm = load_pcm("../tests/data/Seq03.inp");
+    const size_t frames = pcm.size() / 160;
+
+    Encoder encoder;
+    std::vector<uint8_t> expected(frames * 33);
+    encoder.encodeFrames(pcm.data(), frames, expected.data());
+
+    // Device periods that do and don't line up with the frames, and 
+    // random chunk sizes (including empty ones)
+    const size_t chunkSizes[] = { 1, 80, 160, 441, 480, 0 };
+    for (size_t chunkSize : chunkSizes) {
+
+        // Through the callback
+        StreamingEncoder streamer;
+        std::vector<uint8_t> packed;
+        for (size_t k = 0; k < pcm.size(); ) {
+            size_t n = chunkSize ? chunkSize : (size_t)rand16(0, 700);
+            n = std::min(n, pcm.size() - k);
+            size_t expectedFrames = streamer.framesFor(n);
+            size_t count = streamer.write(&pcm[k], n, [&packed](const uint8_t* frame) {
+                packed.insert(packed.end(), frame, frame + 33);
+            });
+            assert(count == expectedFrames);
+            k += n;
+        }
+        assert(streamer.pending() == pcm.size() % 160);
+        assert(packed == expected);
+
+        // Into a span
+        StreamingEncoder spanStreamer;
+        std::vector<uint8_t> out(frames * 33);
+        size_t outFrames = 0;
+        for (size_t k = 0; k < pcm.size(); ) {
+            size_t n = chunkSize ? chunkSize : (size_t)rand16(0, 700);
+            n = std::min(n, pcm.size() - k);
+            outFrames += spanStreamer.write(&pcm[k], n, &out[outFrames * 33]);
+            k += n;
+        }
+        assert(outFrames == frames);
+        assert(out == expected);
+    }
+
+    // The last partial frame is padded with silence
+    StreamingEncoder streamer;
+    streamer.write(pcm.data(), 100, [](const uint8_t*) { assert(false); });
+    uint8_t packed[33];
+    assert(streamer.flush([&packed](const uint8_t* frame) { memcpy(packed, frame, 33); }) == 1);
+    assert(streamer.pending() == 0);
+    int16_t padded[160] = { 0 };
+    memcpy(padded, pcm.data(), 100 * sizeof(int16_t));
+    Encoder padEncoder;
+    uint8_t expectedPacked[33];
+    padEncoder.encode(padded, expectedPacked);
+    assert(memcmp(packed, expectedPacked, 33) == 0);
+}
+
+static std::string le32(uint32_t i) {
+    std::string r(4, 0);
+    for (unsigned k = 0; k < 4; k++) {
+        r[k] = (char)((i >> (8 * k)) & 0xff);
+    }
+    return r;
+}
+
+static void writeFile(const char* fn, const std::string& bytes) {
+    std::ofstream str(fn, std::ios::binary);
+    str.write(bytes.data(), bytes.size());
+}
+
+static void wav_tests() {
+
+    std::vector<int16_t> pcm(160 * 100 + 7);
+    for (size_t k = 0; k < pcm.size(); k++) {
+        pcm[k] = rand16(-32768, 32767);
+    }
+    std::stringstream str;
+    encodeFromPCM16(pcm.data(), pcm.size(), str, 8000);
+    const std::string bytes = str.str();
+    const char* fn = "../tmp/wav-test.wav";
+
+    // The writer (in chunks that don't line up with its buffer) makes 
+    // the same file as encodeFromPCM16()
+    {
+        WavWriter writer;
+        assert(writer.open(fn, 8000) == 0);
+        for (size_t k = 0; k < pcm.size(); k += 333) {
+            writer.write(&pcm[k], std::min<size_t>(333, pcm.size() - k));
+        }
+        assert(writer.close() == 0);
+        std::ifstream in(fn, std::ios::binary);
+        std::stringstream file;
+        file << in.rdbuf();
+        assert(file.str() == bytes);
+    }
+
+    // The reader hands out the same samples, all at once and in blocks
+    {
+        WavReader reader;
+        assert(reader.open(fn) == 0);
+        assert(reader.channels() == 1);
+        assert(reader.sampleRate() == 8000);
+        assert(reader.samples() == pcm.size());
+        assert(memcmp(reader.pcm(), pcm.data(), pcm.size() * 2) == 0);
+        const int16_t* block;
+        uint32_t n;
+        size_t k = 0;
+        while ((n = reader.next(160, &block)) > 0) {
+            assert(memcmp(block, &pcm[k], n * 2) == 0);
+            k += n;
+        }
+        assert(k == pcm.size());
+        reader.rewind();
+        assert(reader.next(1000000, &block) == pcm.size());
+    }
+
+    // Chunks that aren't used (an odd-sized LIST, padded, and a fact) 
+    // are skipped
+    {
+        std::string chunks = bytes.substr(0, 36) + "LIST" + le32(5) + "hello" + 
+            std::string(1, 0) + "fact" + le32(4) + le32(pcm.size()) + bytes.substr(36);
+        std::stringstream in(chunks);
+        std::vector<int16_t> back(pcm.size() + 10);
+        assert(decodeToPCM16(in, back.data(), back.size()) == (int)pcm.size());
+        assert(memcmp(back.data(), pcm.data(), pcm.size() * 2) == 0);
+
+        writeFile(fn, chunks);
+        WavReader reader;
+        assert(reader.open(fn) == 0);
+        assert(reader.samples() == pcm.size());
+        assert(memcmp(reader.pcm(), pcm.data(), pcm.size() * 2) == 0);
+    }
+
+    // A recording that was never closed claims more data than it has
+    {
+        std::string open = bytes.substr(0, 40) + le32(0xffffffff) + bytes.substr(44);
+        std::stringstream in(open);
+        std::vector<int16_t> back(pcm.size() + 10);
+        assert(decodeToPCM16(in, back.data(), back.size()) == (int)pcm.size());
+
+        writeFile(fn, open);
+        WavReader reader;
+        assert(reader.open(fn) == 0);
+        assert(reader.samples() == pcm.size());
+    }
+
+    // Errors
+    {
+        std::stringstream noData(bytes.substr(0, 36));
+        assert(decodeToPCM16(noData, pcm.data(), pcm.size()) == -1);
+        std::string stereo = bytes;
+        stereo[22] = 2;
+        std::stringstream in(stereo);
+        assert(decodeToPCM16(in, pcm.data(), pcm.size()) == -3);
+        writeFile(fn, stereo);
+        WavReader reader;
+        assert(reader.open(fn) == 0);
+        assert(reader.channels() == 2);
+        assert(reader.samples() == pcm.size() / 2);
+        assert(reader.open("../tmp/does-not-exist.wav") == -5);
+        // A writer that was never opened (or failed to open) ignores the 
+        // samples
+        WavWriter unopened;
+        unopened.write(pcm.data(), pcm.size());
+        assert(unopened.close() == 0);
+        WavWriter failed;
+        assert(failed.open("../tmp/no-such-dir/out.wav", 8000) == -5);
+        failed.write(pcm.data(), pcm.size());
+        assert(failed.close() == 0);
+    }
+}
+
+static void channel_tests() {
+
+    // A call recording: one ETSI sequence on each channel
+    std::vector<int16_t> left = load_pcm("../tests/data/Seq03.inp");
+    std::vector<int16_t> right = load_pcm("../tests/data/Seq04.inp");
+    const size_t frames = std::min(left.size(), right.size()) / 160;
+    const uint32_t samples = frames * 160 + 37;
+    left.resize(samples);
+    right.resize(samples);
+    std::vector<int16_t> stereo(samples * 2);
+    for (size_t k = 0; k < samples; k++) {
+        stereo[2 * k] = left[k];
+        stereo[2 * k + 1] = right[k];
+    }
+
+    // Each channel encodes the same as it does on its own
+    std::vector<uint8_t> expected[2] = { 
+        std::vector<uint8_t>(frames * 33), std::vector<uint8_t>(frames * 33) };
+    Encoder().encodeFrames(left.data(), frames, expected[0].data());
+    Encoder().encodeFrames(right.data(), frames, expected[1].data());
+    std::vector<uint8_t> packed[2] = { 
+        std::vector<uint8_t>(frames * 33), std::vector<uint8_t>(frames * 33) };
+    uint8_t* packedOut[2] = { packed[0].data(), packed[1].data() };
+    encodeChannels(stereo.data(), 2, samples, packedOut);
+    assert(packed[0] == expected[0]);
+    assert(packed[1] == expected[1]);
+
+    // And decodes into the right slots of the interleaved output
+    std::vector<int16_t> mono[2] = { 
+        std::vector<int16_t>(frames * 160), std::vector<int16_t>(frames * 160) };
+    Decoder().decodeFrames(expected[0].data(), frames, mono[0].data());
+    Decoder().decodeFrames(expected[1].data(), frames, mono[1].data());
+    std::vector<int16_t> out(frames * 160 * 2);
+    const uint8_t* packedIn[2] = { packed[0].data(), packed[1].data() };
+    decodeChannels(packedIn, 2, frames, out.data());
+    for (size_t k = 0; k < frames * 160; k++) {
+        assert(out[2 * k] == mono[0][k]);
+        assert(out[2 * k + 1] == mono[1][k]);
+    }
+
+    // Stereo .WAV in and out
+    std::stringstream str;
+    encodeFromPCM16(stereo.data(), samples, 2, str, 8000);
+    std::vector<int16_t> back(stereo.size());
+    uint16_t channels = 0;
+    assert(decodeToPCM16(str, back.data(), back.size(), &channels) == (int)samples);
+    assert(channels == 2);
+    assert(back == stereo);
+    // The room is counted in int16s, a partial frame isn't read
+    int16_t few[6] = { 0 };
+    str.seekg(0);
+    assert(decodeToPCM16(str, few, 5, &channels) == 2);
+    assert(few[3] == stereo[3] && few[4] == 0);
+    // The mono version rejects the file before reading any samples
+    few[0] = 0;
+    str.seekg(0);
+    assert(decodeToPCM16(str, few, 1) == -3);
+    assert(few[0] == 0);
+
+    const char* fn = "../tmp/stereo-test.wav";
+    {
+        WavWriter writer;
+        assert(writer.open(fn, 8000, 2) == 0);
+        writer.write(stereo.data(), samples);
+        assert(writer.close() == 0);
+    }
+    WavReader reader;
+    assert(reader.open(fn) == 0);
+    assert(reader.channels() == 2);
+    assert(reader.samples() == samples);
+    encodeChannels(reader.pcm(), reader.channels(), reader.samples(), packedOut);
+    assert(packed[0] == expected[0]);
+    assert(packed[1] == expected[1]);
+}
+
+// A policy for development: fixed-point only, checked and instrumented
+struct CheckedPolicy : public DefaultPolicy {
+    static constexpr Analysis analysis = Analysis::FIXED;
+    static constexpr bool boundsChecking = true;
+    static constexpr bool instrumentation = true;
+};
+
+struct NoHomingPolicy : public DefaultPolicy {
+    static constexpr Homing homing = Homing::NEVER;
+};
+
+struct HomingPolicy : public DefaultPolicy {
+    static constexpr Homing homing = Homing::ALWAYS;
+};
+
+static void policy_tests() {
+
+    // The compile-time setting wins over the runtime one
+    BasicEncoder<NoHomingPolicy> noHoming(true);
+    BasicEncoder<HomingPolicy> homing(false);
+    Encoder fresh;
+    BasicEncoder<CheckedPolicy> checked;
+    checked.setFloatAnalysis(true);
+    assert(!checked.isFloatAnalysis());
+
+    int16_t pcm[160];
+    Parameters p0, p1, p2;
+    for (unsigned frame = 0; frame < 20; frame++) {
+        for (uint16_t k = 0; k < 160; k++) {
+            pcm[k] = rand16(-8192, 8191);
+        }
+        noHoming.encode(pcm, &p0);
+        homing.encode(pcm, &p1);
+        assert(p0.isEqualTo(p1));
+    }
+
+    // After a homing frame only the one with homing starts over
+    for (uint16_t k = 0; k < 160; k++) {
+        pcm[k] = 1;
+    }
+    noHoming.encode(pcm, &p0);
+    homing.encode(pcm, &p1);
+    for (uint16_t k = 0; k < 160; k++) {
+        pcm[k] = rand16(-8192, 8191);
+    }
+    noHoming.encode(pcm, &p0);
+    homing.encode(pcm, &p1);
+    fresh.encode(pcm, &p2);
+    assert(p1.isEqualTo(p2));
+    assert(!p0.isEqualTo(p2));
+
+    // The same for the incremental encoder
+    BasicIncrementalEncoder<HomingPolicy> incremental;
+    for (uint16_t k = 0; k < 160; k++) {
+        incremental.push(pcm[k], &p0);
+    }
+    for (uint16_t k = 0; k < 160; k++) {
+        incremental.push(1, &p0);
+    }
+    for (uint16_t k = 0; k < 160; k++) {
+        incremental.push(pcm[k], &p0);
+    }
+    assert(p0.isEqualTo(p2));
+
+    // The instrumentation doesn't depend on the build
+    checked.encode(pcm, &p0);
+    assert(checked.getStats().frames == 1);
+    static_assert(!DefaultPolicy::instrumentation, "DefaultPolicy is fixed");
+    BasicEncoder<InstrumentedPolicy> instrumented;
+    instrumented.encode(pcm, &p0);
+    assert(instrumented.getStats().frames == 1);
+    assert(instrumented.getStats().stageNs[EncoderStats::LTP] > 0);
+    assert(instrumented.getStats().stageNs[EncoderStats::RPE] > 0);
+    BasicDecoder<CheckedPolicy> checkedDecoder;
+    checkedDecoder.decode(&p0, pcm);
+    assert(checkedDecoder.getStats().frames == 1);
+    checkedDecoder.clearStats();
+    assert(checkedDecoder.getStats().frames == 0);
+
+    // Every frame the encoder produces is in range
+    Parameters bad = p0;
+    assert(bad.isInRange());
+    bad.subSegs[2].Mc = 4;
+    assert(!bad.isInRange());
+    bad = p0;
+    bad.LARc[7] = 8;
+    assert(!bad.isInRange());
 }
 
 static void test_wav(const char* inFn, const char* outFn) {
@@ -117,9 +759,32 @@ static int encoder_test(const char* baseFn) {
 
     // 76 parameters, each coded in 16-bit words
     assert(sizeof(Parameters) == 76 * 2);
+    // The same thing packed
+    assert(sizeof(PackedFrame) == 33);
 
     // This is stateful so we keep it outside of the mail loop
     Encoder encoder;
+    // Another one that writes packed frames
+    Encoder packedEncoder;
+    // Another one that uses an external workspace
+    Encoder wsEncoder;
+    Encoder::Workspace ws;
+    // A specialized one, which must still be bit-exact
+    BasicEncoder<CheckedPolicy> checkedEncoder;
+    // Ones that take a sample at a time, which must be bit-exact
+    IncrementalEncoder incrementalEncoder;
+    BasicIncrementalEncoder<CheckedPolicy> checkedIncrementalEncoder;
+    // Another one at the highest complexity level, which isn't bit-exact.  
+    // The error after decoding is compared with the bit-exact path.
+    Encoder fastEncoder;
+    fastEncoder.setComplexity(Encoder::MAX_COMPLEXITY + 1);
+    assert(fastEncoder.getComplexity() == Encoder::MAX_COMPLEXITY);
+    // The float analysis, which isn't bit-exact either.  The error after 
+    // decoding is compared with the fixed-point path.
+    Encoder floatEncoder;
+    floatEncoder.setFloatAnalysis(true);
+    Decoder fixedDecoder, fastDecoder, floatDecoder;
+    double fixedNoise = 0, fastNoise = 0, floatNoise = 0;
     int segmentCount = 0;
 
     std::string inp_fn = baseFn;
@@ -170,12 +835,71 @@ static int encoder_test(const char* baseFn) {
 
         assert(computed_params.isEqualTo(expected_params));
 
+        uint8_t expected_packed[33], computed_packed[33];
+        expected_params.pack(expected_packed);
+        packedEncoder.encode(inp_pcm, computed_packed);
+        assert(memcmp(expected_packed, computed_packed, 33) == 0);
+
+        wsEncoder.encode(inp_pcm, &computed_params, &ws);
+        assert(computed_params.isEqualTo(expected_params));
+
+        checkedEncoder.encode(inp_pcm, &computed_params);
+        assert(computed_params.isEqualTo(expected_params));
+
+        for (uint16_t i = 0; i < 160; i++) {
+            assert(incrementalEncoder.pending() == i);
+            assert(incrementalEncoder.push(inp_pcm[i], &computed_params) == (i == 159));
+        }
+        assert(incrementalEncoder.pending() == 0);
+        assert(computed_params.isEqualTo(expected_params));
+
+        for (uint16_t i = 0; i < 160; i++) {
+            if (checkedIncrementalEncoder.push(inp_pcm[i], computed_packed)) {
+                assert(i == 159);
+            }
+        }
+        assert(memcmp(expected_packed, computed_packed, 33) == 0);
+
+        int16_t fixed_pcm[160], fast_pcm[160], float_pcm[160];
+        fixedDecoder.decode(&expected_params, fixed_pcm);
+        fastEncoder.encode(inp_pcm, &computed_params);
+        for (uint16_t j = 0; j < 4; j++) {
+            assert(computed_params.subSegs[j].Nc >= 40 && 
+                computed_params.subSegs[j].Nc <= 120);
+        }
+        fastDecoder.decode(&computed_params, fast_pcm);
+        floatEncoder.encode(inp_pcm, &computed_params);
+        floatDecoder.decode(&computed_params, float_pcm);
+        for (uint16_t i = 0; i < 160; i++) {
+            double e0 = (double)inp_pcm[i] - fixed_pcm[i];
+            double e1 = (double)inp_pcm[i] - float_pcm[i];
+            double e2 = (double)inp_pcm[i] - fast_pcm[i];
+            fixedNoise += e0 * e0;
+            floatNoise += e1 * e1;
+            fastNoise += e2 * e2;
+        }
+
         segmentCount++;
     }
 
     inp_file.close();
     cod_file.close();
 
+    // Within 1 dB of the fixed-point path
+    assert(floatNoise <= fixedNoise * 1.26);
+    // The reduced lag search is within 0.5 dB of the full search (0.18 dB
+    // at worst on the test sequences)
+    assert(fastNoise <= fixedNoise * 1.12);
+
+    // Instrumentation counters
+#ifdef GSM_INSTRUMENTATION
+    assert(encoder.getStats().frames == (uint64_t)segmentCount);
+    encoder.clearStats();
+    assert(encoder.getStats().frames == 0);
+#else
+    assert(encoder.getStats().frames == 0);
+#endif
+
     return segmentCount;
 }
 
@@ -183,6 +907,16 @@ static int decoder_test(const char* baseFn) {
 
     // This is stateful so we keep it outside of the mail loop
     Decoder decoder;
+    // Another one that works from packed frames
+    Decoder packedDecoder;
+    BasicDecoder<CheckedPolicy> checkedDecoder;
+    // Ones that are pulled 40 samples at a time
+    Decoder pullDecoder;
+    BasicDecoder<CheckedPolicy> checkedPullDecoder;
+    // One that leaves blocks behind on every other frame
+    Decoder partialDecoder;
+    // One that mixes startFrame()/decodeBlock() with decode()
+    Decoder mixedDecoder;
     int segmentCount = 0;
 
     std::string cod_fn = baseFn;
@@ -233,12 +967,79 @@ static int decoder_test(const char* baseFn) {
 
         assert(memcmp((void *)expected_pcm, (void*)computed_pcm, 160 * 2) == 0);
 
+        uint8_t packed[33];
+        params.pack(packed);
+        packedDecoder.decode(packed, computed_pcm);
+        assert(memcmp((void *)expected_pcm, (void*)computed_pcm, 160 * 2) == 0);
+
+        checkedDecoder.decode(&params, computed_pcm);
+        assert(memcmp((void *)expected_pcm, (void*)computed_pcm, 160 * 2) == 0);
+
+        memset(computed_pcm, 0, sizeof(computed_pcm));
+        pullDecoder.startFrame(&params);
+        for (uint16_t j = 0; j < 4; j++) {
+            assert(pullDecoder.blocksPending() == 4u - j);
+            pullDecoder.decodeBlock(computed_pcm + (j * 40));
+        }
+        assert(pullDecoder.blocksPending() == 0);
+        assert(memcmp((void *)expected_pcm, (void*)computed_pcm, 160 * 2) == 0);
+
+        // Into the right channel of interleaved output
+        int16_t stereo_pcm[320];
+        memset(stereo_pcm, 0, sizeof(stereo_pcm));
+        checkedPullDecoder.startFrame(packed);
+        for (uint16_t j = 0; j < 4; j++) {
+            checkedPullDecoder.decodeBlock(stereo_pcm + (j * 80) + 1, 2);
+        }
+        for (uint16_t i = 0; i < 160; i++) {
+            assert(stereo_pcm[2 * i] == 0);
+            assert(stereo_pcm[2 * i + 1] == expected_pcm[i]);
+        }
+
+        // The blocks that aren't pulled still go through the filters, so
+        // the frames after them are still right
+        partialDecoder.startFrame(packed);
+        if (segmentCount % 2 == 0) {
+            partialDecoder.decodeBlock(computed_pcm);
+        } else {
+            for (uint16_t j = 0; j < 4; j++) {
+                partialDecoder.decodeBlock(computed_pcm + (j * 40));
+            }
+            assert(memcmp((void *)expected_pcm, (void*)computed_pcm, 160 * 2) == 0);
+        }
+
+        // A decode() right after a partly pulled frame finishes that 
+        // frame first
+        if (segmentCount % 3 == 0) {
+            mixedDecoder.startFrame(&params);
+            mixedDecoder.decodeBlock(computed_pcm);
+            assert(memcmp((void *)expected_pcm, (void*)computed_pcm, 40 * 2) == 0);
+        } else {
+            if (segmentCount % 3 == 1) {
+                mixedDecoder.decode(&params, computed_pcm);
+            } else {
+                mixedDecoder.decode(packed, computed_pcm);
+            }
+            assert(mixedDecoder.blocksPending() == 0);
+            assert(memcmp((void *)expected_pcm, (void*)computed_pcm, 160 * 2) == 0);
+        }
+
         segmentCount++;
     }
 
     out_file.close();
     cod_file.close();
 
+    assert(checkedPullDecoder.getStats().frames == (uint64_t)segmentCount);
+    assert(checkedPullDecoder.getStats().saturatedFrames == 
+        checkedDecoder.getStats().saturatedFrames);
+
+#ifdef GSM_INSTRUMENTATION
+    assert(decoder.getStats().frames == (uint64_t)segmentCount);
+#else
+    assert(decoder.getStats().frames == 0);
+#endif
+
     return segmentCount;
 }
 
@@ -266,45 +1067,38 @@ static void etsi_test_files() {
 int main(int, const char**) {
 
     pack_tests();
+    kernel_tests();
+    bank_tests();
+    policy_tests();
+    batch_tests();
+    streaming_tests();
+    wav_tests();
+    channel_tests();
     etsi_test_files();
 
     // A demonstration of encoding a "normal" .WAV file
     {   
-        std::string inp_fn = "../tests/data/male-1.wav";
-        std::string out_fn = "../tmp/male-1-out.wav";
-
-        const uint32_t in_pcm_max = 160 * 1024;
-        int16_t in_pcm[in_pcm_max];
-
-        std::ifstream inp_file(inp_fn, std::ios::binary);
-        if (!inp_file.good()) {
-            assert(false);
-        }
-        int samples = decodeToPCM16(inp_file, in_pcm, in_pcm_max);
-        inp_file.close();
-
-        uint16_t segments = samples / 160;
+        WavReader reader;
+        assert(reader.open("../tests/data/male-1.wav") == 0);
+        WavWriter writer;
+        assert(writer.open("../tmp/male-1-out.wav", 8000) == 0);
 
         Encoder encoder;
         Decoder decoder;
 
-        int16_t out_pcm[160 * 1024];
-
-        for (uint16_t segment = 0; segment < segments; segment++) {
+        const int16_t* in_pcm;
+        while (reader.next(160, &in_pcm) == 160) {
 
             // Do the encoding 
             Parameters params;
-            encoder.encode(&(in_pcm[segment * 160]), &params);
+            encoder.encode(in_pcm, &params);
 
             // Do the decoding
-            decoder.decode(&params, &(out_pcm[segment * 160]));
+            int16_t out_pcm[160];
+            decoder.decode(&params, out_pcm);
+            writer.write(out_pcm, 160);
         }
 
-        std::ofstream out_file(out_fn, std::ios::binary);
-        if (!out_file.good()) {
-            assert(false);
-        }
-        encodeFromPCM16(out_pcm, samples, out_file, 8000);
-        out_file.close();
+        assert(writer.close() == 0);
     }
 }